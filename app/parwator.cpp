@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <bits/chrono.h>
 #include <chrono>
 #include <cstdlib>
@@ -7,12 +8,16 @@
 #include <fstream>
 #include <iostream>
 #include <numeric>
+#include <optional>
 #include <ostream>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <utility>
 #include <random>
 
 #include "execution_planner.hpp"
+#include "numa_audit.hpp"
 
 #include "posixFostream.hpp"
 #include "wator/map.hpp"
@@ -63,11 +68,14 @@ argparse::ArgumentParser buildArgParser() {
     res.add_argument("--sharks")
         .help("The initial number of sharks in the ocean, default value is 1/30-th of ocean cells").scan<'u', std::size_t>();
     res.add_argument("--fishbreed")
-        .help("The number of chronons have to pass for fish to be able to breed").default_value(3U).scan<'u', unsigned>();
+        .help("The number of chronons have to pass for fish to be able to breed, at most " + 
+              std::to_string(WaTor::Rules::MAX_FISH_BREED_TIME)).default_value(3U).scan<'u', unsigned>();
     res.add_argument("--sharkbreed")
-        .help("The number of chronons have to pass for shark to be able to breed").default_value(10U).scan<'u', unsigned>();
+        .help("The number of chronons have to pass for shark to be able to breed, at most " + 
+              std::to_string(WaTor::Rules::MAX_SHARK_BREED_TIME)).default_value(10U).scan<'u', unsigned>();
     res.add_argument("--sharkstarve")
-        .help("The number of chronons have to pass for a shark must not eat to die").default_value(3U).scan<'u', unsigned>();
+        .help("The number of chronons have to pass for a shark must not eat to die, at most " + 
+              std::to_string(WaTor::Rules::MAX_SHARK_STARVE_TIME)).default_value(3U).scan<'u', unsigned>();
     res.add_argument("--workers", "--threads")
         .help("Number of threads to run the simulation on, by default it uses all")
         .default_value(static_cast<unsigned>(std::thread::hardware_concurrency()))
@@ -75,16 +83,138 @@ argparse::ArgumentParser buildArgParser() {
     res.add_argument("--disable-ht", "-H")
         .help("Disables the use of hyperthreaded cores").default_value(false).implicit_value(true);
     res.add_argument("--seed")
-        .help("Provides seed for random number generation, warning: output is depending also on thread count")
+        .help("Provides seed for random number generation, the output does not depend on the thread count")
         .scan<'u', unsigned>();
     res.add_argument("--output")
         .help("Where to output the saved map").default_value(std::string{"/dev/null"});
     res.add_argument("--benchmark")
         .help("Gives significantly shorted output").default_value(false).implicit_value(true);
+    res.add_argument("--engine")
+        .help("Simulation engine: tile - updates one cell at a time, "
+              "bitboard - updates 64 cells at a time using bit planes (different results)")
+        .default_value(std::string{"tile"});
+    res.add_argument("--kernel")
+        .help("Instruction set of the tile engine: auto - the best one the CPU supports, "
+              "generic, avx2 or avx512")
+        .default_value(std::string{"auto"});
+    res.add_argument("--layout")
+        .help("Memory layout of the map: rows - row major, "
+              "panels - row major panels of 1024 columns, for very wide maps")
+        .default_value(std::string{"rows"});
+    res.add_argument("--strip-width")
+        .help("The tile engine sweeps strips of this many columns through the whole stripe, "
+              "0 sweeps whole rows, the results depend on it")
+        .default_value(0U).scan<'u', unsigned>();
+    res.add_argument("--huge-pages")
+        .help("Backs the map with huge pages: explicit ones if reserved, otherwise transparent ones")
+        .default_value(false).implicit_value(true);
+    res.add_argument("--stripe-height")
+        .help("The ocean is split into stripes of at least this many rows, the even ones are updated before "
+              "the odd ones, the pairs of them are handed out to the threads, every thread needs one, "
+              "the results depend on it, but not on the threads")
+        .default_value(16U).scan<'u', unsigned>();
+    res.add_argument("--scratch-dir")
+        .help("Out-of-core: keeps the map in a scratch file in this directory and sweeps it "
+              "once per chronon, about 3 stripes per thread are in the memory, see --stripe-height")
+        .default_value(std::string{});
+    res.add_argument("--persistent-workers")
+        .help("The threads stay in a loop and meet on a barrier per NUMA node and then a global one, "
+              "instead of getting a task per stripe, for small oceans and many chronons")
+        .default_value(false).implicit_value(true);
+    res.add_argument("--work-stealing")
+        .help("A thread out of its stripes updates the ones of the same parity of the others, "
+              "of its NUMA node first, use with several pairs of stripes per thread, the results do not change")
+        .default_value(false).implicit_value(true);
+    res.add_argument("--rebalance")
+        .help("Every this many chronons hands pairs of stripes from the slower threads to the faster ones next "
+              "to them on the same NUMA node, 0 disables it, use with several pairs of stripes per thread, "
+              "the results do not change, tile engine only")
+        .default_value(0U).scan<'u', unsigned>();
+    res.add_argument("--rebalance-threshold")
+        .help("With --rebalance, hands over a pair only if the run times of the threads differ by more than "
+              "this percentage")
+        .default_value(10.0).scan<'g', double>();
+    res.add_argument("--dataflow")
+        .help("No barriers between the half iterations, a stripe is updated as soon as its neighbours are done, "
+              "the results do not change")
+        .default_value(false).implicit_value(true);
+    res.add_argument("--dataflow-chronons")
+        .help("With --dataflow, the chronons the threads run without meeting, so the fast ones can get ahead, "
+              "the map is saved only after them")
+        .default_value(1U).scan<'u', unsigned>();
+    res.add_argument("--temporal-block")
+        .help("With --dataflow, a thread updates its stripes in blocks of this many chronons, skewed in time, "
+              "so they stay in the cache, use with --dataflow-chronons and at least 2 pairs of stripes per thread, "
+              "0 disables it")
+        .default_value(0U).scan<'u', unsigned>();
+    res.add_argument("--numa-audit")
+        .help("Reports on which NUMA nodes the sampled pages of the map, the queues and the stacks are, "
+              "at the start and then every this many chronons, 0 disables it")
+        .default_value(0U).scan<'u', unsigned>();
+    res.add_argument("--numa-remigrate")
+        .help("With --numa-audit, moves the memory with less than this percentage of its pages "
+              "on its NUMA node back to it, 0 disables it")
+        .default_value(0.0).scan<'g', double>();
 
     return res;
 }
 
+// the Tile has room only for ages up to max
+bool checkMax(const argparse::ArgumentParser &arg, const std::string &name, unsigned max) {
+    if(arg.get<unsigned>(name) > max) {
+        std::clog << name << " can be at most " << max << '\n';
+        return false;
+    }
+    return true;
+}
+
+WaTor::SimulationEngine parseEngine(const std::string &engine) {
+    if(engine == "tile") {
+        return WaTor::SimulationEngine::TILE;
+    }
+    if(engine == "bitboard") {
+        return WaTor::SimulationEngine::BITBOARD;
+    }
+    throw std::runtime_error("Unknown simulation engine: " + engine);
+}
+
+std::optional<WaTor::KernelIsa> parseKernelIsa(const std::string &kernel) {
+    if(kernel == "auto") {
+        return std::nullopt;
+    }
+    for(WaTor::KernelIsa isa : {WaTor::KernelIsa::GENERIC, WaTor::KernelIsa::AVX2, 
+                                WaTor::KernelIsa::AVX512}) {
+        if(kernel == WaTor::getKernelIsaName(isa)) {
+            return isa;
+        }
+    }
+    throw std::runtime_error("Unknown kernel instruction set: " + kernel);
+}
+
+WaTor::MapLineLayout parseLayout(const std::string &layout) {
+    if(layout == "rows") {
+        return WaTor::MapLineLayout::ROWS;
+    }
+    if(layout == "panels") {
+        return WaTor::MapLineLayout::PANELS;
+    }
+    throw std::runtime_error("Unknown map layout: " + layout);
+}
+
+// the pages sampled from every range
+constexpr std::size_t NUMA_AUDIT_SAMPLE_PAGES = 256;
+
+void auditNuma(const WaTor::Simulation &game, double remigratePercent) {
+    const NumaAudit audit = game.makeNumaAudit();
+    NumaAudit::print(std::clog, audit.audit(NUMA_AUDIT_SAMPLE_PAGES));
+    if(remigratePercent > 0) {
+        const std::size_t moved = audit.migrate(remigratePercent/100, NUMA_AUDIT_SAMPLE_PAGES);
+        if(moved != 0) {
+            std::clog << "Moved " << moved << " pages back to their NUMA nodes\n";
+        }
+    }
+}
+
 void printStats(WaTor::Simulation &game, std::chrono::microseconds mapAllocDur, 
                 std::chrono::microseconds mapSaveDur, bool isBench) {
     if(!isBench) {
@@ -131,6 +261,12 @@ int main(int argc, char *argv[])
         exp.printStats(std::clog);
     }
 
+    if(!checkMax(arg, "--fishbreed", WaTor::Rules::MAX_FISH_BREED_TIME) ||
+       !checkMax(arg, "--sharkbreed", WaTor::Rules::MAX_SHARK_BREED_TIME) ||
+       !checkMax(arg, "--sharkstarve", WaTor::Rules::MAX_SHARK_STARVE_TIME)) {
+        return 1;
+    }
+
     std::size_t mapSize = static_cast<std::size_t>(arg.get<unsigned>("--height")) *
                           arg.get<unsigned>("--width");
     std::size_t defaultFishCnt = std::max<std::size_t>(mapSize/10, 1);
@@ -159,26 +295,57 @@ int main(int argc, char *argv[])
     std::random_device rnd;
     auto clockStart = std::chrono::steady_clock::now();
     unsigned seed = arg.present<unsigned>("--seed") ? arg.get<unsigned>("--seed") : rnd();
-    WaTor::Simulation game(rules, exp, seed);
+    WaTor::SimulationOptions simOpts;
+    simOpts.engine = parseEngine(arg.get("--engine"));
+    simOpts.kernelIsa = parseKernelIsa(arg.get("--kernel"));
+    simOpts.layout = parseLayout(arg.get("--layout"));
+    simOpts.stripWidth = arg.get<unsigned>("--strip-width");
+    simOpts.hugePages = arg.get<bool>("--huge-pages");
+    simOpts.lineHeight = arg.get<unsigned>("--stripe-height");
+    simOpts.scratchDir = arg.get("--scratch-dir");
+    simOpts.persistentWorkers = arg.get<bool>("--persistent-workers");
+    simOpts.workStealing = arg.get<bool>("--work-stealing");
+    simOpts.rebalancePeriod = arg.get<unsigned>("--rebalance");
+    simOpts.rebalanceThreshold = arg.get<double>("--rebalance-threshold")/100;
+    simOpts.dataflowSync = arg.get<bool>("--dataflow");
+    simOpts.temporalBlock = arg.get<unsigned>("--temporal-block");
+    simOpts.allocLog = arg.get<bool>("--benchmark") ? nullptr : &std::clog;
+    WaTor::Simulation game(rules, exp, seed, simOpts);
+    if(!arg.get<bool>("--benchmark") && simOpts.engine == WaTor::SimulationEngine::TILE) {
+        std::clog << "Tile kernel: " << WaTor::getKernelIsaName(game.getKernelIsa()) << '\n';
+    }
     auto clockEnd = std::chrono::steady_clock::now();
     std::chrono::microseconds mapAllocDur = std::chrono::duration_cast<std::chrono::microseconds>(clockEnd - clockStart);
 
     std::chrono::microseconds saveMapDur{0};
     clockStart = std::chrono::steady_clock::now();
 #ifdef __unix__
-        game.getMap().saveMap(fmap, true);
+        std::as_const(game).getMap().saveMap(fmap, true);
 #else
-        game.getMap().saveMap(fmap, true);
+        std::as_const(game).getMap().saveMap(fmap, true);
 #endif // __unix__
     clockEnd = std::chrono::steady_clock::now();
     saveMapDur += std::chrono::duration_cast<std::chrono::microseconds>(clockEnd-clockStart);
 
+    // outside of the measured times
+    const unsigned numaAuditPeriod = arg.get<unsigned>("--numa-audit");
+    const double numaRemigrate = arg.get<double>("--numa-remigrate");
+    if(numaAuditPeriod != 0) {
+        auditNuma(game, numaRemigrate);
+    }
+
     unsigned iterCnt = arg.get<unsigned>("--itercnt");
-    for(unsigned i=0; i<iterCnt-1; ++i) {
-        game.doIteration();
+    const unsigned chrononsPerSync = simOpts.dataflowSync ? 
+                                     std::max(1U, arg.get<unsigned>("--dataflow-chronons")) : 1;
+    for(unsigned i=0; i<iterCnt-1; i += chrononsPerSync) {
+        const unsigned cnt = std::min(chrononsPerSync, iterCnt-1-i);
+        game.doIterations(cnt);
+        if(numaAuditPeriod != 0 && (i + cnt)/numaAuditPeriod != i/numaAuditPeriod) {
+            auditNuma(game, numaRemigrate);
+        }
 
         clockStart = std::chrono::steady_clock::now();
-        game.getMap().saveMap(fmap);
+        std::as_const(game).getMap().saveMap(fmap);
         clockEnd = std::chrono::steady_clock::now();
         saveMapDur += std::chrono::duration_cast<std::chrono::microseconds>(clockEnd-clockStart);
     }
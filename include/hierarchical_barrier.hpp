@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// a reusable barrier of threads split into groups (the NUMA nodes): the
+// threads of a group meet on a counter of their own and only the last
+// one of every group touches the shared counter, so most of the cache
+// line traffic stays on the node, the waiting threads spin for a while
+// and then sleep on a futex
+class HierarchicalBarrier {
+public:
+    // the polls of a waiting thread before it sleeps
+    static constexpr unsigned DEFAULT_SPIN_CNT = 1U << 14U;
+
+private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    struct alignas(CACHE_LINE) Group {
+        std::atomic<unsigned> arrived{0};
+        unsigned size{0};
+    };
+
+    std::unique_ptr<Group[]> m_groups; // NOLINT
+    unsigned m_groupCnt;
+    unsigned m_spinCnt;
+    alignas(CACHE_LINE) std::atomic<unsigned> m_groupsArrived{0};
+    // incremented when the last thread arrives, the futex word
+    alignas(CACHE_LINE) std::atomic<std::uint32_t> m_generation{0};
+    std::atomic<unsigned> m_sleepers{0};
+
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t) &&
+                  std::atomic<std::uint32_t>::is_always_lock_free, "the futex word");
+
+    [[nodiscard]] std::uint32_t* getFutexWord() noexcept {
+        return reinterpret_cast<std::uint32_t*>(&m_generation); // NOLINT
+    }
+
+    static void cpuRelax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    void wait(std::uint32_t generation) noexcept {
+        for(unsigned i=0; i<m_spinCnt; ++i) {
+            if(m_generation.load(std::memory_order_acquire) != generation) {
+                return;
+            }
+            cpuRelax();
+        }
+
+        // the releasing thread checks m_sleepers after it changed
+        // m_generation, and the futex does not sleep if it changed
+        while(m_generation.load(std::memory_order_acquire) == generation) {
+            m_sleepers.fetch_add(1);
+            if(m_generation.load() == generation) {
+                syscall(SYS_futex, getFutexWord(), FUTEX_WAIT_PRIVATE, generation, nullptr, nullptr, 0); // NOLINT
+            }
+            m_sleepers.fetch_sub(1);
+        }
+    }
+
+    void release() noexcept {
+        m_generation.fetch_add(1);
+        if(m_sleepers.load() != 0) {
+            syscall(SYS_futex, getFutexWord(), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0); // NOLINT
+        }
+    }
+
+public:
+    // groupSizes - the threads of every group, none can be 0
+    explicit HierarchicalBarrier(const std::vector<unsigned> &groupSizes,
+                                 unsigned spinCnt = DEFAULT_SPIN_CNT)
+        : m_groups(std::make_unique<Group[]>(groupSizes.size())), // NOLINT
+          m_groupCnt(static_cast<unsigned>(groupSizes.size())), m_spinCnt(spinCnt) {
+        assert(m_groupCnt != 0);
+        for(unsigned i=0; i<m_groupCnt; ++i) {
+            assert(groupSizes[i] != 0);
+            m_groups[i].size = groupSizes[i];
+        }
+    }
+
+    HierarchicalBarrier(const HierarchicalBarrier&) = delete;
+    HierarchicalBarrier& operator=(const HierarchicalBarrier&) = delete;
+    ~HierarchicalBarrier() = default;
+
+    [[nodiscard]] unsigned getGroupCnt() const noexcept { return m_groupCnt; }
+
+    // returns when every thread of every group arrived, what a thread
+    // wrote before it arrived is visible to all of them after that
+    void arriveAndWait(unsigned group) noexcept {
+        assert(group < m_groupCnt);
+        const std::uint32_t generation = m_generation.load(std::memory_order_acquire);
+
+        Group &grp = m_groups[group];
+        if(grp.arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == grp.size) {
+            // nobody arrives to it again before the release
+            grp.arrived.store(0, std::memory_order_relaxed);
+            if(m_groupsArrived.fetch_add(1, std::memory_order_acq_rel) + 1 == m_groupCnt) {
+                m_groupsArrived.store(0, std::memory_order_relaxed);
+                release();
+                return;
+            }
+        }
+        wait(generation);
+    }
+};
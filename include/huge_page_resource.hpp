@@ -0,0 +1,214 @@
+#pragma once
+
+#include <config.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <ostream>
+#include <string>
+
+#include <sys/mman.h>
+
+#ifdef WATOR_NUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+// maps the memory straight from the kernel, backed by huge pages:
+// explicit ones (MAP_HUGETLB) if the pool has enough free pages, otherwise
+// transparent ones (madvise(MADV_HUGEPAGE)), otherwise normal pages,
+// the mappings are whole huge pages, the allocations smaller than them are
+// carved from the rest of the last mapping, it is meant as the upstream of
+// a monotonic_buffer_resource
+class HugePageResource : public std::pmr::memory_resource {
+public:
+    enum class PageKind {
+        HUGETLB = 0,    // explicit huge pages
+        TRANSPARENT,    // transparent huge pages, if the kernel can assemble them
+        NORMAL
+    };
+
+private:
+    static constexpr std::size_t DEFAULT_HUGE_PAGE_SIZE = std::size_t{2} << 20U;
+
+    int m_numaNode;
+    std::ostream *m_log;
+    std::size_t m_hugePageSize;
+    PageKind m_lastKind{PageKind::NORMAL};
+
+    struct Mapping {
+        std::size_t bytes;
+        std::size_t allocCnt;   // it is unmapped when all are deallocated
+    };
+    // by their beginning
+    std::map<char*, Mapping> m_mappings;
+    // the rest of the last mapping
+    char *m_lastMapping{nullptr};
+    char *m_free{nullptr};
+    std::size_t m_freeBytes{0};
+
+    // the default size of the explicit huge pages, 2 MiB if unknown
+    [[nodiscard]] static std::size_t readHugePageSize() {
+        std::ifstream meminfo("/proc/meminfo");
+        std::string key;
+        while(meminfo >> key) {
+            if(key == "Hugepagesize:") {
+                std::size_t kib = 0;
+                if(meminfo >> kib && kib != 0) {
+                    return kib << 10U;
+                }
+                break;
+            }
+            meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        return DEFAULT_HUGE_PAGE_SIZE;
+    }
+
+    [[nodiscard]] std::size_t roundUp(std::size_t bytes) const noexcept {
+        return (bytes + m_hugePageSize - 1) / m_hugePageSize * m_hugePageSize;
+    }
+
+    // before the pages are touched
+    void bindToNode(void *ptr, std::size_t bytes, PageKind kind) const noexcept {
+#ifdef WATOR_NUMA
+        if(m_numaNode < 0 || numa_available() < 0) {
+            return;
+        }
+        if(kind == PageKind::HUGETLB) {
+            // the pool is reserved for the whole system, binding could
+            // fault without a free page on the node
+            struct bitmask *mask = numa_allocate_nodemask();
+            numa_bitmask_setbit(mask, static_cast<unsigned>(m_numaNode));
+            static_cast<void>(mbind(ptr, bytes, MPOL_PREFERRED, mask->maskp,
+                                    mask->size + 1, 0));
+            numa_bitmask_free(mask);
+        } else {
+            numa_tonode_memory(ptr, bytes, m_numaNode);
+        }
+#else
+        static_cast<void>(ptr); static_cast<void>(bytes); static_cast<void>(kind);
+#endif
+    }
+
+    // aligned to a huge page, so the kernel can back it with them
+    [[nodiscard]] void* mapAligned(std::size_t bytes) const {
+        const std::size_t mapped = bytes + m_hugePageSize;
+        void *raw = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(raw == MAP_FAILED) { // NOLINT
+            throw std::bad_alloc();
+        }
+        auto *beg = static_cast<char*>(raw);
+        char *aligned = beg + (m_hugePageSize - reinterpret_cast<std::uintptr_t>(beg) % m_hugePageSize) % m_hugePageSize; // NOLINT
+        if(aligned != beg) {
+            munmap(beg, static_cast<std::size_t>(aligned - beg));
+        }
+        munmap(aligned + bytes, mapped - bytes - static_cast<std::size_t>(aligned - beg)); // NOLINT
+        return aligned;
+    }
+
+    // whole huge pages
+    [[nodiscard]] void* mapPages(std::size_t bytes) {
+        void *res = MAP_FAILED; // NOLINT
+#ifdef MAP_HUGETLB
+        res = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if(res != MAP_FAILED) { // NOLINT
+            m_lastKind = PageKind::HUGETLB;
+        } else {
+            res = mapAligned(bytes);
+            m_lastKind = PageKind::NORMAL;
+#ifdef MADV_HUGEPAGE
+            if(madvise(res, bytes, MADV_HUGEPAGE) == 0) {
+                m_lastKind = PageKind::TRANSPARENT;
+            }
+#endif
+        }
+        bindToNode(res, bytes, m_lastKind);
+        logMapping(bytes);
+        return res;
+    }
+
+    void logMapping(std::size_t bytes) const {
+        if(m_log == nullptr) {
+            return;
+        }
+        *m_log << "Mapped " << (bytes >> 20U) << " MiB";
+        if(m_numaNode >= 0) {
+            *m_log << " on NUMA node " << m_numaNode;
+        }
+        *m_log << " with " << getPageKindName(m_lastKind) << " pages\n";
+    }
+
+public:
+    // numaNode - the node the pages are bound to, -1 for any,
+    // log - a line is written to it for every mapping, may be nullptr
+    explicit HugePageResource(int numaNode = -1, std::ostream *log = nullptr)
+        : m_numaNode(numaNode), m_log(log), m_hugePageSize(readHugePageSize()) { }
+
+    HugePageResource(const HugePageResource&) = delete;
+    HugePageResource& operator=(const HugePageResource&) = delete;
+    ~HugePageResource() override = default;
+
+    [[nodiscard]] static const char* getPageKindName(PageKind kind) noexcept {
+        switch(kind) {
+            case PageKind::HUGETLB: return "explicit huge";
+            case PageKind::TRANSPARENT: return "transparent huge";
+            case PageKind::NORMAL: return "normal";
+        }
+        return "unknown";
+    }
+
+    [[nodiscard]] std::size_t getHugePageSize() const noexcept { return m_hugePageSize; }
+
+    // what the last allocation got
+    [[nodiscard]] PageKind getLastPageKind() const noexcept { return m_lastKind; }
+
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if(alignment > m_hugePageSize) {
+            throw std::bad_alloc();
+        }
+        const std::size_t pad = (alignment - reinterpret_cast<std::uintptr_t>(m_free) % alignment) % alignment; // NOLINT
+        if(m_free != nullptr && pad + bytes <= m_freeBytes) {
+            char *res = m_free + pad; // NOLINT
+            m_free = res + bytes; // NOLINT
+            m_freeBytes -= pad + bytes;
+            ++m_mappings[m_lastMapping].allocCnt;
+            return res;
+        }
+
+        const std::size_t mapped = roundUp(bytes);
+        auto *res = static_cast<char*>(mapPages(mapped));
+        m_mappings.emplace(res, Mapping{mapped, 1});
+        m_lastMapping = res;
+        m_free = res + bytes; // NOLINT
+        m_freeBytes = mapped - bytes;
+        return res;
+    }
+
+    void do_deallocate(void *ptr, std::size_t /*bytes*/, std::size_t /*alignment*/) override {
+        // the mapping containing ptr
+        auto it = m_mappings.upper_bound(static_cast<char*>(ptr));
+        --it;
+        if(--it->second.allocCnt != 0) {
+            return;
+        }
+        if(it->first == m_lastMapping) {
+            m_lastMapping = nullptr;
+            m_free = nullptr;
+            m_freeBytes = 0;
+        }
+        munmap(it->first, it->second.bytes);
+        m_mappings.erase(it);
+    }
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// maps every allocation from a scratch file, shared, so the kernel writes
+// the pages out to the file instead of the swap and the allocations can be
+// larger than the RAM, every allocation is a separate mapping of whole
+// pages, so it is meant as the upstream of a monotonic_buffer_resource,
+// the file is not shrunk on deallocation
+class MappedFileResource : public std::pmr::memory_resource {
+private:
+    int m_fd = -1;
+    std::size_t m_pageSize;
+    std::size_t m_fileSize = 0;
+
+    [[nodiscard]] std::size_t roundUp(std::size_t bytes) const noexcept {
+        return (bytes + m_pageSize - 1) / m_pageSize * m_pageSize;
+    }
+
+    // the whole pages covering [ptr, ptr+bytes)
+    [[nodiscard]] std::pair<void*, std::size_t> pageRange(const void *ptr, std::size_t bytes) const noexcept {
+        const auto beg = reinterpret_cast<std::uintptr_t>(ptr) / m_pageSize * m_pageSize; // NOLINT
+        const auto end = reinterpret_cast<std::uintptr_t>(ptr) + bytes; // NOLINT
+        return {reinterpret_cast<void*>(beg), roundUp(end - beg)}; // NOLINT
+    }
+
+public:
+    // dir - where the file is created, it is unlinked at once, so it is
+    // removed with the last mapping even if the process is killed
+    explicit MappedFileResource(const std::filesystem::path &dir)
+        : m_pageSize(static_cast<std::size_t>(sysconf(_SC_PAGESIZE))) {
+        std::string name = (dir / "wator-scratch-XXXXXX").string();
+        m_fd = mkstemp(name.data());
+        if(m_fd < 0) {
+            throw std::system_error(errno, std::system_category(), "mkstemp " + name);
+        }
+        unlink(name.c_str());
+    }
+
+    MappedFileResource(const MappedFileResource&) = delete;
+    MappedFileResource& operator=(const MappedFileResource&) = delete;
+    ~MappedFileResource() override {
+        close(m_fd);
+    }
+
+    // the bytes mapped so far
+    [[nodiscard]] std::size_t getFileSize() const noexcept { return m_fileSize; }
+
+    // starts reading the pages of [ptr, ptr+bytes) in, before they are used
+    void prefetch(const void *ptr, std::size_t bytes) const noexcept {
+        const auto range = pageRange(ptr, bytes);
+        static_cast<void>(madvise(range.first, range.second, MADV_WILLNEED));
+    }
+
+    // writes the pages of [ptr, ptr+bytes) to the file and frees their
+    // memory, they are read again when they are used
+    void writeBack(const void *ptr, std::size_t bytes) const noexcept {
+        const auto range = pageRange(ptr, bytes);
+#ifdef MADV_PAGEOUT
+        if(madvise(range.first, range.second, MADV_PAGEOUT) == 0) {
+            return;
+        }
+#endif
+        // before Linux 5.4, the clean pages are left to the page cache
+        static_cast<void>(msync(range.first, range.second, MS_SYNC));
+        static_cast<void>(madvise(range.first, range.second, MADV_DONTNEED));
+    }
+
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if(alignment > m_pageSize) {
+            throw std::bad_alloc();
+        }
+        bytes = roundUp(bytes);
+
+        const auto offset = static_cast<off_t>(m_fileSize);
+        if(ftruncate(m_fd, offset + static_cast<off_t>(bytes)) != 0) {
+            throw std::bad_alloc();
+        }
+        void *res = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, offset);
+        if(res == MAP_FAILED) { // NOLINT
+            throw std::bad_alloc();
+        }
+        m_fileSize += bytes;
+        return res;
+    }
+
+    void do_deallocate(void *ptr, std::size_t bytes, std::size_t /*alignment*/) override {
+        munmap(ptr, roundUp(bytes));
+    }
+};
@@ -6,6 +6,8 @@
 
 #include <cassert>
 
+#include <cstddef>
+#include <map>
 #include <memory_resource>
 
 #include <numa.h>
@@ -17,6 +19,9 @@ class NumaAllocator : public std::pmr::memory_resource {
 private:
     unsigned m_numaNode;
     bool m_numaAvailable;
+    // the live allocations, for NumaAudit, meant to be few large ones (the
+    // chunks of a pool or monotonic resource above it)
+    std::map<const void*, std::size_t> m_allocations;
 
 public:
     explicit NumaAllocator(unsigned numaNode) : m_numaNode(numaNode), m_numaAvailable(numa_available() >= 0) { }
@@ -25,6 +30,13 @@ public:
     NumaAllocator& operator=(const NumaAllocator&) = delete;
     ~NumaAllocator() override = default;
 
+    [[nodiscard]] unsigned getNumaNode() const noexcept { return m_numaNode; }
+
+    // pointer -> bytes of every live allocation
+    [[nodiscard]] const std::map<const void*, std::size_t>& getAllocations() const noexcept {
+        return m_allocations;
+    }
+
     [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
         const NumaAllocator *nuo = dynamic_cast<const NumaAllocator*>(&other);
         if(nuo == nullptr) { return false; }
@@ -33,6 +45,7 @@ public:
     }
 
     void do_deallocate( void* ptr, std::size_t bytes, std::size_t alignment ) override {
+        m_allocations.erase(ptr);
         if(m_numaAvailable) {
             numa_free(ptr, bytes);
         } else {
@@ -49,11 +62,14 @@ public:
                 throw std::runtime_error("Cannot allocate memory on NUMA node " + 
                         std::to_string(m_numaNode));
             }
+            m_allocations.emplace(res, bytes);
             return res;
         }
 
         std::pmr::memory_resource *def = std::pmr::new_delete_resource();
-        return def->allocate(bytes, alignment);
+        void *res = def->allocate(bytes, alignment);
+        m_allocations.emplace(res, bytes);
+        return res;
        
     }
 };
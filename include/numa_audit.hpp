@@ -0,0 +1,221 @@
+#pragma once
+
+#include <config.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef WATOR_NUMA
+#include <cerrno>
+#include <numa.h>
+#include <numaif.h>
+#include <unistd.h>
+#endif
+
+// the residency of the sampled pages of the ranges of one kind which
+// should be on expectedNode
+struct NumaResidency {
+    std::string kind;
+    int expectedNode = -1;
+    std::size_t sampledPages = 0;
+    // not touched yet or swapped out
+    std::size_t absentPages = 0;
+    // node -> pages
+    std::map<int, std::size_t> pagesPerNode;
+
+    [[nodiscard]] std::size_t getPresentPages() const noexcept {
+        return sampledPages - absentPages;
+    }
+
+    // of the present pages, 1 if none is present
+    [[nodiscard]] double getLocalFraction() const noexcept {
+        const auto it = pagesPerNode.find(expectedNode);
+        if(getPresentPages() == 0) {
+            return 1;
+        }
+        const std::size_t local = (it == pagesPerNode.end()) ? 0 : it->second;
+        return static_cast<double>(local)/static_cast<double>(getPresentPages());
+    }
+};
+
+// samples on which NUMA node the pages of the registered ranges are, in
+// any build, since the kernel (autonuma, reclaim) can move them after
+// they were placed, and moves them back on request, queries and moves
+// only pages of this process, nothing is done without NUMA
+class NumaAudit {
+public:
+    // the pages queried or moved by one call
+    static constexpr std::size_t PAGE_CHUNK = 4096;
+
+private:
+    struct Range {
+        std::string kind;
+        const void *ptr;
+        std::size_t bytes;
+        int expectedNode;
+    };
+
+    std::vector<Range> m_ranges;
+    std::size_t m_pageSize;
+
+    [[nodiscard]] static std::size_t readPageSize() noexcept {
+#ifdef WATOR_NUMA
+        const long pageSize = sysconf(_SC_PAGESIZE);
+        if(pageSize > 0) {
+            return static_cast<std::size_t>(pageSize);
+        }
+#endif
+        return 4096; // NOLINT
+    }
+
+    [[nodiscard]] std::pair<std::uintptr_t, std::size_t> pageRange(const Range &range) const noexcept {
+        const auto beg = reinterpret_cast<std::uintptr_t>(range.ptr) / m_pageSize * m_pageSize; // NOLINT
+        const auto end = reinterpret_cast<std::uintptr_t>(range.ptr) + range.bytes; // NOLINT
+        return {beg, (end - beg + m_pageSize - 1) / m_pageSize};
+    }
+
+    // maxPages evenly spaced pages of range, all if it has fewer
+    [[nodiscard]] std::vector<void*> samplePages(const Range &range, std::size_t maxPages) const {
+        const auto [beg, pageCnt] = pageRange(range);
+        const std::size_t cnt = std::min(pageCnt, maxPages);
+        std::vector<void*> res(cnt);
+        for(std::size_t i=0; i<cnt; ++i) {
+            res[i] = reinterpret_cast<void*>(beg + i*pageCnt/cnt*m_pageSize); // NOLINT
+        }
+        return res;
+    }
+
+    // adds the nodes of the sampled pages to res
+    void sampleRange(const Range &range, std::size_t maxPages, NumaResidency &res) const {
+#ifdef WATOR_NUMA
+        std::vector<void*> pages = samplePages(range, maxPages);
+        std::vector<int> status(pages.size(), std::numeric_limits<int>::min());
+        for(std::size_t beg=0; beg<pages.size(); beg += PAGE_CHUNK) {
+            const std::size_t cnt = std::min(PAGE_CHUNK, pages.size() - beg);
+            if(numa_move_pages(0, cnt, &pages[beg], nullptr, &status[beg], 0) < 0) { // NOLINT
+                return;
+            }
+        }
+        res.sampledPages += pages.size();
+        for(int node : status) {
+            if(node < 0) {
+                ++res.absentPages;
+            } else {
+                ++res.pagesPerNode[node];
+            }
+        }
+#else
+        static_cast<void>(range); static_cast<void>(maxPages); static_cast<void>(res);
+#endif
+    }
+
+    // every page of range to its node, returns the pages moved
+    [[nodiscard]] std::size_t moveRange(const Range &range) const {
+#ifdef WATOR_NUMA
+        const auto [beg, pageCnt] = pageRange(range);
+        std::size_t res = 0;
+        std::vector<void*> pages(std::min(PAGE_CHUNK, pageCnt));
+        std::vector<int> nodes(pages.size(), range.expectedNode);
+        std::vector<int> status(pages.size());
+        for(std::size_t first=0; first<pageCnt; first += PAGE_CHUNK) {
+            const std::size_t cnt = std::min(PAGE_CHUNK, pageCnt - first);
+            for(std::size_t i=0; i<cnt; ++i) {
+                pages[i] = reinterpret_cast<void*>(beg + (first + i)*m_pageSize); // NOLINT
+            }
+            // the absent pages fail with -ENOENT, they are placed by the policy later
+            if(numa_move_pages(0, cnt, pages.data(), nodes.data(), status.data(), MPOL_MF_MOVE) < 0) { // NOLINT
+                continue;
+            }
+            res += static_cast<std::size_t>(std::count(status.begin(), status.begin() + static_cast<std::ptrdiff_t>(cnt),
+                                                       range.expectedNode));
+        }
+        return res;
+#else
+        static_cast<void>(range);
+        return 0;
+#endif
+    }
+
+public:
+    NumaAudit() : m_pageSize(readPageSize()) { }
+
+    // the pages can be queried
+    [[nodiscard]] static bool isAvailable() noexcept {
+#ifdef WATOR_NUMA
+        return numa_available() >= 0;
+#else
+        return false;
+#endif
+    }
+
+    // kind - the name it is reported under, ranges of the same kind and
+    // node are reported together
+    void addRange(std::string kind, const void *ptr, std::size_t bytes, int expectedNode) {
+        if(ptr == nullptr || bytes == 0) {
+            return;
+        }
+        m_ranges.push_back(Range{std::move(kind), ptr, bytes, expectedNode});
+    }
+
+    [[nodiscard]] std::size_t getRangeCnt() const noexcept { return m_ranges.size(); }
+
+    // samples at most maxPagesPerRange pages of every range, the residency
+    // per kind and node in the order they were added, empty without NUMA
+    [[nodiscard]] std::vector<NumaResidency> audit(std::size_t maxPagesPerRange) const {
+        std::vector<NumaResidency> res;
+        if(!isAvailable()) {
+            return res;
+        }
+        for(const Range &range : m_ranges) {
+            auto it = std::find_if(res.begin(), res.end(), [&](const NumaResidency &r) {
+                return r.kind == range.kind && r.expectedNode == range.expectedNode;
+            });
+            if(it == res.end()) {
+                it = res.insert(res.end(), NumaResidency{range.kind, range.expectedNode, 0, 0, {}});
+            }
+            sampleRange(range, maxPagesPerRange, *it);
+        }
+        return res;
+    }
+
+    // moves the ranges whose sampled pages are less than minLocalFraction
+    // on their node back to it, returns the pages moved
+    std::size_t migrate(double minLocalFraction, std::size_t maxPagesPerRange) const {
+        if(!isAvailable()) {
+            return 0;
+        }
+        std::size_t res = 0;
+        for(const Range &range : m_ranges) {
+            NumaResidency residency{range.kind, range.expectedNode, 0, 0, {}};
+            sampleRange(range, maxPagesPerRange, residency);
+            if(residency.getLocalFraction() < minLocalFraction) {
+                res += moveRange(range);
+            }
+        }
+        return res;
+    }
+
+    static void print(std::ostream &out, const std::vector<NumaResidency> &residency) {
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(1);
+        for(const NumaResidency &r : residency) {
+            out << "NUMA residency of " << r.kind << " of node " << r.expectedNode << ':';
+            for(const auto &[node, pages] : r.pagesPerNode) {
+                out << " node " << node << ' '
+                    << 100*static_cast<double>(pages)/static_cast<double>(r.getPresentPages()) << '%';
+            }
+            out << " (" << r.sampledPages << " pages sampled, " << r.absentPages << " not present)\n";
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
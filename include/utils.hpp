@@ -5,6 +5,7 @@
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <new>
 #include <sched.h>
 #include <string>
 #include <system_error>
@@ -19,6 +20,7 @@
 #ifdef WATOR_NUMA
 #include <numaif.h>
 #include <numa.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #endif
 
@@ -112,19 +114,81 @@ namespace Utils {
             throw std::system_error(errno, std::system_category(), "numa_move_pages");
         }
 
+        std::size_t failedCnt = 0;
         for(std::size_t page=0; page<numPages; ++page) {
-            if(status[page] < 0 && status[page] != -EFAULT) {
-                std::clog << "Failed to move page: " << pages[page] << ", reason: " << status[page] << std::endl;
-            } else if(status[page] > 0 && static_cast<unsigned>(status[page]) != numaNode) {
-                std::clog << "Move for page: " << pages[page] << "requested: " << numaNode
-                          << "but put instead on: " << status[page] << std::endl;
+            if((status[page] < 0 && status[page] != -EFAULT) || 
+               (status[page] > 0 && static_cast<unsigned>(status[page]) != numaNode)) {
+                ++failedCnt;
             }
         }
+        if(failedCnt != 0) {
+            std::clog << "Failed to move " << failedCnt << " stack pages to NUMA node " << numaNode << std::endl;
+        }
     }
 #else 
     inline void mapThisThreadStackToNuma(unsigned /*numaNode*/) {}
 #endif
 
+    // memory for the stack of a new thread, see allocThreadStack
+    struct ThreadStack {
+        void *ptr = nullptr;
+        std::size_t size = 0;
+    };
+
+    // the stack size of a new thread by default
+    [[nodiscard]] inline std::size_t getDefaultThreadStackSize() {
+        pthread_attr_t tattr;
+        int ret = pthread_attr_init(&tattr);
+        if(ret != 0) {
+            throw std::system_error(ret, std::system_category(), "pthread_attr_init");
+        }
+        std::size_t res = 0;
+        ret = pthread_attr_getstacksize(&tattr, &res);
+        pthread_attr_destroy(&tattr);
+        if(ret != 0) {
+            throw std::system_error(ret, std::system_category(), "pthread_attr_getstacksize");
+        }
+        return res;
+    }
+
+#ifdef WATOR_NUMA
+    // a stack for a thread which is not yet created, its pages are bound
+    // to numaNode before they are touched, so nothing has to be moved
+    // later (as by mapThisThreadStackToNuma), the lowest page is a guard,
+    // an empty ThreadStack without NUMA
+    [[nodiscard]] inline ThreadStack allocThreadStack(std::size_t size, unsigned numaNode) {
+        if(numa_available() < 0) {
+            return {};
+        }
+
+        const std::size_t pageSize = static_cast<std::size_t>(numa_pagesize());
+        size = (size + (pageSize - 1))/pageSize*pageSize + pageSize;
+
+        void *ptr = numa_alloc_onnode(size, static_cast<int>(numaNode));
+        if(ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        if(mprotect(ptr, pageSize, PROT_NONE) != 0) {
+            int err = errno;
+            numa_free(ptr, size);
+            throw std::system_error(err, std::system_category(), "mprotect");
+        }
+        return {ptr, size};
+    }
+
+    inline void freeThreadStack(const ThreadStack &stack) noexcept {
+        if(stack.ptr != nullptr) {
+            numa_free(stack.ptr, stack.size);
+        }
+    }
+#else
+    [[nodiscard]] inline ThreadStack allocThreadStack(std::size_t /*size*/, unsigned /*numaNode*/) {
+        return {};
+    }
+
+    inline void freeThreadStack(const ThreadStack &/*stack*/) noexcept {}
+#endif
+
 #if !defined(NDEBUG) && defined (WATOR_NUMA)
     inline void assertMemLocalFunc(const void* ptr, std::size_t size, const char file[], unsigned line) { // NOLINT
         (void)size; // TODO: use size
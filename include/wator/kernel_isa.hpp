@@ -0,0 +1,25 @@
+#pragma once
+
+namespace WaTor {
+
+// instruction set the tile kernel is compiled for, every one is built into
+// the library and Simulation picks one at runtime
+enum class KernelIsa {
+    GENERIC = 0,    // the instruction set of the build
+    AVX2,
+    AVX512          // AVX-512 F and BW
+};
+
+// the kernel was compiled for isa, otherwise it is the GENERIC one
+// under a different name (WATOR_KERNEL_DISPATCH is off)
+[[nodiscard]] bool isKernelIsaCompiled(KernelIsa isa) noexcept;
+
+// the CPU (and the OS) can run the kernel for isa
+[[nodiscard]] bool isKernelIsaSupported(KernelIsa isa) noexcept;
+
+// the best compiled kernel the CPU can run
+[[nodiscard]] KernelIsa detectKernelIsa() noexcept;
+
+[[nodiscard]] const char* getKernelIsaName(KernelIsa isa) noexcept;
+
+}
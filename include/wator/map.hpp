@@ -6,6 +6,7 @@
 #include <cstdint>
 
 #include <cassert>
+#include <filesystem>
 #include <functional>
 #include <limits>
 #include <memory>
@@ -13,6 +14,7 @@
 #include <optional>
 #include <ostream>
 #include <random>
+#include <stdexcept>
 #include <vector>
 
 #include <iostream>
@@ -21,6 +23,8 @@
 #include "map_numa.hpp"
 
 #include "execution_planner.hpp"
+#include "huge_page_resource.hpp"
+#include "mapped_file_resource.hpp"
 #include "numa_allocator.hpp"
 #include "posixFostream.hpp"
 #include "rules.hpp"
@@ -36,6 +40,19 @@ public:
 
     virtual auto operator() (const ExecutionPlanner &exp) 
         -> std::unique_ptr<std::pmr::memory_resource*[]> = 0;
+
+    // the memory of the map if the system is not NUMA
+    virtual auto getDefaultResource() -> std::pmr::memory_resource* {
+        return std::pmr::get_default_resource();
+    }
+};
+
+// huge pages (HugePageResource) under a monotonic_buffer_resource
+struct HugePageAllocEnt {
+    HugePageResource hugePageAlloc;
+    std::pmr::monotonic_buffer_resource alloc;
+    HugePageAllocEnt(int numaNode, std::ostream *log) 
+        : hugePageAlloc(numaNode, log), alloc(&hugePageAlloc) { }
 };
 
 // NON NUMA Aware allocation strategy for WaTor::Map
@@ -65,16 +82,27 @@ class NumaAllocStrategy : public MapAllocStrategy {
 private:
     struct NumaAllocEnt {
         NumaAllocator numaAlloc;
+        std::unique_ptr<HugePageAllocEnt> hugePageAlloc;
         std::pmr::monotonic_buffer_resource alloc;
-        explicit NumaAllocEnt(unsigned numaNode) 
-            : numaAlloc(numaNode), alloc(&numaAlloc) { }
+        // hugePageAlloc is the upstream of alloc if it is not nullptr
+        NumaAllocEnt(unsigned numaNode, std::unique_ptr<HugePageAllocEnt> &&hugePages) 
+            : numaAlloc(numaNode), hugePageAlloc(std::move(hugePages)), 
+              alloc(hugePageAlloc ? static_cast<std::pmr::memory_resource*>(&hugePageAlloc->hugePageAlloc) 
+                                  : &numaAlloc) { }
     };
 
     std::vector<std::unique_ptr<NumaAllocEnt>> alloc;
+    bool m_hugePages{false};
+    std::ostream *m_log{nullptr};
+    std::unique_ptr<HugePageAllocEnt> m_defaultAlloc;
         
 public:
 
     NumaAllocStrategy() = default;
+    // hugePages - the map is backed by huge pages (HugePageResource),
+    // log - where the pages it got are reported, may be nullptr
+    explicit NumaAllocStrategy(bool hugePages, std::ostream *log = nullptr) 
+        : m_hugePages(hugePages), m_log(log) { }
     NumaAllocStrategy(const NumaAllocStrategy&) = delete; 
     NumaAllocStrategy& operator=(const NumaAllocStrategy&) = delete; 
     NumaAllocStrategy(NumaAllocStrategy&&) = default; 
@@ -90,22 +118,102 @@ public:
 
         for(unsigned numaInd=0; numaInd<exp.getNumaList().size(); ++numaInd) {
             unsigned numaNode = exp.getNumaList()[numaInd];
-            auto ent = std::make_unique<NumaAllocEnt>(numaNode);
+            std::unique_ptr<HugePageAllocEnt> hugePages;
+            if(m_hugePages) {
+                hugePages = std::make_unique<HugePageAllocEnt>(static_cast<int>(numaNode), m_log);
+            }
+            auto ent = std::make_unique<NumaAllocEnt>(numaNode, std::move(hugePages));
             alloc.emplace_back(std::move(ent));
             res[numaInd] = &alloc.back().get()->alloc;
         }
 
         return res;
     }
+
+    auto getDefaultResource() -> std::pmr::memory_resource* override {
+        if(!m_hugePages) {
+            return std::pmr::get_default_resource();
+        }
+        if(!m_defaultAlloc) {
+            m_defaultAlloc = std::make_unique<HugePageAllocEnt>(-1, m_log);
+        }
+        return &m_defaultAlloc->alloc;
+    }
 };
 
 #else
 // NUMA aware allocation strategy for WaTor::Map
-// WARNING: NO NUMA support compiled, using NON Numa alloc strategy
-using NumaAllocStrategy = MockAllocStrategy;
+// WARNING: NO NUMA support compiled, the memory is not bound to the nodes
+class NumaAllocStrategy : public MapAllocStrategy {
+private:
+    bool m_hugePages{false};
+    std::ostream *m_log{nullptr};
+    std::unique_ptr<HugePageAllocEnt> m_defaultAlloc;
+
+public:
+    NumaAllocStrategy() = default;
+    explicit NumaAllocStrategy(bool hugePages, std::ostream *log = nullptr) 
+        : m_hugePages(hugePages), m_log(log) { }
+
+    auto operator() (const ExecutionPlanner &exp) 
+        -> std::unique_ptr<std::pmr::memory_resource*[]> override { // NOLINT
+        auto res = std::make_unique<std::pmr::memory_resource*[]>
+                            (exp.getNumaList().size());
+        for(unsigned i=0; i<exp.getNumaList().size(); ++i) {
+            res[i] = getDefaultResource();
+        }
+        return res;
+    }
+
+    auto getDefaultResource() -> std::pmr::memory_resource* override {
+        if(!m_hugePages) {
+            return std::pmr::get_default_resource();
+        }
+        if(!m_defaultAlloc) {
+            m_defaultAlloc = std::make_unique<HugePageAllocEnt>(-1, m_log);
+        }
+        return &m_defaultAlloc->alloc;
+    }
+};
 
 #endif
 
+// the map in a scratch file (MappedFileResource) for maps larger than 
+// the RAM, the NUMA nodes are not considered
+class MappedFileAllocStrategy : public MapAllocStrategy {
+private:
+    MappedFileResource m_file;
+    std::pmr::monotonic_buffer_resource m_alloc;
+
+public:
+    // dir - where the scratch file is created
+    explicit MappedFileAllocStrategy(const std::filesystem::path &dir) 
+        : m_file(dir), m_alloc(&m_file) { }
+
+    auto operator() (const ExecutionPlanner &exp) 
+        -> std::unique_ptr<std::pmr::memory_resource*[]> override { // NOLINT
+        auto res = std::make_unique<std::pmr::memory_resource*[]>
+                            (exp.getNumaList().size());
+        for(unsigned i=0; i<exp.getNumaList().size(); ++i) {
+            res[i] = &m_alloc;
+        }
+        return res;
+    }
+
+    auto getDefaultResource() -> std::pmr::memory_resource* override {
+        return &m_alloc;
+    }
+
+    // for the paging hints
+    [[nodiscard]] MappedFileResource& getFile() noexcept { return m_file; }
+};
+
+// how many entities Map::randomize puts in a line
+struct LinePopulation {
+    std::size_t fishCnt = 0;
+    std::size_t sharkCnt = 0;
+};
+
 class Map
 {
 
@@ -113,16 +221,22 @@ private:
 
     unsigned m_width, m_height;
     unsigned m_numaCount;
+    MapLineStorage m_storage;
+    MapLineLayout m_layout;
+    bool m_deferInit;
+    unsigned m_linePairs;
+    unsigned m_spareRows;
     std::unique_ptr<MapAllocStrategy> m_numaAlloc;
 
     std::unique_ptr<std::unique_ptr<MapNuma, PmrDelete<MapNuma>>[]> m_numaMap; // NOLINT
+    // getLineFirstRow, indexed [numaInd][lineInd]
+    std::vector<std::vector<unsigned>> m_lineFirstRow;
 
-    void generateNuma(unsigned width, unsigned heightPerCpu, unsigned &heightRem,
-                      const ExecutionPlanner &exp, unsigned numaInd, std::pmr::memory_resource *pmr) {
-        unsigned curNumaCpuCnt = static_cast<unsigned>(exp.getCpuListPerNuma(numaInd).size());
-        unsigned newHeight = 2*heightPerCpu*curNumaCpuCnt;
-        newHeight += std::min(2*curNumaCpuCnt, heightRem);
-        heightRem -= std::min(2*curNumaCpuCnt, heightRem);
+    void generateNuma(unsigned width, unsigned heightPerLine, unsigned &heightRem, unsigned curNumaLineCnt,
+                      unsigned numaInd, std::pmr::memory_resource *pmr) {
+        unsigned newHeight = heightPerLine*curNumaLineCnt;
+        newHeight += std::min(curNumaLineCnt, heightRem);
+        heightRem -= std::min(curNumaLineCnt, heightRem);
 
         // rules.width, newHeight, numaNode, exp
         // perNuma[numaNode] = std::make_unique<PerNumaData, AllocatorDeleter>(rules.width, newHeight, numaNode, exp);
@@ -130,7 +244,8 @@ private:
         MapNuma *ptr = alloc.allocate(1);
 
         try {
-            alloc.construct(ptr, newHeight, width, numaInd, exp, pmr);
+            alloc.construct(ptr, newHeight, width, curNumaLineCnt, pmr, m_storage, m_layout, m_deferInit, 
+                            m_spareRows);
         } catch (...) {
             alloc.deallocate(ptr, 1);
             throw;
@@ -144,40 +259,91 @@ public:
     // AllocStrategy - a class generating memory_resources 
     // based on NUMA node
     // NOTE: If the system is not NUMA (ExecutionPlanner::isNuma()), 
-    // AllocStrategy is not used!
+    // only AllocStrategy::getDefaultResource is used!
+    // storage, layout - of every MapLine
+    // deferInit - the lines are not written, every one of them has to be 
+    // initialized (MapLine::initialize) before use, by the thread the 
+    // pages of the line should be local to
+    // linePairs - the map is split into 2*linePairs lines, their heights 
+    // depend only on height and linePairs, the pairs are split between
+    // the CPUs by getCpuFirstPair and the lines are on the NUMA node of
+    // their CPU, 0 gives a pair per CPU, throws std::invalid_argument if 
+    // there are fewer pairs than CPUs
+    // spareRows - every line has room for this many rows above and bellow
+    // it, so its boundaries can be moved (moveLineBoundary)
     Map(unsigned height, unsigned width, const ExecutionPlanner &exp, 
-        std::unique_ptr<MapAllocStrategy> &&numaAlloc = std::make_unique<NumaAllocStrategy>()) 
+        std::unique_ptr<MapAllocStrategy> &&numaAlloc = std::make_unique<NumaAllocStrategy>(),
+        MapLineStorage storage = MapLineStorage::TILES, 
+        MapLineLayout layout = MapLineLayout::ROWS, bool deferInit = false,
+        unsigned linePairs = 0, unsigned spareRows = 0) 
         : m_width(width), m_height(height), 
           m_numaCount(static_cast<unsigned>(exp.getNumaList().size())),
+          m_storage(storage), m_layout(layout), m_deferInit(deferInit),
+          m_linePairs((linePairs == 0) ? exp.getCpuCnt() : linePairs), m_spareRows(spareRows),
           m_numaAlloc(std::move(numaAlloc)),
           m_numaMap(std::make_unique<std::unique_ptr<MapNuma, PmrDelete<MapNuma>>[]>(m_numaCount)) // NOLINT
           {
 
-        if(height < static_cast<std::size_t>(2)*2*exp.getCpuCnt()) { // TODO: this has to be 4
+        if(m_linePairs < exp.getCpuCnt()) {
+            throw std::invalid_argument("There are fewer line pairs than CPUs!");
+        }
+        const std::size_t lineCnt = std::size_t{2}*m_linePairs;
+        if(height < 2*lineCnt) { // TODO: this has to be 4
            throw std::runtime_error("Height is too small or CPU count is too large!");
         }
 
-        // TODO: granularity
-        unsigned heightPerCpu = height / (2*exp.getCpuCnt());
-        unsigned heightRem = height - 2*exp.getCpuCnt()*heightPerCpu;
+        unsigned heightPerLine = static_cast<unsigned>(height / lineCnt);
+        unsigned heightRem = static_cast<unsigned>(height - lineCnt*heightPerLine);
 
         if(exp.isNuma()) {
             std::unique_ptr<std::pmr::memory_resource*[]> numaMem{(*m_numaAlloc)(exp)};
 
+            unsigned firstCpu = 0;
             for(unsigned numaInd=0; numaInd<m_numaCount; ++numaInd) {
-                generateNuma(width, heightPerCpu, heightRem, exp, numaInd, numaMem[numaInd]);
+                const auto endCpu = firstCpu + static_cast<unsigned>(exp.getCpuListPerNuma(numaInd).size());
+                const unsigned pairCnt = getCpuFirstPair(m_linePairs, exp.getCpuCnt(), endCpu) - 
+                                         getCpuFirstPair(m_linePairs, exp.getCpuCnt(), firstCpu);
+                generateNuma(width, heightPerLine, heightRem, 2*pairCnt, numaInd, numaMem[numaInd]);
+                firstCpu = endCpu;
             }
         } else {
-            generateNuma(width, heightPerCpu, heightRem, exp, 0, std::pmr::get_default_resource());
+            generateNuma(width, heightPerLine, heightRem, 2*m_linePairs, 0, m_numaAlloc->getDefaultResource());
+        }
+
+        m_lineFirstRow.resize(m_numaCount);
+        unsigned firstRow = 0;
+        for(unsigned numaInd=0; numaInd<m_numaCount; ++numaInd) {
+            const MapNuma &numa = getMapNuma(numaInd);
+            for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
+                m_lineFirstRow[numaInd].push_back(firstRow);
+                firstRow += numa.getLine(lineInd).getHeight();
+            }
         }
     }
 
-    Map(const Rules &rules, const ExecutionPlanner &exp) 
-        : Map(rules.getHeight(), rules.getWidth(), exp) {}
+    Map(const Rules &rules, const ExecutionPlanner &exp, 
+        MapLineStorage storage = MapLineStorage::TILES, 
+        MapLineLayout layout = MapLineLayout::ROWS) 
+        : Map(rules.getHeight(), rules.getWidth(), exp, std::make_unique<NumaAllocStrategy>(), storage, layout) {}
 
     [[nodiscard]] unsigned getHeight() const noexcept { return m_height; }
     [[nodiscard]] unsigned getWidth() const noexcept { return m_width; }
     [[nodiscard]] unsigned getMapNumaCnt() const noexcept { return m_numaCount; }
+    [[nodiscard]] MapLineStorage getStorage() const noexcept { return m_storage; }
+    [[nodiscard]] MapLineLayout getLayout() const noexcept { return m_layout; }
+    // of the whole map
+    [[nodiscard]] unsigned getLinePairCnt() const noexcept { return m_linePairs; }
+    [[nodiscard]] unsigned getSpareRows() const noexcept { return m_spareRows; }
+
+    // the first pair of lines of CPU cpuInd of all cpuCnt ones, counted
+    // from the top of the map, every CPU gets linePairs/cpuCnt pairs or
+    // one more, cpuInd == cpuCnt gives linePairs
+    [[nodiscard]] static unsigned getCpuFirstPair(unsigned linePairs, unsigned cpuCnt, unsigned cpuInd) noexcept {
+        return static_cast<unsigned>(std::uint64_t{linePairs}*cpuInd/cpuCnt);
+    }
+
+    // initializes the lines which are not yet, on this thread
+    void initialize();
     [[nodiscard]] MapNuma& getMapNuma(unsigned numa) noexcept { 
         assert(numa < getMapNumaCnt());
         return *m_numaMap[numa]; 
@@ -195,32 +361,43 @@ public:
         return getMapNuma(numaInd).getLine(lineInNuma).get(posy, posx);
     }
 
-    [[nodiscard]] auto getUpdateMask(unsigned numaInd, unsigned lineInNuma, unsigned posx) { // NOLINT
-        return getMapNuma(numaInd).getLine(lineInNuma).getUpdateMask(posx);
-    }
-
-    [[nodiscard]] bool getUpdateMask(unsigned numaInd, unsigned lineInNuma, unsigned posx) const { // NOLINT
-        return getMapNuma(numaInd).getLine(lineInNuma).getUpdateMask(posx);
-    }
-
-    [[nodiscard]] auto getTopMask(unsigned numaInd, unsigned lineInd, unsigned posx) noexcept {
-        MapLine &line = getMapNuma(numaInd).getLine(lineInd);
-        return line.getTopMask(posx);
-    }
-
-    [[nodiscard]] bool getTopMask(unsigned numaInd, unsigned lineInd, unsigned posx) const noexcept {
-        const MapLine &line = getMapNuma(numaInd).getLine(lineInd);
-        return line.getTopMask(posx);
+    // the line above, wraps around to the last line of the map
+    [[nodiscard]] MapLine& getPrevLine(unsigned numaInd, unsigned lineInd) noexcept {
+        if(lineInd == 0) {
+            numaInd = (numaInd == 0) ? getMapNumaCnt()-1 : numaInd-1;
+            lineInd = getMapNuma(numaInd).getLineCnt();
+        }
+        return getMapNuma(numaInd).getLine(lineInd-1);
     }
 
-    [[nodiscard]] auto getBottomMask(unsigned numaInd, unsigned lineInd, unsigned posx) noexcept {
-        MapLine &line = getMapNuma(numaInd).getLine(lineInd);
-        return line.getBottomMask(posx);
+    // the line bellow, wraps around to the first line of the map
+    [[nodiscard]] MapLine& getNextLine(unsigned numaInd, unsigned lineInd) noexcept {
+        ++lineInd;
+        if(lineInd == getMapNuma(numaInd).getLineCnt()) {
+            numaInd = (numaInd+1 == getMapNumaCnt()) ? 0 : numaInd+1;
+            lineInd = 0;
+        }
+        return getMapNuma(numaInd).getLine(lineInd);
+    }
+
+    // moves the boundary between the line and the one bellow it by rows
+    // (MapLine::moveRows), the last line of the map has none, the moved 
+    // entities are updated by the other line from the next chronon
+    void moveLineBoundary(unsigned numaInd, unsigned lineInd, int rows) {
+        assert(numaInd+1 < getMapNumaCnt() || lineInd+1 < getMapNuma(numaInd).getLineCnt());
+        MapLine::moveRows(getMapNuma(numaInd).getLine(lineInd), getNextLine(numaInd, lineInd), rows);
+        if(++lineInd == getMapNuma(numaInd).getLineCnt()) {
+            ++numaInd;
+            lineInd = 0;
+        }
+        unsigned &firstRow = m_lineFirstRow[numaInd][lineInd];
+        firstRow = static_cast<unsigned>(static_cast<int>(firstRow) + rows);
     }
 
-    [[nodiscard]] bool getBottomMask(unsigned numaInd, unsigned lineInd, unsigned posx) const noexcept {
-        const MapLine &line = getMapNuma(numaInd).getLine(lineInd);
-        return line.getBottomMask(posx);
+    // the row of the whole map which is row 0 of the line
+    [[nodiscard]] unsigned getLineFirstRow(unsigned numaInd, unsigned lineInd) const noexcept {
+        assert(numaInd < getMapNumaCnt() && lineInd < m_lineFirstRow[numaInd].size());
+        return m_lineFirstRow[numaInd][lineInd];
     }
 
     [[nodiscard]] unsigned getMapLineHeight(unsigned numaInd, unsigned lineInd) const noexcept {
@@ -237,15 +414,14 @@ public:
         // MapNuma *numaData; // numaData == perNuma[numaInd].get()
         // we use iterators and as needed cast them to const
         MapLine::TileIter m_curTileIter;
-        MapLine::UpdateMaskIter m_curUpdateMaskIter;
 
         unsigned m_numaInd;
         unsigned m_lineInd;
         unsigned m_posy, m_posx;
 
-        Cordinate(MapLine::TileIter curTileIter, MapLine::UpdateMaskIter curUpdateMaskIter, 
+        Cordinate(MapLine::TileIter curTileIter, 
                   unsigned numaInd, unsigned lineInNuma, unsigned posy, unsigned posx) 
-            : m_curTileIter(curTileIter), m_curUpdateMaskIter(curUpdateMaskIter), 
+            : m_curTileIter(curTileIter), 
               m_numaInd(numaInd), m_lineInd(lineInNuma), m_posy(posy), m_posx(posx) { }
 
     public:
@@ -263,9 +439,8 @@ public:
     [[nodiscard]] Cordinate makeCordinate(unsigned numaInd, unsigned lineInd, unsigned posy, unsigned posx) const {
         MapLine &line = const_cast<MapLine&>(getMapNuma(numaInd).getLine(lineInd)); // NOLINT
         MapLine::TileIter tit = line.getTileIter(posy, posx);
-        MapLine::UpdateMaskIter umit = line.getUpdateMaskIter(posx);
 
-        return {tit, umit, numaInd, lineInd, posy, posx};
+        return {tit, numaInd, lineInd, posy, posx};
     }
 
     [[nodiscard]] Tile& get(const Cordinate& cord) noexcept { // NOLINT
@@ -278,36 +453,6 @@ public:
         return *cord.m_curTileIter;
     }
 
-    [[nodiscard]] auto getUpdateMask(const Cordinate& cord) noexcept { // NOLINT
-        assert(*cord.m_curUpdateMaskIter == getUpdateMask(cord.numaInd(), cord.lineInd(), cord.posx()));
-        return *cord.m_curUpdateMaskIter;
-    }
-
-    [[nodiscard]] bool getUpdateMask(const Cordinate& cord) const noexcept { // NOLINT
-        assert(*cord.m_curUpdateMaskIter == getUpdateMask(cord.numaInd(), cord.lineInd(), cord.posx()));
-        return *cord.m_curUpdateMaskIter;
-    }
-
-    [[nodiscard]] auto getTopMask(const Cordinate& cord) noexcept {
-        MapLine &line = getMapNuma(cord.numaInd()).getLine(cord.lineInd());
-        return line.getTopMask(cord.posx());
-    }
-
-    [[nodiscard]] bool getTopMask(const Cordinate& cord) const noexcept {
-        const MapLine &line = getMapNuma(cord.numaInd()).getLine(cord.lineInd());
-        return line.getTopMask(cord.posx());
-    }
-
-    [[nodiscard]] auto getBottomMask(const Cordinate& cord) noexcept {
-        MapLine &line = getMapNuma(cord.numaInd()).getLine(cord.lineInd());
-        return line.getBottomMask(cord.posx());
-    }
-
-    [[nodiscard]] bool getBottomMask(const Cordinate& cord) const noexcept {
-        const MapLine &line = getMapNuma(cord.numaInd()).getLine(cord.lineInd());
-        return line.getBottomMask(cord.posx());
-    }
-
     [[nodiscard]] Cordinate dirHelper(Cordinate cord, unsigned dir) const {
         assert(dir < 4);
 
@@ -363,9 +508,8 @@ public:
         MapLine &ncLine = const_cast<MapLine&>(*newLine); // NOLINT
 
         MapLine::TileIter tit = ncLine.getTileIter(newPosy, newPosx);
-        MapLine::UpdateMaskIter umit = ncLine.getUpdateMaskIter(newPosx);
 
-        return {tit, umit, newNumaInd, newLineInd, newPosy, newPosx};
+        return {tit, newNumaInd, newLineInd, newPosy, newPosx};
     }
 
     // TODO: document
@@ -373,24 +517,13 @@ public:
         // TODO: assert
         assert(cord.posx() + 1 < getMapLineWidth(cord.numaInd(), cord.lineInd()));
         ++cord.m_posx;
-        ++cord.m_curTileIter;
-        ++cord.m_curUpdateMaskIter;
-    }
-
-    MapLine::TopMaskIter getTopMaskIter(unsigned numaInd, unsigned lineInd, unsigned posx) {
-        return getMapNuma(numaInd).getLine(lineInd).getTopMaskIter(posx);
-    }
-
-    MapLine::TopMaskIter getTopMaskIter(const Cordinate& cord) {
-        return getMapNuma(cord.numaInd()).getLine(cord.lineInd()).getTopMaskIter(cord.posx());
-    }
-
-    MapLine::BottomMaskIter getBottomMaskIter(unsigned numaInd, unsigned lineInd, unsigned posx) {
-        return getMapNuma(numaInd).getLine(lineInd).getBottomMaskIter(posx);
-    }
-
-    MapLine::TopMaskIter getBottomMaskIter(const Cordinate& cord) {
-        return getMapNuma(cord.numaInd()).getLine(cord.lineInd()).getBottomMaskIter(cord.posx());
+        MapLine &line = const_cast<MapLine&>(getMapNuma(cord.numaInd()).getLine(cord.lineInd())); // NOLINT
+        if(line.isPanelBegin(cord.m_posx)) {
+            // the next panel is stored after all rows of this one
+            cord.m_curTileIter = line.getTileIter(cord.posy(), cord.posx());
+        } else {
+            ++cord.m_curTileIter;
+        }
     }
 
     // TODO: move out of this class
@@ -402,8 +535,40 @@ public:
     void saveMap(PosixFostream &fout, bool includeHeader = false) const;
 #endif
 
+    // throws std::invalid_argument if the entities do not fit the map
+    void checkPopulation(std::size_t fishCnt, std::size_t sharkCnt) const;
+
+    // places the entities uniformly over the map, every line is
+    // randomized separately (see randomizeLine), the same seed gives the
+    // same map for any order of the lines and any split into lines
     void randomize(std::size_t fishCnt, std::size_t sharkCnt, unsigned seed);
 
+    // the entities randomize puts in every line, indexed [numaInd][lineInd]
+    [[nodiscard]] std::vector<std::vector<LinePopulation>> splitPopulation(std::size_t fishCnt, 
+                                                                           std::size_t sharkCnt, 
+                                                                           unsigned seed) const;
+
+    // replaces the tiles of a line by its share of fishCnt and sharkCnt 
+    // entities of the whole map, the counts are split between the rows of 
+    // the map with hypergeometric draws, as if the entities were placed on 
+    // the whole map, and placed at random positions of every row, both 
+    // keyed by the rows, without a scratch memory, the lines can be 
+    // randomized concurrently
+    void randomizeLine(unsigned numaInd, unsigned lineInd, std::size_t fishCnt, std::size_t sharkCnt, 
+                       unsigned seed);
+
+    // sets the parity of every entity, so all of them are updated
+    // in the next chronon with the given parity
+    void setParity(bool parity);
+
+    // marks every block of every line as possibly occupied, needed after
+    // the tiles are changed from outside of the simulation
+    void markAllOccupied();
+
+    // recalculates the entity planes with MapLineStorage::SPLIT, needed
+    // after the tiles are changed from outside of the simulation
+    void updateEntityPlanes();
+
     void randomize(const Rules &rules, unsigned seed) {
         randomize(rules.getInitialFishCnt(), rules.getInitialSharkCnt(), seed);
     }
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cassert>
+#include <vector>
+
+#include "map.hpp"
+#include "map_line_bitboard.hpp"
+
+namespace WaTor {
+
+// Bit sliced copy of a WaTor::Map, used by SimulationBitboardWorker
+// it keeps the same NUMA node/line structure as the Map it is built from
+// and every line is allocated with the memory resource of its MapLine
+class MapBitboard {
+private:
+    std::vector<std::vector<MapLineBitboard>> m_numaLines;
+    // getLineFirstRow, the lines do not change their heights
+    std::vector<std::vector<unsigned>> m_lineFirstRow;
+
+public:
+    explicit MapBitboard(const Map &map) : m_numaLines(map.getMapNumaCnt()), m_lineFirstRow(map.getMapNumaCnt()) {
+        for(unsigned numaInd=0; numaInd<map.getMapNumaCnt(); ++numaInd) {
+            const MapNuma &numa = map.getMapNuma(numaInd);
+            std::vector<MapLineBitboard> &lines = m_numaLines[numaInd];
+            lines.reserve(numa.getLineCnt());
+            for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
+                lines.emplace_back(numa.getLine(lineInd));
+                m_lineFirstRow[numaInd].push_back(map.getLineFirstRow(numaInd, lineInd));
+            }
+        }
+    }
+
+    [[nodiscard]] unsigned getMapNumaCnt() const noexcept {
+        return static_cast<unsigned>(m_numaLines.size());
+    }
+
+    [[nodiscard]] unsigned getLineCnt(unsigned numaInd) const noexcept {
+        assert(numaInd < getMapNumaCnt());
+        return static_cast<unsigned>(m_numaLines[numaInd].size());
+    }
+
+    [[nodiscard]] MapLineBitboard& getLine(unsigned numaInd, unsigned lineInd) noexcept {
+        assert(lineInd < getLineCnt(numaInd));
+        return m_numaLines[numaInd][lineInd];
+    }
+    [[nodiscard]] const MapLineBitboard& getLine(unsigned numaInd, unsigned lineInd) const noexcept {
+        assert(lineInd < getLineCnt(numaInd));
+        return m_numaLines[numaInd][lineInd];
+    }
+
+    // the row of the whole map which is row 0 of the line
+    [[nodiscard]] unsigned getLineFirstRow(unsigned numaInd, unsigned lineInd) const noexcept {
+        assert(lineInd < getLineCnt(numaInd));
+        return m_lineFirstRow[numaInd][lineInd];
+    }
+
+    // the line above, wraps around to the last line of the map
+    [[nodiscard]] MapLineBitboard& getPrevLine(unsigned numaInd, unsigned lineInd) noexcept {
+        if(lineInd == 0) {
+            numaInd = (numaInd == 0) ? getMapNumaCnt()-1 : numaInd-1;
+            lineInd = getLineCnt(numaInd);
+        }
+        return getLine(numaInd, lineInd-1);
+    }
+
+    // the line bellow, wraps around to the first line of the map
+    [[nodiscard]] MapLineBitboard& getNextLine(unsigned numaInd, unsigned lineInd) noexcept {
+        ++lineInd;
+        if(lineInd == getLineCnt(numaInd)) {
+            numaInd = (numaInd+1 == getMapNumaCnt()) ? 0 : numaInd+1;
+            lineInd = 0;
+        }
+        return getLine(numaInd, lineInd);
+    }
+
+    void load(const Map &map, bool stamp) {
+        for(unsigned numaInd=0; numaInd<getMapNumaCnt(); ++numaInd) {
+            for(unsigned lineInd=0; lineInd<getLineCnt(numaInd); ++lineInd) {
+                getLine(numaInd, lineInd).load(map.getMapNuma(numaInd).getLine(lineInd), stamp);
+            }
+        }
+    }
+
+    void store(Map &map) const {
+        for(unsigned numaInd=0; numaInd<getMapNumaCnt(); ++numaInd) {
+            for(unsigned lineInd=0; lineInd<getLineCnt(numaInd); ++lineInd) {
+                getLine(numaInd, lineInd).store(map.getMapNuma(numaInd).getLine(lineInd));
+            }
+        }
+    }
+};
+
+}
@@ -1,117 +1,556 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
+#include <memory_resource>
+#include <utility>
 #include <vector>
 
 #include "tile.hpp"
 
 namespace WaTor {
 
+    enum class MapLineStorage {
+        TILES = 0,  // only the tiles
+        // also a dense entity plane, 2 bits for every tile: bit sliced
+        // water and fish masks of every block, the tile kernel keeps it
+        // up to date, after any other change updateEntityPlane has to be called
+        SPLIT
+    };
+
+    enum class MapLineLayout {
+        ROWS = 0,   // row major
+        // the columns are split into panels of MapLine::PANEL_WIDTH, every
+        // panel is row major on its own, so the tiles above and bellow are 
+        // PANEL_WIDTH bytes away instead of the whole width of the map
+        PANELS
+    };
+
+    // m_map holds height+2 rows: row 0 and row height+1 are halo rows,
+    // copies of the last row of the line above and the first row of the
+    // line bellow, so the tiles above and bellow are a fixed offset 
+    // (getRowStride) from a tile,
+    // the rows are split into panels of columns (one with MapLineLayout::ROWS),
+    // all rows of a panel are stored before the next panel,
+    // there is room for spare rows above and bellow them, so rows can be 
+    // moved from and to the neighbouring lines (moveRows) without moving 
+    // the others
     class MapLine {
+    public:
+        // tiles per occupancy block
+        static constexpr unsigned BLOCK_WIDTH = 64;
+        // columns of a panel with MapLineLayout::PANELS, the last one may be narrower
+        static constexpr unsigned PANEL_WIDTH = 1024;
+        static_assert(PANEL_WIDTH % BLOCK_WIDTH == 0 && (PANEL_WIDTH & (PANEL_WIDTH-1)) == 0, 
+                      "a block is never split between panels");
+
+        // bit x is tile x of a block
+        using EntityWord = std::uint64_t;
+        // in a row of the entity plane, the fish mask of a block follows its water mask
+        static constexpr unsigned ENTITY_WATER = 0, ENTITY_FISH = 1, ENTITY_WORDS_PER_BLOCK = 2;
+
     private:
-        std::pmr::vector<bool> m_topMask, m_bottomMask, m_updateMask;
+        using OccupancyWord = std::uint64_t;
+        static constexpr unsigned OCCUPANCY_WORD_BITS = 64;
+
         std::pmr::vector<Tile> m_map;
+        // empty with MapLineStorage::TILES, height+2 rows like m_map,
+        // a shark has both bits cleared, so do the bits past the width
+        std::pmr::vector<EntityWord> m_entities;
+        // one bit for every block of BLOCK_WIDTH tiles of every row,
+        // a cleared bit means there is no entity in the block,
+        // a set one that there may be
+        std::pmr::vector<OccupancyWord> m_occupancy;
         unsigned m_height, m_width;
+        // the rows of every buffer, the halo row above row 0 is row
+        // m_rowOrigin of it, in every panel of m_map
+        unsigned m_rowCapacity, m_rowOrigin;
+        unsigned m_blockCnt, m_occupancyWordsPerRow;
+        // column posx is in panel posx >> m_panelShift, every panel except
+        // the last one is 1 << m_panelShift wide
+        MapLineStorage m_storage;
+        MapLineLayout m_layout;
+        unsigned m_panelShift, m_panelCnt, m_lastPanelWidth;
+
+        [[nodiscard]] static unsigned calcPanelShift(unsigned width, MapLineLayout layout) noexcept {
+            unsigned shift = 0;
+            while(shift < 31 && (1U << shift) < width && 
+                  (layout == MapLineLayout::ROWS || (1U << shift) < PANEL_WIDTH)) {
+                ++shift;
+            }
+            return shift;
+        }
+
+        // row is counted from the top halo row
+        [[nodiscard]] std::size_t tileOffset(unsigned row, unsigned posx) const noexcept {
+            const unsigned panel = posx >> m_panelShift;
+            const std::size_t panelBeg = static_cast<std::size_t>(panel) << m_panelShift;
+            return panelBeg*m_rowCapacity + static_cast<std::size_t>(m_rowOrigin + row)*getPanelWidth(panel) + 
+                   (posx - panelBeg);
+        }
+
+        [[nodiscard]] std::size_t occupancyOffset(unsigned posy) const noexcept {
+            return static_cast<std::size_t>(m_rowOrigin + posy)*m_occupancyWordsPerRow;
+        }
+
+        // row is counted from the top halo row
+        [[nodiscard]] std::size_t entityOffset(unsigned row) const noexcept {
+            return static_cast<std::size_t>(m_rowOrigin + row)*getEntityRowWords();
+        }
+
+        [[nodiscard]] std::size_t entityRowOffset(unsigned posy) const noexcept {
+            return entityOffset(posy+1);
+        }
+
+        // cnt elements from src to dst, the ranges may overlap
+        template<class T>
+        static void moveWithin(std::pmr::vector<T> &vec, std::size_t src, std::size_t dst, std::size_t cnt) {
+            if(dst < src) {
+                std::copy(vec.begin() + static_cast<std::ptrdiff_t>(src), 
+                          vec.begin() + static_cast<std::ptrdiff_t>(src + cnt), 
+                          vec.begin() + static_cast<std::ptrdiff_t>(dst));
+            } else {
+                std::copy_backward(vec.begin() + static_cast<std::ptrdiff_t>(src), 
+                                   vec.begin() + static_cast<std::ptrdiff_t>(src + cnt), 
+                                   vec.begin() + static_cast<std::ptrdiff_t>(dst + cnt));
+            }
+        }
+
+        // copies rows [srcRow, srcRow+cnt) of src to rows [dstRow, dstRow+cnt)
+        // of dst, the rows are counted from the top halo rows, the copied 
+        // rows must not overlap
+        static void copyRows(const MapLine &src, unsigned srcRow, MapLine &dst, unsigned dstRow, unsigned cnt) {
+            for(unsigned panel=0; panel<src.m_panelCnt; ++panel) {
+                const unsigned beg = src.getPanelBegin(panel);
+                const std::size_t tiles = std::size_t{cnt}*src.getPanelWidth(panel);
+                const Tile *from = &src.m_map[src.tileOffset(srcRow, beg)];
+                std::copy(from, from + tiles, &dst.m_map[dst.tileOffset(dstRow, beg)]); // NOLINT
+            }
+            // the occupancy has no halo rows
+            const std::size_t occWords = std::size_t{cnt}*src.m_occupancyWordsPerRow;
+            const OccupancyWord *occ = &src.m_occupancy[src.occupancyOffset(srcRow) - src.m_occupancyWordsPerRow];
+            std::copy(occ, occ + occWords, &dst.m_occupancy[dst.occupancyOffset(dstRow) - dst.m_occupancyWordsPerRow]); // NOLINT
+            if(src.hasEntityPlane()) {
+                const std::size_t entWords = std::size_t{cnt}*src.getEntityRowWords();
+                const EntityWord *ent = &src.m_entities[src.entityOffset(srcRow)];
+                std::copy(ent, ent + entWords, &dst.m_entities[dst.entityOffset(dstRow)]); // NOLINT
+            }
+        }
+
+        // moves the rows (with the halo rows) so origin spare rows are above them
+        void setRowOrigin(unsigned origin) {
+            assert(origin + m_height + 2 <= m_rowCapacity);
+            assert(isInitialized());
+            if(origin == m_rowOrigin) {
+                return;
+            }
+            for(unsigned panel=0; panel<m_panelCnt; ++panel) {
+                const std::size_t panelBeg = static_cast<std::size_t>(getPanelBegin(panel))*m_rowCapacity;
+                const std::size_t rowTiles = getPanelWidth(panel);
+                moveWithin(m_map, panelBeg + m_rowOrigin*rowTiles, panelBeg + origin*rowTiles, 
+                           (std::size_t{m_height}+2)*rowTiles);
+            }
+            moveWithin(m_occupancy, m_rowOrigin*std::size_t{m_occupancyWordsPerRow}, 
+                       origin*std::size_t{m_occupancyWordsPerRow}, 
+                       std::size_t{m_height}*m_occupancyWordsPerRow);
+            if(hasEntityPlane()) {
+                moveWithin(m_entities, m_rowOrigin*std::size_t{getEntityRowWords()}, 
+                           origin*std::size_t{getEntityRowWords()}, 
+                           (std::size_t{m_height}+2)*getEntityRowWords());
+            }
+            m_rowOrigin = origin;
+        }
+
+        // recalculates a row of the entity plane from its tiles, 
+        // row is counted from the top halo row
+        void updateEntityRow(unsigned row, EntityWord *entRow) const {
+            for(unsigned block=0; block<m_blockCnt; ++block) {
+                const unsigned beg = block*BLOCK_WIDTH;
+                const unsigned end = std::min(beg + BLOCK_WIDTH, m_width);
+                const Tile *tiles = &m_map[tileOffset(row, beg)];
+                EntityWord water = 0, fish = 0;
+                for(unsigned x=beg; x<end; ++x) {
+                    const Entity ent = tiles[x-beg].getEntity(); // NOLINT
+                    water |= EntityWord{ent == Entity::WATER} << (x-beg);
+                    fish |= EntityWord{ent == Entity::FISH} << (x-beg);
+                }
+                entRow[ENTITY_WORDS_PER_BLOCK*block + ENTITY_WATER] = water; // NOLINT
+                entRow[ENTITY_WORDS_PER_BLOCK*block + ENTITY_FISH] = fish; // NOLINT
+            }
+        }
 
     public:
         // type deffinitions:
         using TileIter = decltype(m_map)::iterator;
-        using UpdateMaskIter = decltype(m_updateMask)::iterator;
-        using TopMaskIter = decltype(m_topMask)::iterator;
-        using BottomMaskIter = decltype(m_bottomMask)::iterator;
 
         // member functions:
 
-        MapLine(unsigned height, unsigned width, std::pmr::memory_resource *mmr) 
-            : m_topMask(width, false, mmr), m_bottomMask(width, false, mmr), m_updateMask(width, false, mmr), 
-              m_map(static_cast<std::size_t>(width)*height, Tile(), mmr), m_height(height), m_width(width) 
+        // deferInit - the memory is only allocated, it is written first by 
+        // initialize, so its pages are placed by the thread calling it,
+        // spareRows - the room for the rows moved in (moveRows) above and 
+        // bellow the line each
+        MapLine(unsigned height, unsigned width, std::pmr::memory_resource *mmr, 
+                MapLineStorage storage = MapLineStorage::TILES, 
+                MapLineLayout layout = MapLineLayout::ROWS, bool deferInit = false,
+                unsigned spareRows = 0) 
+            : m_map(mmr), m_entities(mmr), 
+              m_occupancy(mmr), m_height(height), m_width(width), 
+              m_rowCapacity(height + 2 + 2*spareRows), m_rowOrigin(spareRows),
+              m_blockCnt(static_cast<unsigned>((std::size_t{width} + BLOCK_WIDTH - 1)/BLOCK_WIDTH)), 
+              m_occupancyWordsPerRow((m_blockCnt + OCCUPANCY_WORD_BITS - 1)/OCCUPANCY_WORD_BITS),
+              m_storage(storage), m_layout(layout), m_panelShift(calcPanelShift(width, layout)), 
+              m_panelCnt(std::max(1U, static_cast<unsigned>((std::size_t{width} + (std::size_t{1} << m_panelShift) - 1) >> m_panelShift))),
+              m_lastPanelWidth(width - ((m_panelCnt-1) << m_panelShift))
               {
+            m_map.reserve(static_cast<std::size_t>(width)*m_rowCapacity);
+            m_occupancy.reserve(static_cast<std::size_t>(m_occupancyWordsPerRow)*m_rowCapacity);
+            if(storage == MapLineStorage::SPLIT) {
+                m_entities.reserve(static_cast<std::size_t>(getEntityRowWords())*m_rowCapacity);
+            }
+
+            if(!deferInit) {
+                initialize();
+            }
 
             // std::clog << "Creating line with: " << width << ' ' << height << '\n'; // TODO: comment out
         }
 
+        // fills the line with water, does not allocate
+        void initialize() {
+            assert(!isInitialized());
+            // within the reserved capacity
+            m_map.resize(static_cast<std::size_t>(m_width)*m_rowCapacity);
+            m_occupancy.resize(static_cast<std::size_t>(m_occupancyWordsPerRow)*m_rowCapacity);
+            markAllOccupied();
+
+            if(m_storage == MapLineStorage::SPLIT) {
+                m_entities.resize(static_cast<std::size_t>(getEntityRowWords())*m_rowCapacity);
+                for(unsigned row=0; row<=m_height+1; ++row) {
+                    updateEntityRow(row, &m_entities[entityOffset(row)]);
+                }
+            }
+        }
+
+        [[nodiscard]] bool isInitialized() const noexcept { return !m_map.empty(); }
+
+        // the memory of the tiles, the occupancy and the entity plane, for 
+        // the paging hints of MappedFileResource
+        [[nodiscard]] std::array<std::pair<const void*, std::size_t>, 3> getBuffers() const noexcept {
+            return {{{m_map.data(), m_map.size()*sizeof(Tile)},
+                     {m_occupancy.data(), m_occupancy.size()*sizeof(OccupancyWord)},
+                     {m_entities.data(), m_entities.size()*sizeof(EntityWord)}}};
+        }
+
         [[nodiscard]] unsigned getWidth() const noexcept { return m_width; }
         [[nodiscard]] unsigned getHeight() const noexcept { return m_height; }
 
-        [[nodiscard]] std::size_t getAbsSize() const noexcept { return m_map.size(); }
+        // the height the line can grow to by moveRows
+        [[nodiscard]] unsigned getMaxHeight() const noexcept { return m_rowCapacity - 2; }
+
+        // the rows which can be moved in above and bellow the line
+        [[nodiscard]] unsigned getSpareRowsTop() const noexcept { return m_rowOrigin; }
+        [[nodiscard]] unsigned getSpareRowsBottom() const noexcept { 
+            return m_rowCapacity - m_rowOrigin - m_height - 2; 
+        }
+
+        // moves the rows so the spare rows are split evenly above and 
+        // bellow them
+        void centerRows() {
+            setRowOrigin((m_rowCapacity - m_height - 2)/2);
+        }
+
+        // moves the boundary between upper and the line bellow it, lower:
+        // rows > 0 - the first rows of lower become the last ones of upper,
+        // rows < 0 - the last -rows of upper become the first ones of lower,
+        // only the moved rows are copied (and the other ones of a line if it
+        // has run out of the spare rows on that side), the halo rows have
+        // to be loaded again
+        static void moveRows(MapLine &upper, MapLine &lower, int rows) {
+            assert(upper.m_width == lower.m_width && upper.m_panelShift == lower.m_panelShift);
+            assert(upper.m_storage == lower.m_storage);
+            if(rows > 0) {
+                const auto cnt = static_cast<unsigned>(rows);
+                assert(cnt < lower.m_height);
+                assert(upper.m_height + cnt <= upper.getMaxHeight());
+                if(upper.getSpareRowsBottom() < cnt) {
+                    const unsigned spare = upper.getMaxHeight() - upper.m_height;
+                    upper.setRowOrigin(std::min(spare/2, spare - cnt));
+                }
+                assert(upper.getSpareRowsBottom() >= cnt);
+                copyRows(lower, 1, upper, upper.m_height+1, cnt);
+                upper.m_height += cnt;
+                lower.m_rowOrigin += cnt;
+                lower.m_height -= cnt;
+            } else if(rows < 0) {
+                const auto cnt = static_cast<unsigned>(-rows);
+                assert(cnt < upper.m_height);
+                assert(lower.m_height + cnt <= lower.getMaxHeight());
+                if(lower.getSpareRowsTop() < cnt) {
+                    const unsigned spare = lower.getMaxHeight() - lower.m_height;
+                    lower.setRowOrigin(std::max(spare/2, cnt));
+                }
+                assert(lower.getSpareRowsTop() >= cnt);
+                lower.m_rowOrigin -= cnt;
+                lower.m_height += cnt;
+                copyRows(upper, upper.m_height+1-cnt, lower, 1, cnt);
+                upper.m_height -= cnt;
+            }
+        }
+
+        // number of tiles without the halo rows
+        [[nodiscard]] std::size_t getAbsSize() const noexcept { 
+            return static_cast<std::size_t>(m_height)*m_width; 
+        }
+
+        [[nodiscard]] std::pmr::memory_resource* getMemoryResource() const noexcept {
+            return m_map.get_allocator().resource();
+        }
 
         [[nodiscard]] Tile& get(unsigned posy, unsigned posx) noexcept {
             assert(posy < m_height);
             assert(posx < m_width);
-            return m_map[posy*m_width + posx];
+            return m_map[tileOffset(posy+1, posx)];
         }
         [[nodiscard]] const Tile& get(unsigned posy, unsigned posx) const noexcept {
             assert(posy < m_height);
             assert(posx < m_width);
-            return m_map[posy*m_width + posx];
+            return m_map[tileOffset(posy+1, posx)];
         }
 
+        // the tile indx in row major order
         [[nodiscard]] Tile& getAbs(std::size_t indx) {
-            assert(indx < m_map.size());
-            return m_map[indx];
+            assert(indx < getAbsSize());
+            if(m_panelCnt == 1) {
+                return m_map[(std::size_t{m_rowOrigin}+1)*m_width + indx];
+            }
+            return get(static_cast<unsigned>(indx / m_width), static_cast<unsigned>(indx % m_width));
         }
         [[nodiscard]] const Tile& getAbs(std::size_t indx) const {
-            assert(indx < m_map.size());
-            return m_map[indx];
+            assert(indx < getAbsSize());
+            if(m_panelCnt == 1) {
+                return m_map[(std::size_t{m_rowOrigin}+1)*m_width + indx];
+            }
+            return get(static_cast<unsigned>(indx / m_width), static_cast<unsigned>(indx % m_width));
         }
 
-        [[nodiscard]] std::pmr::vector<bool>::reference getUpdateMask(unsigned posx) {
-            assert(posx < m_width);
-            return m_updateMask[posx];
+        [[nodiscard]] MapLineLayout getLayout() const noexcept { return m_layout; }
+
+        [[nodiscard]] unsigned getPanelCnt() const noexcept { return m_panelCnt; }
+
+        // the first column of a panel
+        [[nodiscard]] unsigned getPanelBegin(unsigned panel) const noexcept { 
+            assert(panel < m_panelCnt);
+            return panel << m_panelShift; 
+        }
+
+        [[nodiscard]] unsigned getPanelWidth(unsigned panel) const noexcept {
+            assert(panel < m_panelCnt);
+            return (panel+1 == m_panelCnt) ? m_lastPanelWidth : (1U << m_panelShift);
         }
-        [[nodiscard]] bool getUpdateMask(unsigned posx) const {
+
+        [[nodiscard]] bool isPanelBegin(unsigned posx) const noexcept {
+            return (posx & ((1U << m_panelShift) - 1)) == 0;
+        }
+
+        // the distance from a tile in column posx to the tiles above and bellow it
+        [[nodiscard]] std::size_t getRowStride(unsigned posx) const noexcept {
             assert(posx < m_width);
-            return m_updateMask[posx];
+            return getPanelWidth(posx >> m_panelShift);
+        }
+
+        // pointer to the tile (posy, posx), it is followed by the tiles to 
+        // the end of its panel, the halo rows are at -getRowStride(posx) 
+        // from row 0 and +getRowStride(posx) from row getHeight()-1
+        [[nodiscard]] Tile* getTilePtr(unsigned posy, unsigned posx) noexcept {
+            assert(posy < m_height && posx < m_width);
+            return &m_map[tileOffset(posy+1, posx)];
+        }
+        [[nodiscard]] const Tile* getTilePtr(unsigned posy, unsigned posx) const noexcept {
+            assert(posy < m_height && posx < m_width);
+            return &m_map[tileOffset(posy+1, posx)];
         }
-        
-        [[nodiscard]] std::pmr::vector<bool>::reference getTopMask(unsigned posx) {
+
+        // pointer to the first tile of row posy, same as getTilePtr(posy, 0)
+        [[nodiscard]] Tile* getRowPtr(unsigned posy) noexcept {
+            return getTilePtr(posy, 0);
+        }
+        [[nodiscard]] const Tile* getRowPtr(unsigned posy) const noexcept {
+            return getTilePtr(posy, 0);
+        }
+
+        [[nodiscard]] Tile& getHaloTop(unsigned posx) noexcept {
             assert(posx < m_width);
-            return m_topMask[posx];
+            return m_map[tileOffset(0, posx)];
         }
-        [[nodiscard]] bool getTopMask(unsigned posx) const {
+        [[nodiscard]] const Tile& getHaloTop(unsigned posx) const noexcept {
             assert(posx < m_width);
-            return m_topMask[posx];
+            return m_map[tileOffset(0, posx)];
         }
 
-        [[nodiscard]] std::pmr::vector<bool>::reference getBottomMask(unsigned posx) {
+        [[nodiscard]] Tile& getHaloBottom(unsigned posx) noexcept {
             assert(posx < m_width);
-            return m_bottomMask[posx];
+            return m_map[tileOffset(m_height+1, posx)];
         }
-        [[nodiscard]] bool getBottomMask(unsigned posx) const {
+        [[nodiscard]] const Tile& getHaloBottom(unsigned posx) const noexcept {
             assert(posx < m_width);
-            return m_bottomMask[posx];
+            return m_map[tileOffset(m_height+1, posx)];
         }
 
-        [[nodiscard]] TileIter getTileIter(unsigned posy, unsigned posx) {
-            const std::size_t adist = posy*m_width + posx;
-            assert(adist < m_map.size());
-            TileIter res = m_map.begin();
-            std::advance(res, adist);
-            return res;
+        // copies the edge rows of the neighbouring lines into the halo rows
+        void loadHalo(const MapLine &prev, const MapLine &next) {
+            assert(prev.getWidth() == m_width && next.getWidth() == m_width);
+            assert(prev.m_panelShift == m_panelShift && next.m_panelShift == m_panelShift);
+            for(unsigned panel=0; panel<m_panelCnt; ++panel) {
+                const unsigned beg = getPanelBegin(panel), cnt = getPanelWidth(panel);
+                const Tile *prevRow = prev.getTilePtr(prev.getHeight()-1, beg);
+                const Tile *nextRow = next.getTilePtr(0, beg);
+                std::copy(prevRow, prevRow + cnt, &getHaloTop(beg)); // NOLINT
+                std::copy(nextRow, nextRow + cnt, &getHaloBottom(beg)); // NOLINT
+            }
+            if(hasEntityPlane()) {
+                loadEntityHalo(prev, next);
+            }
         }
 
-        [[nodiscard]] UpdateMaskIter getUpdateMaskIter(unsigned posx) {
-            assert(posx < m_width);
-            UpdateMaskIter res = m_updateMask.begin();
-            std::advance(res, posx);
-            return res;
+        // writes the halo rows back to the edge rows of the neighbouring lines
+        void storeHalo(MapLine &prev, MapLine &next) const {
+            assert(prev.getWidth() == m_width && next.getWidth() == m_width);
+            assert(prev.m_panelShift == m_panelShift && next.m_panelShift == m_panelShift);
+            for(unsigned panel=0; panel<m_panelCnt; ++panel) {
+                const unsigned beg = getPanelBegin(panel), cnt = getPanelWidth(panel);
+                std::copy(&getHaloTop(beg), &getHaloTop(beg) + cnt, prev.getTilePtr(prev.getHeight()-1, beg)); // NOLINT
+                std::copy(&getHaloBottom(beg), &getHaloBottom(beg) + cnt, next.getTilePtr(0, beg)); // NOLINT
+            }
+            if(hasEntityPlane()) {
+                storeEntityHalo(prev, next);
+            }
+            prev.updateOccupancy(prev.getHeight()-1);
+            next.updateOccupancy(0);
         }
 
-        [[nodiscard]] TopMaskIter getTopMaskIter(unsigned posx) {
-            assert(posx < m_width);
-            TopMaskIter res = m_topMask.begin();
-            std::advance(res, posx);
-            return res;
+        [[nodiscard]] bool hasEntityPlane() const noexcept { return m_storage == MapLineStorage::SPLIT; }
+
+        // words in a row of the entity plane
+        [[nodiscard]] unsigned getEntityRowWords() const noexcept { 
+            return ENTITY_WORDS_PER_BLOCK*m_blockCnt; 
         }
 
-        [[nodiscard]] BottomMaskIter getBottomMaskIter(unsigned posx) {
-            assert(posx < m_width);
-            BottomMaskIter res = m_bottomMask.begin();
-            std::advance(res, posx);
-            return res;
+        // the entity plane row posy, the halo rows are at -getEntityRowWords()
+        // from row 0 and +getEntityRowWords() from row getHeight()-1
+        [[nodiscard]] EntityWord* getEntityRowPtr(unsigned posy) noexcept {
+            assert(hasEntityPlane() && posy < m_height);
+            return &m_entities[entityRowOffset(posy)];
+        }
+        [[nodiscard]] const EntityWord* getEntityRowPtr(unsigned posy) const noexcept {
+            assert(hasEntityPlane() && posy < m_height);
+            return &m_entities[entityRowOffset(posy)];
+        }
+
+        static void setEntity(EntityWord *entRow, unsigned posx, Entity ent) noexcept {
+            EntityWord *block = entRow + static_cast<std::size_t>(posx / BLOCK_WIDTH)*ENTITY_WORDS_PER_BLOCK; // NOLINT
+            const EntityWord bit = EntityWord{1} << (posx % BLOCK_WIDTH);
+            block[ENTITY_WATER] = (ent == Entity::WATER) ? (block[ENTITY_WATER] | bit) : (block[ENTITY_WATER] & ~bit); // NOLINT
+            block[ENTITY_FISH] = (ent == Entity::FISH) ? (block[ENTITY_FISH] | bit) : (block[ENTITY_FISH] & ~bit); // NOLINT
         }
 
+        // recalculates the entity plane from the tiles, the halo rows are
+        // loaded by loadHalo
+        void updateEntityPlane() {
+            assert(hasEntityPlane());
+            for(unsigned posy=0; posy<m_height; ++posy) {
+                updateEntityRow(posy+1, getEntityRowPtr(posy));
+            }
+        }
+
+        void loadEntityHalo(const MapLine &prev, const MapLine &next) {
+            assert(hasEntityPlane() && prev.hasEntityPlane() && next.hasEntityPlane());
+            const std::size_t words = getEntityRowWords();
+            const EntityWord *prevRow = prev.getEntityRowPtr(prev.getHeight()-1);
+            const EntityWord *nextRow = next.getEntityRowPtr(0);
+            std::copy(prevRow, prevRow + words, &m_entities[entityOffset(0)]); // NOLINT
+            std::copy(nextRow, nextRow + words, &m_entities[entityRowOffset(m_height)]); // NOLINT
+        }
+
+        void storeEntityHalo(MapLine &prev, MapLine &next) const {
+            assert(hasEntityPlane() && prev.hasEntityPlane() && next.hasEntityPlane());
+            const std::size_t words = getEntityRowWords();
+            const EntityWord *top = &m_entities[entityOffset(0)];
+            const EntityWord *bottom = &m_entities[entityRowOffset(m_height)];
+            std::copy(top, top + words, prev.getEntityRowPtr(prev.getHeight()-1)); // NOLINT
+            std::copy(bottom, bottom + words, next.getEntityRowPtr(0)); // NOLINT
+        }
+
+        [[nodiscard]] unsigned getBlockCnt() const noexcept { return m_blockCnt; }
+
+        [[nodiscard]] bool isBlockOccupied(unsigned posy, unsigned block) const noexcept {
+            assert(posy < m_height && block < m_blockCnt);
+            const OccupancyWord word = m_occupancy[occupancyOffset(posy) + block/OCCUPANCY_WORD_BITS];
+            return ((word >> (block % OCCUPANCY_WORD_BITS)) & 1U) != 0;
+        }
+
+        void setBlockOccupied(unsigned posy, unsigned block) noexcept {
+            assert(posy < m_height && block < m_blockCnt);
+            m_occupancy[occupancyOffset(posy) + block/OCCUPANCY_WORD_BITS] |= 
+                OccupancyWord{1} << (block % OCCUPANCY_WORD_BITS);
+        }
+
+        // the block must not contain entities
+        void clearBlockOccupied(unsigned posy, unsigned block) noexcept {
+            assert(posy < m_height && block < m_blockCnt);
+            m_occupancy[occupancyOffset(posy) + block/OCCUPANCY_WORD_BITS] &= 
+                ~(OccupancyWord{1} << (block % OCCUPANCY_WORD_BITS));
+        }
+
+        // the first block >= block which may contain entities, getBlockCnt() if none
+        [[nodiscard]] unsigned findOccupiedBlock(unsigned posy, unsigned block) const noexcept {
+            assert(posy < m_height && block <= m_blockCnt);
+            const OccupancyWord *row = &m_occupancy[occupancyOffset(posy)];
+            unsigned wordInd = block / OCCUPANCY_WORD_BITS;
+            if(wordInd == m_occupancyWordsPerRow) {
+                return m_blockCnt;
+            }
+            OccupancyWord word = row[wordInd] & (~OccupancyWord{0} << (block % OCCUPANCY_WORD_BITS)); // NOLINT
+            while(word == 0) {
+                if(++wordInd == m_occupancyWordsPerRow) {
+                    return m_blockCnt;
+                }
+                word = row[wordInd]; // NOLINT
+            }
+            return wordInd*OCCUPANCY_WORD_BITS + static_cast<unsigned>(__builtin_ctzll(word));
+        }
+
+        // needed after the tiles are changed from outside of the simulation
+        void markAllOccupied() {
+            std::fill(m_occupancy.begin(), m_occupancy.end(), ~OccupancyWord{0});
+        }
+
+        // recalculates the exact occupancy of row posy
+        void updateOccupancy(unsigned posy) {
+            for(unsigned block=0; block<m_blockCnt; ++block) {
+                const unsigned beg = block*BLOCK_WIDTH;
+                const unsigned end = std::min(beg + BLOCK_WIDTH, m_width);
+                const Tile *tiles = getTilePtr(posy, beg);
+                const bool occupied = std::any_of(tiles, tiles + (end-beg), [](const Tile &tile) { // NOLINT
+                    return tile.getEntity() != Entity::WATER;
+                });
+                if(occupied) {
+                    setBlockOccupied(posy, block);
+                } else {
+                    clearBlockOccupied(posy, block);
+                }
+            }
+        }
+
+        [[nodiscard]] TileIter getTileIter(unsigned posy, unsigned posx) {
+            assert(posy < m_height && posx < m_width);
+            const std::size_t adist = tileOffset(posy+1, posx);
+            TileIter res = m_map.begin();
+            std::advance(res, adist);
+            return res;
+        }
     };
 }
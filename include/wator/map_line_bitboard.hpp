@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "map_line.hpp"
+#include "tile.hpp"
+
+namespace WaTor {
+
+    // number of bits needed to store val
+    constexpr unsigned bitWidth(unsigned val) {
+        unsigned res = 0;
+        while(val > 0) { ++res; val >>= 1U; }
+        return res;
+    }
+
+    // Bit sliced representation of a MapLine
+    // every row is stored as PLANE_CNT bit planes, each plane is
+    // getWordsPerRow() 64 bit words, bit x of a plane belongs to column x
+    // padding bits (x >= width) are always zero
+    class MapLineBitboard {
+    public:
+        using Word = std::uint64_t;
+        static constexpr unsigned WORD_BITS = 64;
+
+        static constexpr unsigned AGE_BITS = bitWidth(Tile::MAX_AGE);
+        static constexpr unsigned LAST_ATE_BITS = bitWidth(Tile::MAX_LAST_ATE);
+
+        // plane indexes inside a row
+        static constexpr unsigned FISH_PLANE = 0;
+        static constexpr unsigned SHARK_PLANE = 1;
+        // parity of the chronon in which the entity was last updated
+        static constexpr unsigned STAMP_PLANE = 2;
+        static constexpr unsigned AGE_PLANE = 3;
+        static constexpr unsigned LAST_ATE_PLANE = AGE_PLANE + AGE_BITS;
+        static constexpr unsigned PLANE_CNT = LAST_ATE_PLANE + LAST_ATE_BITS;
+
+    private:
+        std::pmr::vector<Word> m_planes;
+        unsigned m_height, m_width;
+        unsigned m_wordsPerRow;
+
+        [[nodiscard]] std::size_t planeOffset(unsigned posy, unsigned plane) const noexcept {
+            return (static_cast<std::size_t>(posy)*PLANE_CNT + plane)*m_wordsPerRow;
+        }
+
+    public:
+        MapLineBitboard(unsigned height, unsigned width, std::pmr::memory_resource *mmr)
+            : m_planes(mmr), m_height(height), m_width(width),
+              m_wordsPerRow(static_cast<unsigned>((std::size_t{width} + WORD_BITS - 1)/WORD_BITS)) {
+            m_planes.resize(static_cast<std::size_t>(m_height)*PLANE_CNT*m_wordsPerRow, 0);
+        }
+
+        explicit MapLineBitboard(const MapLine &line)
+            : MapLineBitboard(line.getHeight(), line.getWidth(), line.getMemoryResource()) {}
+
+        [[nodiscard]] unsigned getWidth() const noexcept { return m_width; }
+        [[nodiscard]] unsigned getHeight() const noexcept { return m_height; }
+        [[nodiscard]] unsigned getWordsPerRow() const noexcept { return m_wordsPerRow; }
+
+        // mask of the valid bits in the last word of a row
+        [[nodiscard]] Word getLastWordMask() const noexcept {
+            const unsigned rem = m_width % WORD_BITS;
+            return (rem == 0) ? ~Word{0} : ((Word{1} << rem) - 1);
+        }
+
+        [[nodiscard]] Word* getPlane(unsigned posy, unsigned plane) noexcept {
+            assert(posy < m_height && plane < PLANE_CNT);
+            return &m_planes[planeOffset(posy, plane)];
+        }
+        [[nodiscard]] const Word* getPlane(unsigned posy, unsigned plane) const noexcept {
+            assert(posy < m_height && plane < PLANE_CNT);
+            return &m_planes[planeOffset(posy, plane)];
+        }
+
+        // all planes of one row are consecutive,
+        // plane p starts at getRow(posy) + p*getWordsPerRow()
+        [[nodiscard]] Word* getRow(unsigned posy) noexcept { return getPlane(posy, 0); }
+        [[nodiscard]] const Word* getRow(unsigned posy) const noexcept { return getPlane(posy, 0); }
+
+        [[nodiscard]] Tile getTile(unsigned posy, unsigned posx) const noexcept {
+            assert(posx < m_width);
+            const unsigned word = posx / WORD_BITS;
+            const unsigned bit = posx % WORD_BITS;
+            auto getBit = [&](unsigned plane) -> unsigned {
+                return static_cast<unsigned>(getPlane(posy, plane)[word] >> bit) & 1U;
+            };
+            auto getCounter = [&](unsigned firstPlane, unsigned bits) -> unsigned {
+                unsigned res = 0;
+                for(unsigned b=0; b<bits; ++b) {
+                    res |= getBit(firstPlane + b) << b;
+                }
+                return res;
+            };
+
+            if(getBit(FISH_PLANE) != 0) {
+                return {Entity::FISH, getCounter(AGE_PLANE, AGE_BITS), 0};
+            }
+            if(getBit(SHARK_PLANE) != 0) {
+                return {Entity::SHARK, getCounter(AGE_PLANE, AGE_BITS),
+                                       getCounter(LAST_ATE_PLANE, LAST_ATE_BITS)};
+            }
+            return {};
+        }
+
+        // stamp - the value of the stamp plane for all entities, the engine
+        // updates only entities whose stamp differs from the current chronon parity
+        void load(const MapLine &line, bool stamp) {
+            assert(line.getHeight() == m_height && line.getWidth() == m_width);
+            std::fill(m_planes.begin(), m_planes.end(), 0);
+
+            for(unsigned posy=0; posy<m_height; ++posy) {
+                for(unsigned posx=0; posx<m_width; ++posx) {
+                    const Tile &tile = line.get(posy, posx);
+                    const Entity ent = tile.getEntity();
+                    if(ent == Entity::WATER) {
+                        continue;
+                    }
+
+                    const unsigned word = posx / WORD_BITS;
+                    const Word bit = Word{1} << (posx % WORD_BITS);
+                    auto setCounter = [&](unsigned firstPlane, unsigned bits, unsigned val) {
+                        for(unsigned b=0; b<bits; ++b) {
+                            if(((val >> b) & 1U) != 0) {
+                                getPlane(posy, firstPlane + b)[word] |= bit;
+                            }
+                        }
+                    };
+
+                    if(stamp) {
+                        getPlane(posy, STAMP_PLANE)[word] |= bit;
+                    }
+                    setCounter(AGE_PLANE, AGE_BITS, tile.getAge());
+                    if(ent == Entity::FISH) {
+                        getPlane(posy, FISH_PLANE)[word] |= bit;
+                    } else {
+                        getPlane(posy, SHARK_PLANE)[word] |= bit;
+                        setCounter(LAST_ATE_PLANE, LAST_ATE_BITS, tile.getLastAte());
+                    }
+                }
+            }
+        }
+
+        void store(MapLine &line) const {
+            assert(line.getHeight() == m_height && line.getWidth() == m_width);
+            for(unsigned posy=0; posy<m_height; ++posy) {
+                for(unsigned posx=0; posx<m_width; ++posx) {
+                    line.get(posy, posx) = getTile(posy, posx);
+                }
+            }
+        }
+    };
+}
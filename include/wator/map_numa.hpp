@@ -3,7 +3,6 @@
 #include <vector>
 
 #include "map_line.hpp"
-#include "execution_planner.hpp"
 
 namespace WaTor {
 
@@ -13,29 +12,29 @@ namespace WaTor {
 
     public:
 
-        // width, height of the map for this numaNode
-        MapNuma(unsigned height, unsigned width, unsigned numaInx, const ExecutionPlanner &exp,
-                    std::pmr::memory_resource *pmr) 
+        // width, height of the map for this numaNode, split into lineCnt 
+        // lines, the first ones are a row higher if it is not divisible,
+        // spareRows - see MapLine
+        MapNuma(unsigned height, unsigned width, unsigned lineCnt, std::pmr::memory_resource *pmr, 
+                    MapLineStorage storage = MapLineStorage::TILES, 
+                    MapLineLayout layout = MapLineLayout::ROWS, bool deferInit = false,
+                    unsigned spareRows = 0) 
             : m_lines(pmr) {
-            const std::vector<unsigned> &cpuList = exp.getCpuListPerNuma(numaInx);
-            unsigned cpuCnt = static_cast<unsigned>(cpuList.size());
+            if(lineCnt == 0) { return; }
 
-            if(cpuCnt == 0) { return; }
+            unsigned heightPerLine = height/lineCnt;
+            unsigned heightRem = height - lineCnt*heightPerLine;
 
-            // TODO: granularity
-            unsigned heightPerLine = height/(2*cpuCnt);
-            unsigned heightRem = height - 2*cpuCnt*heightPerLine;
+            m_lines.reserve(lineCnt);
 
-            m_lines.reserve(static_cast<std::size_t>(cpuCnt)*2);
-
-            for(unsigned i=0; i<cpuCnt*2; ++i) {
+            for(unsigned i=0; i<lineCnt; ++i) {
                 unsigned newHeight = heightPerLine;
                 if(heightRem > 0) {
                     ++newHeight;
                     --heightRem;
                 }
 
-                m_lines.emplace_back(newHeight, width, pmr);
+                m_lines.emplace_back(newHeight, width, pmr, storage, layout, deferInit, spareRows);
             }
         }
 
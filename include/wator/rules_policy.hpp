@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <tuple>
+
+#include "rules.hpp"
+
+namespace WaTor {
+
+    // the thresholds the kernel needs, read from Rules at runtime
+    class RuntimeRulesPolicy {
+    private:
+        std::uint16_t m_fishBreedTime, m_sharkBreedTime;
+        std::uint16_t m_sharkStarveTime;
+
+    public:
+        explicit RuntimeRulesPolicy(const Rules &rules)
+            : m_fishBreedTime(rules.getFishBreedTime()),
+              m_sharkBreedTime(rules.getSharkBreedTime()),
+              m_sharkStarveTime(rules.getSharkStarveTime()) {}
+
+        // every rule set can be run with it
+        [[nodiscard]] static bool matches(const Rules &/*rules*/) noexcept { return true; }
+
+        [[nodiscard]] unsigned getFishBreedTime() const noexcept { return m_fishBreedTime; }
+        [[nodiscard]] unsigned getSharkBreedTime() const noexcept { return m_sharkBreedTime; }
+        [[nodiscard]] unsigned getSharkStarveTime() const noexcept { return m_sharkStarveTime; }
+    };
+
+    // the thresholds are known at compile time, so the comparisons
+    // in the kernel are folded
+    template<unsigned fishBreedTime, unsigned sharkBreedTime, unsigned sharkStarveTime>
+    class FixedRulesPolicy {
+        static_assert(fishBreedTime <= Rules::MAX_FISH_BREED_TIME &&
+                      sharkBreedTime <= Rules::MAX_SHARK_BREED_TIME &&
+                      sharkStarveTime <= Rules::MAX_SHARK_STARVE_TIME, "Invalid rules");
+    public:
+        explicit FixedRulesPolicy(const Rules &rules) {
+            assert(matches(rules));
+            static_cast<void>(rules);
+        }
+
+        [[nodiscard]] static bool matches(const Rules &rules) noexcept {
+            return rules.getFishBreedTime() == fishBreedTime &&
+                   rules.getSharkBreedTime() == sharkBreedTime &&
+                   rules.getSharkStarveTime() == sharkStarveTime;
+        }
+
+        [[nodiscard]] static constexpr unsigned getFishBreedTime() noexcept { return fishBreedTime; }
+        [[nodiscard]] static constexpr unsigned getSharkBreedTime() noexcept { return sharkBreedTime; }
+        [[nodiscard]] static constexpr unsigned getSharkStarveTime() noexcept { return sharkStarveTime; }
+    };
+
+    // the rule sets which get their own kernel, the first one is the default
+    // of parwator, every one has to be instantiated in wator_simulation_worker.cpp
+    using FixedRulesPolicies = std::tuple<
+        FixedRulesPolicy<3, 10, 3>  // NOLINT
+    >;
+}
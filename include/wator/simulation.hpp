@@ -1,51 +1,424 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <vector>
 #include <memory>
+#include <optional>
+#include <ostream>
 #include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <variant>
 
+#include "kernel_isa.hpp"
 #include "rules.hpp"
+#include "rules_policy.hpp"
 #include "map.hpp"
+#include "map_bitboard.hpp"
 #include "simulation_worker.hpp"
+#include "simulation_bitboard_worker.hpp"
+#include "stripe_rebalancer.hpp"
 #include "execution_planner.hpp"
+#include "hierarchical_barrier.hpp"
+#include "numa_audit.hpp"
 #include "worker.hpp"
 
 namespace WaTor {
+
+enum class SimulationEngine {
+    TILE = 0,   // SimulationWorker, updates one Tile at a time
+    BITBOARD    // SimulationBitboardWorker, updates 64 cells at a time
+};
+
+struct SimulationOptions {
+    SimulationEngine engine = SimulationEngine::TILE;
+    // SimulationEngine::TILE uses a kernel specialised for the rules if
+    // they are one of FixedRulesPolicies
+    bool fixedRules = true;
+    // forces the instruction set of the SimulationEngine::TILE kernel, 
+    // by default the best one the CPU supports (detectKernelIsa)
+    std::optional<KernelIsa> kernelIsa;
+    // MapLineLayout::PANELS keeps the tiles above and bellow close 
+    // in memory on very wide maps
+    MapLineLayout layout = MapLineLayout::ROWS;
+    // columns of a strip of the column blocked sweep of SimulationEngine::TILE,
+    // 0 sweeps whole rows, see BasicSimulationWorker
+    unsigned stripWidth = 0;
+    // the map is backed by huge pages (HugePageResource)
+    bool hugePages = false;
+    // where the pages the map got are reported, may be nullptr
+    std::ostream *allocLog = nullptr;
+    // the map is split into lines of at least this many rows (or two if it
+    // is too low), the even ones are updated before the odd ones, the 
+    // results depend on it, but not on the workers, the pairs of lines 
+    // are handed out to the workers, so every one of them needs a pair 
+    // at least
+    unsigned lineHeight = 16; // NOLINT
+    // not empty - out-of-core, the map is kept in a scratch file in this 
+    // directory (MappedFileAllocStrategy) and a chronon is a wavefront 
+    // over the lines, with about 3 lines per worker in the memory at once,
+    // lineHeight sets how much of the map that is, TILE engine only
+    std::string scratchDir;
+    // the workers stay in a loop for the whole simulation and meet on a 
+    // HierarchicalBarrier instead of getting a task per line, not with
+    // scratchDir
+    bool persistentWorkers = false;
+    // a worker out of its own lines takes the lines of the same parity
+    // of the others, of its NUMA node first, the results do not change,
+    // not with scratchDir
+    bool workStealing = false;
+    // every this many chronons pairs of lines are handed from the slower
+    // workers to the faster ones next to them on the same NUMA node 
+    // (StripeRebalancer), 0 never, the results do not change, a pair 
+    // is the smallest step, so it needs several of them per worker,
+    // SimulationEngine::TILE only, not with scratchDir or workStealing
+    unsigned rebalancePeriod = 0;
+    // a pair is handed over only if the run times of the two workers 
+    // differ by more than this fraction
+    double rebalanceThreshold = 0.1; // NOLINT
+    // no barriers between the half iterations, a line is updated as soon 
+    // as its neighbours are in the previous half iteration (a counter of 
+    // the chronons done per line), so a slow worker holds up only its 
+    // neighbours, and with doIterations the workers far from it can get 
+    // chronons ahead, the results do not change, not with scratchDir, 
+    // persistentWorkers, workStealing or rebalancePeriod
+    bool dataflowSync = false;
+    // with dataflowSync, a worker updates its lines in blocks of this many
+    // chronons, in tiles skewed in time, so a line is updated several 
+    // times while it and its neighbours are in the cache, the lines which
+    // are not ready are passed over instead of waited for, 0 or 1 off, 
+    // needs more than one pair of lines per worker, a tile of a single pair
+    // is the whole stripe of a worker and nothing is reused
+    unsigned temporalBlock = 0;
+};
+
+// writes a line of the map first (MapLine::initialize), so its pages
+// are placed on the NUMA node of the Worker running it, then places
+// the share of the initial population of the line (Map::randomizeLine)
+class MapInitTask {
+private:
+    Map *m_map;
+    unsigned m_numaInd;
+    unsigned m_lineInd;
+    // of the whole map
+    std::size_t m_fishCnt;
+    std::size_t m_sharkCnt;
+    unsigned m_seed;
+
+public:
+    MapInitTask(Map &map, unsigned numaInd, unsigned lineInd, std::size_t fishCnt, std::size_t sharkCnt,
+                unsigned seed) 
+        : m_map(&map), m_numaInd(numaInd), m_lineInd(lineInd), m_fishCnt(fishCnt), m_sharkCnt(sharkCnt), 
+          m_seed(seed) {}
+
+    void operator() () {
+        m_map->getMapNuma(m_numaInd).getLine(m_lineInd).initialize();
+        m_map->randomizeLine(m_numaInd, m_lineInd, m_fishCnt, m_sharkCnt, m_seed);
+    }
+};
+
+class Simulation;
+
+// the loop of a persistent worker (SimulationOptions::persistentWorkers),
+// it returns when the Simulation is destroyed
+class SteppingTask {
+private:
+    Simulation *m_sim;
+    unsigned m_cpuInd;
+
+public:
+    SteppingTask(Simulation &sim, unsigned cpuInd) : m_sim(&sim), m_cpuInd(cpuInd) {}
+
+    void operator() ();
+};
+
+// the lines of a worker in a half iteration and the ones it steals
+// (SimulationOptions::workStealing)
+class StepTask {
+private:
+    Simulation *m_sim;
+    unsigned m_cpuInd;
+    bool m_odd;
+
+public:
+    StepTask(Simulation &sim, unsigned cpuInd, bool odd) : m_sim(&sim), m_cpuInd(cpuInd), m_odd(odd) {}
+
+    void operator() ();
+};
+
+// the lines of a worker in chrononCnt chronons from firstChronon, each
+// one after its neighbours (SimulationOptions::dataflowSync)
+class FlowTask {
+private:
+    Simulation *m_sim;
+    unsigned m_cpuInd;
+    std::uint64_t m_firstChronon;
+    unsigned m_chrononCnt;
+
+public:
+    FlowTask(Simulation &sim, unsigned cpuInd, std::uint64_t firstChronon, unsigned chrononCnt) 
+        : m_sim(&sim), m_cpuInd(cpuInd), m_firstChronon(firstChronon), m_chrononCnt(chrononCnt) {}
+
+    void operator() ();
+};
+
+namespace detail {
+    template<class Policies>
+    struct SimulationTaskVariant;
+
+    template<class... Policies>
+    struct SimulationTaskVariant<std::tuple<Policies...>> {
+        using type = std::variant<SimulationWorker, 
+                                  BasicSimulationWorker<RuntimeRulesPolicy, KernelIsa::AVX2>,
+                                  BasicSimulationWorker<RuntimeRulesPolicy, KernelIsa::AVX512>,
+                                  BasicSimulationWorker<Policies>..., 
+                                  BasicSimulationWorker<Policies, KernelIsa::AVX2>..., 
+                                  BasicSimulationWorker<Policies, KernelIsa::AVX512>..., 
+                                  SimulationBitboardWorker,
+                                  MapInitTask,
+                                  SteppingTask,
+                                  StepTask,
+                                  FlowTask>;
+    };
+}
+
+// a unit of work for Worker, one of the engines for one line, MapInitTask,
+// SteppingTask, StepTask or FlowTask
+class SimulationTask {
+private:
+    detail::SimulationTaskVariant<FixedRulesPolicies>::type m_work;
+
+public:
+    template<class T>
+    SimulationTask(T &&work) : m_work(std::forward<T>(work)) {} // NOLINT
+
+    void operator() () {
+        std::visit([](auto &work) { work(); }, m_work);
+    }
+};
     
 class Simulation {
 private:
     Rules m_rules;
     const ExecutionPlanner &m_exp;
+    SimulationOptions m_opts;
 
-    using WorkerType = Worker<SimulationWorker>;
+    using WorkerType = Worker<SimulationTask>;
     std::unique_ptr<std::unique_ptr<WorkerType>[]> m_workers; // NOLINT
 
+    // the allocation strategy of m_map if out-of-core (SimulationOptions::scratchDir)
+    MappedFileAllocStrategy *m_scratch{nullptr};
     Map m_map;
-    std::mt19937 m_rng;
+    // only with SimulationEngine::BITBOARD, the simulation state is kept here
+    // and m_map is updated from it lazily
+    std::optional<MapBitboard> m_bitboard;
+    mutable bool m_mapStale{false};
+    // m_map was (possibly) changed through getMap(), the entities have to
+    // be prepared for the next chronon
+    bool m_mapModified{false};
+
+    // the workers draw their random numbers keyed by it, the chronon and 
+    // the position, so the results do not depend on which worker updates 
+    // which line
+    unsigned m_seed;
     std::chrono::microseconds m_allTime = std::chrono::microseconds{0};
     std::vector<std::chrono::microseconds> m_waitingTime;
+    // Worker::getAllRunDuration after the last half iteration
+    std::vector<std::chrono::microseconds> m_prevRunTime;
+    // SimulationOptions::rebalancePeriod, the run time of every worker in 
+    // the even and the odd half iterations since the last rebalance
+    std::vector<std::array<std::chrono::microseconds, 2>> m_rebalanceTime;
+    std::uint64_t m_movedPairCnt{0};
     std::uint64_t m_halfIterCnt{0};
+    std::uint64_t m_iterCnt{0};
+
+    // where the worker of every CPU is and the pairs of lines it updates,
+    // [firstPair, endPair) on its NUMA node, pair p is lines 2*p and 2*p+1
+    struct WorkerPlace {
+        unsigned numaInd;
+        unsigned cpuInd;    // on the NUMA node
+        unsigned cpu;
+        unsigned firstPair;
+        unsigned endPair;
+    };
+    std::vector<WorkerPlace> m_workerPlace;
+
+    // SimulationOptions::persistentWorkers, a group of the barrier per 
+    // NUMA node, the workers meet on it before, between and after the 
+    // half iterations
+    std::unique_ptr<HierarchicalBarrier> m_barrier;
+    bool m_stopStepping{false};
+    // written only by its worker, the Worker itself runs a single task
+    struct alignas(64) StepStats { // NOLINT
+        std::chrono::microseconds runDuration{0};
+        std::uint64_t sumFreq{0}; // in kHz
+        // of the even and the odd half iteration
+        std::array<std::chrono::microseconds, 2> lastDuration{};
+        // SimulationOptions::dataflowSync, waiting for the neighbours in 
+        // the last doIterations
+        std::chrono::microseconds flowWait{0};
+    };
+    std::vector<StepStats> m_stepStats;
+
+    // SimulationOptions::workStealing, the pairs of lines of every worker
+    // not taken yet, {first, end} packed, an array per parity, the one of
+    // the other parity is refilled by its owner during a half iteration
+    struct alignas(64) PairRange { // NOLINT
+        std::atomic<std::uint64_t> range{0};
+    };
+    std::array<std::unique_ptr<PairRange[]>, 2> m_pairRanges; // NOLINT
+    // the workers to steal from, the ones on the same NUMA node first
+    std::vector<std::vector<unsigned>> m_victims;
+
+    // SimulationOptions::dataflowSync, the chronons done by every line in
+    // the order of getLineOrder, and the lines of every worker in it
+    struct alignas(64) LineEpoch { // NOLINT
+        std::atomic<std::uint64_t> done{0};
+    };
+    std::unique_ptr<LineEpoch[]> m_lineEpochs; // NOLINT
+    std::vector<std::vector<unsigned>> m_flowLines;
+
+    KernelIsa m_kernelIsa;
+    // creates the SimulationEngine::TILE task, chosen once for the rules
+    // and the instruction set
+    using TileTaskFactory = SimulationTask (*)(Map &map, unsigned numaInd, unsigned lineInd, 
+                                               const Rules &rules, unsigned seed, std::uint64_t chronon,
+                                               unsigned stripWidth);
+    TileTaskFactory m_makeTileTask;
 
     // member functions
-    void calcHalfIterStats();
+    // throws if the forced instruction set can not be used
+    [[nodiscard]] static KernelIsa selectKernelIsa(const SimulationOptions &opts);
+
+    [[nodiscard]] static TileTaskFactory selectTileTaskFactory(const Rules &rules, 
+                                                               const SimulationOptions &opts,
+                                                               KernelIsa isa);
+
+    // the map in a scratch file if out-of-core, otherwise NUMA local
+    [[nodiscard]] static std::unique_ptr<MapAllocStrategy> makeAllocStrategy(const SimulationOptions &opts,
+                                                                           MappedFileAllocStrategy *&scratch);
+
+    // every worker initializes and randomizes its own lines in parallel
+    void initMap(unsigned seed);
+
+    // runs the pushed tasks, worker 0 on this thread
+    void runWorkers();
+
+    void calcHalfIterStats(bool odd);
+
+    // lastDuration - the run time of every worker in the half iteration
+    void addHalfIterStats(const std::vector<std::chrono::microseconds> &lastDuration, bool odd);
+
+    // the pairs of lines of the map, SimulationOptions::lineHeight
+    [[nodiscard]] static unsigned calcLinePairs(const Rules &rules, const SimulationOptions &opts);
+
+    // hands the pairs of lines between the workers by StripeRebalancer
+    void rebalance();
 
     void doHalfIteration(bool odd);
 
+    using LineList = std::vector<std::pair<unsigned, unsigned>>;
+    // {numaInd, lineInd} of every line from the top of the map
+    [[nodiscard]] LineList getLineOrder() const;
+
+    // MappedFileResource::prefetch or writeBack of lines [beg, end) of order
+    void prefetchLines(const LineList &order, std::size_t beg, std::size_t end);
+    void writeBackLines(const LineList &order, std::size_t beg, std::size_t end);
+
+    // out-of-core chronon, the same result as the two half iterations
+    void doWavefrontIteration();
+
+    // SimulationOptions::persistentWorkers
+    friend class SteppingTask;
+    void startStepping();
+    void runSteps(unsigned cpuInd);
+    // the lines of worker cpuInd in a half iteration
+    void doStep(unsigned cpuInd, bool odd);
+    // the first worker runs on this thread
+    void doSteppedIteration();
+
+    // SimulationOptions::workStealing
+    friend class StepTask;
+    void initStealing();
+    void refillPairs(unsigned cpuInd, unsigned uodd);
+    // the owner takes from the front, the thieves from the back
+    [[nodiscard]] bool takePair(unsigned cpuInd, unsigned uodd, bool front, unsigned &pair);
+
+    // SimulationOptions::dataflowSync
+    friend class FlowTask;
+    void initFlow();
+    void runFlow(unsigned cpuInd, std::uint64_t firstChronon, unsigned chrononCnt);
+    // SimulationOptions::temporalBlock, the chronons [firstChronon, endChronon)
+    void runFlowBlock(unsigned cpuInd, std::uint64_t firstChronon, std::uint64_t endChronon,
+                      const LineList &order);
+    // returns the time waited until line k of getLineOrder has done chronons
+    [[nodiscard]] std::chrono::microseconds waitForLine(std::size_t k, std::uint64_t chronons) const;
+    // returns the time waited until line prev or next of getLineOrder is 
+    // past the chronons seen
+    [[nodiscard]] std::chrono::microseconds waitForNeighbours(std::size_t prev, std::uint64_t prevSeen, 
+                                                              std::size_t next, std::uint64_t nextSeen) const;
+    void doFlowIterations(unsigned cnt);
+
+    [[nodiscard]] SimulationTask makeTask(unsigned numaInd, unsigned lineInd) {
+        return makeTask(numaInd, lineInd, m_iterCnt);
+    }
+    [[nodiscard]] SimulationTask makeTask(unsigned numaInd, unsigned lineInd, std::uint64_t chronon);
+
+    // prepares the map changed through getMap() for the next chronon
+    void prepareModifiedMap();
+
+    void syncMap() const;
+
 public:
     
-    Simulation(const Rules &rules, const ExecutionPlanner &exp, unsigned seed);
+    Simulation(const Rules &rules, const ExecutionPlanner &exp, unsigned seed,
+               const SimulationOptions &opts = {});
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+    // stops the persistent workers
+    ~Simulation();
 
-    [[nodiscard]] const Map& getMap() const noexcept { return m_map; }
-    [[nodiscard]] Map& getMap() noexcept { return m_map; }
+    [[nodiscard]] const Map& getMap() const { 
+        syncMap();
+        return m_map; 
+    }
+
+    // NOTE: the changes made through the returned reference are prepared 
+    // (entity parities set, bitboard reloaded) before the next iteration, 
+    // prefer the const overload when only reading
+    [[nodiscard]] Map& getMap() { 
+        syncMap();
+        m_mapModified = true;
+        return m_map; 
+    }
 
     void doIteration();
 
+    // cnt times doIteration, with SimulationOptions::dataflowSync the 
+    // workers meet only after the last one
+    void doIterations(unsigned cnt);
+
+    // the lines of the map, the queues and the stacks of the workers, each
+    // on the NUMA node of its worker, the stack of the first worker is the
+    // one of this thread, so it is to be called on the thread calling 
+    // doIteration, the map is left out if out-of-core
+    [[nodiscard]] NumaAudit makeNumaAudit() const;
+
+    // the instruction set of the SimulationEngine::TILE kernel
+    [[nodiscard]] KernelIsa getKernelIsa() const noexcept { return m_kernelIsa; }
+
     [[nodiscard]] std::vector<std::uint64_t> getAvgFreqPerWorker() const;
 
     [[nodiscard]] std::uint64_t getAvgFreq() const;
 
+    // handed to other workers by the rebalancing (SimulationOptions::rebalancePeriod)
+    [[nodiscard]] std::uint64_t getMovedPairCnt() const noexcept { return m_movedPairCnt; }
+
     [[nodiscard]] std::chrono::microseconds getAllRunTime() const {
         return m_allTime;
     }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "map_bitboard.hpp"
+#include "rules.hpp"
+#include "../src/philox_engine.hpp" // TODO: this
+
+namespace WaTor {
+
+// Alternative to SimulationWorker, works on a MapBitboard and decides
+// 64 cells at a time with word operations.
+// Rows of a line are processed top to bottom like in SimulationWorker,
+// but all entities of a row move at once (first sharks, then fish),
+// so the results are not the same as the ones of SimulationWorker
+class SimulationBitboardWorker {
+private:
+    using Word = MapLineBitboard::Word;
+
+    using RandomEngine = philox4x32_engine<>;
+
+    MapBitboard &m_map;
+    Rules m_rules;
+    // keyed by the seed, the counter is (word, row in the map, chronon)
+    RandomEngine m_rng;
+    unsigned m_numaInd, m_lineInd;
+    std::uint64_t m_chronon;
+    Word m_parity; // all bits set on odd chronons
+    unsigned m_firstRow;
+
+    // per row temporary masks, every one is getWordsPerRow() words long
+    struct RowScratch {
+        Word *act;
+        std::array<Word*, 4> fishDir;
+        std::array<Word*, 4> waterDir;
+        std::array<Word*, 4> moveDir;
+        std::array<Word*, 3> rnd;
+        Word *starve;
+        Word *clearSrc;
+        Word *targetRight, *targetLeft;
+        Word *tmp1, *tmp2;
+
+        static constexpr unsigned BUFFER_CNT = 22;
+    };
+
+    // the random words of word wordInd of row posy of the line
+    void randomWords(unsigned posy, unsigned wordInd, std::array<Word, 3> &res) const;
+
+    template<bool isShark>
+    void stepRow(MapLineBitboard &line, Word *up, Word *cur, Word *down,
+                 const RowScratch &scr);
+
+public:
+    // chronon - the index of the current chronon, its parity is the one
+    // of the entities updated
+    SimulationBitboardWorker(MapBitboard &map, unsigned numaInd, unsigned lineInd,
+                             const Rules &rules, unsigned seed, std::uint64_t chronon);
+
+    void operator() ();
+};
+
+}
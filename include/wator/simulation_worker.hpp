@@ -1,59 +1,118 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "kernel_isa.hpp"
 #include "map.hpp"
 #include "rules.hpp"
-#include "../src/lfsr_engine.hpp" // TODO: this
+#include "rules_policy.hpp"
+#include "../src/philox_engine.hpp" // TODO: this
 
 namespace WaTor {
 
-class SimulationWorker {
+// RulesPolicy - where the breed and starve times are read from,
+// RuntimeRulesPolicy or one of FixedRulesPolicies
+// isa - the instruction set the kernel is compiled for, the CPU has to
+// support it (isKernelIsaSupported)
+template<class RulesPolicy, KernelIsa isa = KernelIsa::GENERIC>
+class BasicSimulationWorker {
 
 private:
-    
-    static constexpr unsigned LFSR_MASK = 0xDEADBEEF;
+
+    using RandomEngine = philox4x32_engine<>;
+    // the random nibbles of RND_BLOCK_WIDTH consecutive tiles of a row
+    // are one block of RandomEngine
+    static constexpr unsigned RND_BLOCK_WIDTH = 32;
 
     Map &m_map;
-    Rules m_rules;
-    linear_feedback_shift_register_engine<std::uint32_t, LFSR_MASK> m_rng;
+    RulesPolicy m_rules;
+    // keyed by the seed, the counter is (block, row in the map, chronon),
+    // so the draws do not depend on how the map is split between workers
+    RandomEngine m_rng;
     unsigned m_numaInd, m_lineInd;
+    std::uint64_t m_chronon;
+    // parity of the current chronon, only entities with this parity are updated
+    bool m_parity;
+    // the line has MapLineStorage::SPLIT, the entity plane is kept up to date
+    bool m_entityPlane;
+    unsigned m_firstRow;
+    // blocks of a strip of the column blocked sweep
+    unsigned m_stripBlocks;
+    // the last generated block, m_rndPosy is ~0U before the first one
+    unsigned m_rndPosy{~0U}, m_rndBlock{0};
+    RandomEngine::counter_type m_rndBits{};
+
+    MapLine &m_line, &m_prevLine, &m_nextLine;
+
+    // horLevel: same as markOccupied
+    // the neighbour of cur, the tile (posy, posx), in direction dir
+    // 0 - up, 1 - right, 2 - down, 3 - left, the halo rows are the 
+    // neighbours of the edge rows
+    template<unsigned horLevel>
+    [[nodiscard]] Tile& getNeighbour(Tile *cur, unsigned posy, unsigned posx, unsigned dir);
 
-    [[nodiscard]] unsigned findTileFish(const std::array<Map::Cordinate, 4> &dirs, 
-                              unsigned rnd) const;
+    // horLevel: same as markOccupied
+    // bit d of water/fish is set if the neighbour in direction d is water/fish
+    template<unsigned horLevel>
+    void getNeighbourMasks(Tile *cur, unsigned posy, unsigned posx,
+                           unsigned &water, unsigned &fish);
 
-    [[nodiscard]] unsigned findTileShark(const std::array<Map::Cordinate, 4> &dirs, 
-                              unsigned rnd, bool& ate) const;
+    // the random nibble of the entity at (posy, posx) in this chronon
+    [[nodiscard]] unsigned randomNibble(unsigned posy, unsigned posx);
+
+    // neighbourhood - the water mask of the neighbours | their fish mask << 4,
+    // rnd - random nibble, both are looked up in a precomputed table
+    [[nodiscard]] static unsigned findTileFish(unsigned neighbourhood, unsigned rnd);
+
+    [[nodiscard]] static unsigned findTileShark(unsigned neighbourhood, unsigned rnd, bool& ate);
 
     //0 - x=0
     //1 - mid
-    //2 - x=height-1
-    template<bool isBotLvl, unsigned horLevel, bool isShark>
-    unsigned tickEntity( const Map::Cordinate &cur, 
-            const std::array<Map::Cordinate, 4> &dirs);
+    //2 - x=width-1
+    // marks the block of the neighbour of (posy, posx) in direction dir
+    // as occupied
+    template<unsigned horLevel>
+    void markOccupied(unsigned posy, unsigned posx, unsigned dir);
 
-    struct PosCache {
-        Map::Cordinate pos;
-        std::array<Map::Cordinate, 4> dirs;
-        union Tbmcache {
-            // top and bot are (like) plain old data, union is not problem (probably)
-            MapLine::TopMaskIter top;
-            MapLine::BottomMaskIter bot;
+    // horLevel: same as markOccupied
+    // sets the entity of the neighbour of (posy, posx) in direction dir,
+    // or of (posy, posx) itself if dir is 4, in the entity plane
+    template<unsigned horLevel>
+    void setPlaneEntity(unsigned posy, unsigned posx, unsigned dir, Entity ent);
 
-            Tbmcache() {} // NOLINT
-        } curCache, neigCache;
-    };
+    template<unsigned horLevel, bool isShark>
+    void tickEntity(Tile *cur, unsigned posy, unsigned posx,
+                    unsigned waterMask, unsigned fishMask);
 
-    template<unsigned vertLevel, unsigned horLevel>
-    void updatePosCache(unsigned posy, unsigned posx, PosCache &cache);
+    // horLevel: same as tickEntity
+    template<unsigned horLevel>
+    void updateEntity(Tile *cur, unsigned posy, unsigned posx);
 
-    template<unsigned vertLevel, unsigned horLevel>
-    void updateEntity(unsigned posy, unsigned posx, PosCache &cache);
+    // same as updateEntity<1> for every posx in [1, width-1) of the blocks
+    // [stripBeg, stripEnd), but the neighbours are classified from whole 
+    // blocks of the rows above, below and the current one, blocks which 
+    // are not occupied are skipped
+    void updateRowInterior(unsigned posy, unsigned stripBeg, unsigned stripEnd);
 
 public:
-    SimulationWorker(Map &map, unsigned numaInd, unsigned lineInd, 
-                     const Rules &rules, unsigned seed);
+    // chronon - the index of the current chronon, its parity is the one
+    // of the entities updated
+    // stripWidth - the line is swept in strips of at least stripWidth 
+    // columns (whole blocks), a strip goes through every row before the 
+    // next one, so only its part of the rows is live in the cache,
+    // 0 sweeps whole rows, the order of the updates and so the results 
+    // depend on it
+    BasicSimulationWorker(Map &map, unsigned numaInd, unsigned lineInd,
+                          const Rules &rules, unsigned seed, std::uint64_t chronon,
+                          unsigned stripWidth = 0);
 
     void operator() ();
 
 };
- 
+
+// works with any rules
+using SimulationWorker = BasicSimulationWorker<RuntimeRulesPolicy>;
+
 }
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+namespace WaTor {
+
+// plans moving the boundaries between the lines of the map toward the
+// lines of the workers which were faster: every line belongs to a group
+// (a worker in a half iteration), the rows of a group are assumed to cost
+// the same, and a boundary between the lines of two groups is moved so 
+// that half of their difference in run time would go, split between all
+// the boundaries of a group, it is moved only if the run times differ by
+// more than the threshold, so the boundaries do not oscillate
+class StripeRebalancer {
+public:
+    struct Line {
+        unsigned height;
+        // the height it can grow to
+        unsigned maxHeight;
+        unsigned group;
+    };
+
+private:
+    double m_threshold;
+    unsigned m_minHeight;
+    unsigned m_boundariesPerGroup;
+
+public:
+    // threshold - the fraction of the longer run time the run times of 
+    // two groups have to differ by, minHeight - no line gets lower, 
+    // boundariesPerGroup - the boundaries a group is moved by
+    StripeRebalancer(double threshold, unsigned minHeight, unsigned boundariesPerGroup)
+        : m_threshold(threshold), m_minHeight(minHeight), m_boundariesPerGroup(boundariesPerGroup) {}
+
+    // lines - from the top of the map, groupTime - the run time of every 
+    // group, returns the shift of the boundary bellow every line but the 
+    // last one, in the order they are to be applied, > 0 moves the rows of 
+    // the line bellow into the line (MapLine::moveRows)
+    [[nodiscard]] std::vector<int> plan(const std::vector<Line> &lines, 
+                                        const std::vector<double> &groupTime) const;
+};
+
+}
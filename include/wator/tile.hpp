@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <cassert>
+#include <cstring>
 
 #include "entity.hpp"
 
@@ -9,29 +10,38 @@ namespace WaTor {
 
     class Tile {
     private:
-        std::uint8_t m_lastAte:4,  m_age:4;
+        // m_parity - parity of the next chronon in which the entity is updated,
+        // an entity that already moved in the current chronon has the other one
+        std::uint8_t m_lastAte:3,  m_age:4, m_parity:1;
 
-        static constexpr unsigned LAST_ATE_BITS = 4, AGE_BITS = 4;
-        static constexpr unsigned LAST_ATE_MASK = 0xFU, AGE_MASK = 0xFU;
+        static constexpr unsigned LAST_ATE_BITS = 3, AGE_BITS = 4;
+        static constexpr unsigned LAST_ATE_MASK = 0x7U, AGE_MASK = 0xFU;
 
     public:
 
         static constexpr unsigned MAX_AGE = 14;
-        static constexpr unsigned MAX_LAST_ATE = 14;
+        static constexpr unsigned MAX_LAST_ATE = 6;
 
+        // raw byte view of the tile, used for vectorised classification:
+        // water is 0, fish has the lastAte bits (RAW_LAST_ATE_MASK) cleared
+        static constexpr std::uint8_t RAW_LAST_ATE_MASK = 0x07U;
+        static constexpr std::uint8_t RAW_PARITY_MASK = 0x80U;
+
+        // also clears the parity
         void set(Entity ent, unsigned age, unsigned lastAte) {
             assert(age <= MAX_AGE && lastAte <= MAX_LAST_ATE);
+            m_parity = 0;
             switch (ent) {
                 case Entity::WATER:
                     assert(age == 0 && lastAte == 0);
                     m_lastAte = 0; m_age = 0;
                     break;
                 case Entity::FISH:
-                    assert(lastAte == 0 && age <= 14);
+                    assert(lastAte == 0 && age <= MAX_AGE);
                     m_lastAte = 0; m_age = (age+1) & AGE_MASK;
                     break;
                 case Entity::SHARK:
-                    assert(lastAte <= 14 && age <= 14);
+                    assert(lastAte <= MAX_LAST_ATE && age <= MAX_AGE);
                     m_lastAte = (lastAte+1) & LAST_ATE_MASK; 
                     m_age = (age+1) & AGE_MASK;
                     break;
@@ -55,14 +65,29 @@ namespace WaTor {
         [[nodiscard]] unsigned getLastAte() const { assert(m_lastAte>0); return m_lastAte-1; }
 
         void setAge(unsigned age) {
-            assert(m_age>0 && age <= 14); 
+            assert(m_age>0 && age <= MAX_AGE); 
             m_age = (age+1) & AGE_MASK;
         }
         void setLastAte(unsigned lastAte) { 
-            assert(m_lastAte>0 && lastAte <= 14); 
+            assert(m_lastAte>0 && lastAte <= MAX_LAST_ATE); 
             m_lastAte = (lastAte+1) & LAST_ATE_MASK; 
         }
 
+        [[nodiscard]] bool getParity() const { return m_parity != 0; }
+
+        // water has always parity 0
+        void setParity(bool parity) {
+            assert(m_age>0);
+            m_parity = parity ? 1 : 0;
+        }
+
+        [[nodiscard]] std::uint8_t getRaw() const noexcept {
+            std::uint8_t res; // NOLINT
+            std::memcpy(&res, this, sizeof(res));
+            return res;
+        }
+
+        // compares only the entity, not the parity
         bool operator==(const Tile& rhs) const {
             return (m_age == rhs.m_age) && (m_lastAte == rhs.m_lastAte);
         }
@@ -15,6 +15,12 @@
 #include <string>
 #include <filesystem>
 #include <queue>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
 
 #include "numa_allocator.hpp"
 #include "utils.hpp"
@@ -25,10 +31,13 @@ template<class T>
 class Worker {
 private:
     std::optional<NumaAllocator> m_numaAlloc;
+    // the queue takes chunks of m_numaAlloc, not a NUMA allocation per node
+    std::optional<std::pmr::unsynchronized_pool_resource> m_queuePool;
     std::queue<T, std::pmr::deque<T>> m_workQueue;
     mutable std::mutex m_lock;
     mutable std::condition_variable m_taskEnqueued, m_queueEmpty;
-    std::optional<std::thread> m_thread;
+    std::optional<pthread_t> m_thread;
+    Utils::ThreadStack m_stack;
     std::chrono::microseconds m_runDuration = std::chrono::microseconds{0};
     std::chrono::microseconds m_lastDuration = std::chrono::microseconds{0};
     std::uint64_t m_sumFreq = 0; // in kHz
@@ -44,18 +53,26 @@ private:
         m_sumFreq += m_lastFreq*m_lastDuration.count();
     }
 
-    void setCpuMask() noexcept {
+    // the thread starts pinned and with its stack on m_numaNode, so 
+    // neither the thread nor its stack have to be migrated
+    void setThreadAttr(pthread_attr_t &attr) {
+        int ret = 0;
         if(m_doCpuPin) {
             cpu_set_t cpuMask;
             CPU_ZERO(&cpuMask);
             CPU_SET(m_cpuNum, &cpuMask); // NOLINT
-            int ret = sched_setaffinity(0, sizeof(cpuMask), &cpuMask);
+            ret = pthread_attr_setaffinity_np(&attr, sizeof(cpuMask), &cpuMask);
             assert(ret == 0); // TODO: yea, this is bad, only for debug
+        }
 
-            if(m_numaNode != std::numeric_limits<unsigned>::max()) {
-                Utils::mapThisThreadStackToNuma(m_numaNode);
+        if(m_numaNode != std::numeric_limits<unsigned>::max()) {
+            m_stack = Utils::allocThreadStack(Utils::getDefaultThreadStackSize(), m_numaNode);
+            if(m_stack.ptr != nullptr) {
+                ret = pthread_attr_setstack(&attr, m_stack.ptr, m_stack.size);
+                assert(ret == 0);
             }
         }
+        static_cast<void>(ret);
     }
 
     // expects m_lock to be locked
@@ -89,8 +106,6 @@ private:
     void workFn() noexcept {
         std::unique_lock<std::mutex> ulk(m_lock);
 
-        setCpuMask();
-
         while(!m_workQueue.empty() || !m_timeToDie) {
             while(m_workQueue.empty() && !m_timeToDie) {
                 m_taskEnqueued.wait(ulk);
@@ -105,15 +120,17 @@ private:
         }
     }
     
-    static void workerCall(Worker<T> *work) noexcept {
-        work->workFn();
+    static void* workerCall(void *work) noexcept {
+        static_cast<Worker<T>*>(work)->workFn();
+        return nullptr;
     }
 
 public:
 
     Worker() : m_workQueue(std::pmr::get_default_resource()) {}
     explicit Worker(unsigned numaNode) 
-        : m_numaAlloc(numaNode), m_workQueue(&(m_numaAlloc.value())), m_numaNode(numaNode) {}
+        : m_numaAlloc(numaNode), m_queuePool(std::in_place, &(m_numaAlloc.value())), 
+          m_workQueue(&(m_queuePool.value())), m_numaNode(numaNode) {}
 
     Worker(const Worker&) = delete;
     Worker& operator=(const Worker&) = delete;
@@ -127,15 +144,14 @@ public:
             return; 
         }
 
-        std::thread &thd = m_thread.value();
-
-        assert(thd.joinable());
-
         m_timeToDie = true;
         m_taskEnqueued.notify_one();
         ulk.unlock();
 
-        thd.join();
+        int ret = pthread_join(m_thread.value(), nullptr);
+        assert(ret == 0);
+        static_cast<void>(ret);
+        Utils::freeThreadStack(m_stack);
     }
 
     void startThread(unsigned cpuNum, bool doCpuPin = false) {
@@ -145,7 +161,27 @@ public:
         m_cpuNum = cpuNum;
         m_doCpuPin = doCpuPin;
 
-        m_thread = std::thread(workerCall, this);
+        pthread_attr_t attr;
+        int ret = pthread_attr_init(&attr);
+        if(ret != 0) {
+            throw std::system_error(ret, std::system_category(), "pthread_attr_init");
+        }
+
+        pthread_t thd;
+        try {
+            setThreadAttr(attr);
+            ret = pthread_create(&thd, &attr, workerCall, this);
+        } catch(...) {
+            pthread_attr_destroy(&attr);
+            throw;
+        }
+        pthread_attr_destroy(&attr);
+        if(ret != 0) {
+            Utils::freeThreadStack(m_stack);
+            m_stack = {};
+            throw std::system_error(ret, std::system_category(), "pthread_create");
+        }
+        m_thread = thd;
     }
 
     void runOnThisThread(unsigned cpuNum) { // TODO: cpuPin
@@ -201,6 +237,30 @@ public:
         return m_lastFreq;
     }
 
+    // the NUMA node it allocates on, or max unsigned
+    [[nodiscard]] unsigned getNumaNode() const noexcept { return m_numaNode; }
+
+    // the chunks of the queue, on the NUMA node of the Worker
+    [[nodiscard]] std::vector<std::pair<const void*, std::size_t>> getQueueMemory() const {
+        std::unique_lock<std::mutex> ulk(m_lock);
+        std::vector<std::pair<const void*, std::size_t>> res;
+        if(m_numaAlloc.has_value()) {
+            res.assign(m_numaAlloc->getAllocations().begin(), m_numaAlloc->getAllocations().end());
+        }
+        return res;
+    }
+
+    // the stack of the thread, without the guard page, if the Worker 
+    // allocated it (see startThread), otherwise {nullptr, 0}
+    [[nodiscard]] std::pair<const void*, std::size_t> getStackMemory() const {
+        std::unique_lock<std::mutex> ulk(m_lock);
+        if(m_stack.ptr == nullptr) {
+            return {nullptr, 0};
+        }
+        const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        return {static_cast<const char*>(m_stack.ptr) + pageSize, m_stack.size - pageSize}; // NOLINT
+    }
+
     void clearStats() {
         std::unique_lock<std::mutex> ulk(m_lock);
         m_runDuration = std::chrono::microseconds{0};
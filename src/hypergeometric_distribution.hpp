@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+// the number of marked items among draws items taken without replacement
+// from total items, marked of them marked; sampled by the inversion of
+// the distribution function, so the result depends only on the uniform
+// number and not on the generator or the standard library
+class hypergeometric_distribution
+{
+public:
+    using result_type = std::uint64_t;
+
+private:
+    // the weights below this fraction of their sum are not visited
+    static constexpr double negligible = 0x1p-60;
+
+    result_type total;
+    result_type marked;
+    result_type draws;
+
+    // weight(k+1)/weight(k)
+    [[nodiscard]] double ratio_up(result_type k) const
+    {
+        return (static_cast<double>(marked - k)*static_cast<double>(draws - k)) /
+               (static_cast<double>(k + 1)*static_cast<double>(total - marked - draws + k + 1));
+    }
+
+    // weight(k-1)/weight(k)
+    [[nodiscard]] double ratio_down(result_type k) const
+    {
+        return (static_cast<double>(k)*static_cast<double>(total - marked - draws + k)) /
+               (static_cast<double>(marked - k + 1)*static_cast<double>(draws - k + 1));
+    }
+
+public:
+    hypergeometric_distribution(result_type total_cnt, result_type marked_cnt, result_type draws_cnt)
+        : total(total_cnt), marked(marked_cnt), draws(draws_cnt)
+    {
+        assert(marked <= total && draws <= total);
+    }
+
+    [[nodiscard]] result_type min() const
+    {
+        return (draws + marked > total) ? draws + marked - total : 0;
+    }
+
+    [[nodiscard]] result_type max() const
+    {
+        return std::min(draws, marked);
+    }
+
+    // u - uniform in [0, 1)
+    [[nodiscard]] result_type operator()(double u) const
+    {
+        const result_type lo = min();
+        const result_type hi = max();
+        if(lo == hi) {
+            return lo;
+        }
+
+        // the weights relative to the mode, it is only approximated since
+        // (draws+1)*(marked+1) does not fit, but the ratios stay near 1
+        const double approx_mode = (static_cast<double>(draws) + 1)*(static_cast<double>(marked) + 1) /
+                                   (static_cast<double>(total) + 2);
+        const result_type mode = std::clamp(static_cast<result_type>(approx_mode), lo, hi);
+
+        double sum = 1;
+        double weight = 1;
+        result_type k = mode;
+        while(k < hi) {
+            weight *= ratio_up(k);
+            ++k;
+            sum += weight;
+            if(weight < negligible*sum) {
+                break;
+            }
+        }
+        const result_type last = k;
+
+        double first_weight = 1;
+        k = mode;
+        while(k > lo) {
+            first_weight *= ratio_down(k);
+            --k;
+            sum += first_weight;
+            if(first_weight < negligible*sum) {
+                break;
+            }
+        }
+
+        const double target = u*sum;
+        double acc = 0;
+        weight = first_weight;
+        for(; k < last; ++k) {
+            acc += weight;
+            if(acc > target) {
+                return k;
+            }
+            weight *= ratio_up(k);
+        }
+        return last;
+    }
+};
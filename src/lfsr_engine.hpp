@@ -1,10 +1,15 @@
 #pragma once
 
+#include <array>
 #include <limits>
 #include <type_traits>
 #include <climits>
 #include <cassert>
 
+// the tile kernel does not draw from it any more, its moves come from
+// philox4x32_engine keyed by the cell, which a sequential stream per
+// worker can not reproduce whatever the partition, the byte jump table
+// of shift_reg is what is left of the word parallel generation
 template<class UIntType, UIntType m>
 class linear_feedback_shift_register_engine
 {
@@ -16,10 +21,59 @@ public:
     static constexpr UIntType mask = m;
     static constexpr UIntType default_seed = 1;
 
+    static constexpr unsigned word_bits = sizeof(UIntType)*CHAR_BIT;
+
 
 private:
+    static constexpr unsigned table_cnt = sizeof(UIntType);
+    static constexpr unsigned table_size = 1U << CHAR_BIT;
+    using jump_table_type = std::array<std::array<UIntType, table_size>, table_cnt>;
+
     UIntType cur_val;
 
+    static constexpr UIntType shift_reg_constexpr(UIntType val, unsigned shift_cnt)
+    {
+        for(unsigned i=0; i<shift_cnt; i++) {
+            UIntType new_bit = 0;
+            for(UIntType taps = val & mask; taps != 0; taps >>= 1) {
+                new_bit ^= taps & 1U;
+            }
+            val = static_cast<UIntType>((val >> 1) | (new_bit << (word_bits-1)));
+        }
+        return val;
+    }
+
+    // shifting by word_bits is linear over GF(2), so it is the xor of the
+    // shifted images of the bytes of the register:
+    // table[j][v] = shift_reg(v << 8*j, word_bits)
+    static constexpr jump_table_type make_jump_table()
+    {
+        jump_table_type res{};
+        for(unsigned j=0; j<table_cnt; j++) {
+            for(unsigned v=1; v<table_size; v++) {
+                unsigned low_bit = 0;
+                while(((v >> low_bit) & 1U) == 0) {
+                    low_bit++;
+                }
+                const auto basis = static_cast<UIntType>(UIntType{1} << (j*CHAR_BIT + low_bit));
+                res[j][v] = static_cast<UIntType>(res[j][v & (v-1)] ^ shift_reg_constexpr(basis, word_bits));
+            }
+        }
+        return res;
+    }
+
+    static constexpr jump_table_type jump_table = make_jump_table();
+
+    // same as shift_reg(word_bits), but with table_cnt lookups
+    static UIntType jump_word(UIntType val)
+    {
+        UIntType res = 0;
+        for(unsigned j=0; j<table_cnt; j++) {
+            res ^= jump_table[j][(val >> (j*CHAR_BIT)) & (table_size-1)];
+        }
+        return res;
+    }
+
     static unsigned popcount(unsigned long long val)
     {
         return static_cast<unsigned>(__builtin_popcountll(val));
@@ -43,6 +97,10 @@ private:
 
 
     void shift_reg(unsigned shift_cnt = sizeof(UIntType)*CHAR_BIT) {
+        if(shift_cnt == word_bits) {
+            cur_val = jump_word(cur_val);
+            return;
+        }
         for(unsigned i=0; i<shift_cnt; i++) {
             UIntType new_bit = popcount(cur_val & mask) & 1U;
             cur_val = (cur_val >> 1) | (new_bit << (sizeof(UIntType)*CHAR_BIT-1));
@@ -90,4 +148,3 @@ public:
 
 
 };
-
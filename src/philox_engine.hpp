@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Philox4x32 counter based generator (Salmon et al., "Parallel Random
+// Numbers: As Easy as 1, 2, 3"), the output is a bijection of the counter
+// for every key, so any block of the stream is generated independently of
+// the others
+template<unsigned rounds = 10>
+class philox4x32_engine
+{
+public:
+    using result_type = std::uint32_t;
+    using key_type = std::array<std::uint32_t, 2>;
+    using counter_type = std::array<std::uint32_t, 4>;
+
+private:
+    static constexpr std::uint32_t mul0 = 0xD2511F53;
+    static constexpr std::uint32_t mul1 = 0xCD9E8D57;
+    static constexpr std::uint32_t weyl0 = 0x9E3779B9;
+    static constexpr std::uint32_t weyl1 = 0xBB67AE85;
+
+    key_type key;
+
+    static void mulhilo(std::uint32_t a, std::uint32_t b, std::uint32_t &hi, std::uint32_t &lo)
+    {
+        const std::uint64_t prod = static_cast<std::uint64_t>(a)*b;
+        hi = static_cast<std::uint32_t>(prod >> 32U);
+        lo = static_cast<std::uint32_t>(prod);
+    }
+
+public:
+    explicit philox4x32_engine(key_type k = {0, 0}) : key(k) {}
+
+    void seed(key_type k) {
+        key = k;
+    }
+
+    // the 128 bits of block ctr
+    [[nodiscard]] counter_type operator()(counter_type ctr) const
+    {
+        key_type k = key;
+        for(unsigned i=0; i<rounds; i++) {
+            std::uint32_t hi0, lo0, hi1, lo1; // NOLINT
+            mulhilo(mul0, ctr[0], hi0, lo0);
+            mulhilo(mul1, ctr[2], hi1, lo1);
+            ctr = {hi1 ^ ctr[1] ^ k[0], lo1, hi0 ^ ctr[3] ^ k[1], lo0};
+            k[0] += weyl0;
+            k[1] += weyl1;
+        }
+        return ctr;
+    }
+};
@@ -36,3 +36,19 @@ TEST_CASE("16 bit with 2 bit output")
     for(unsigned expt : output)
         CHECK(sr.get_bits(2) == expt);
 }
+
+TEST_CASE("16 bit with word output")
+{
+    constexpr std::uint16_t mask = 0x4A20;
+    constexpr std::uint16_t seed = 0xD35E;
+    linear_feedback_shift_register_engine<std::uint16_t, mask> sr(seed);
+    linear_feedback_shift_register_engine<std::uint16_t, mask> serial(seed);
+
+    // a whole word is shifted with the jump table
+    for(unsigned i=0; i<64; i++) {
+        const std::uint16_t res = sr.operator()<std::uint16_t>();
+        serial.get_bits(8);
+        CHECK(res == static_cast<std::uint16_t>(serial.get_bits(8) | (serial.operator()<std::uint8_t>() << 8)));
+        serial.seed(res);
+    }
+}
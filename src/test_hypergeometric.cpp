@@ -0,0 +1,66 @@
+#include <catch2/catch.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "hypergeometric_distribution.hpp"
+
+namespace {
+    double binomial(unsigned n, unsigned k) {
+        double res = 1;
+        for(unsigned i=1; i<=k; ++i) {
+            res = res*(n - k + i)/i;
+        }
+        return res;
+    }
+}
+
+TEST_CASE("hypergeometric_distribution bounds")
+{
+    CHECK(hypergeometric_distribution(10, 0, 5)(0.5) == 0);
+    CHECK(hypergeometric_distribution(10, 10, 5)(0.5) == 5);
+    CHECK(hypergeometric_distribution(10, 7, 10)(0.3) == 7);
+    CHECK(hypergeometric_distribution(10, 7, 0)(0.3) == 0);
+
+    const hypergeometric_distribution dist(100, 80, 50); // NOLINT
+    CHECK(dist.min() == 30);
+    CHECK(dist.max() == 50);
+    CHECK(dist(0.0) >= 30);
+    CHECK(dist(0.999999) <= 50);
+}
+
+TEST_CASE("hypergeometric_distribution inverts the distribution function")
+{
+    const unsigned total = 60;
+    const unsigned marked = 25;
+    const unsigned draws = 20;
+    const hypergeometric_distribution dist(total, marked, draws);
+
+    // the fraction of [0, 1) mapped to every result is its probability
+    const unsigned steps = 100000;
+    std::vector<unsigned> hits(draws + 1, 0);
+    std::uint64_t prev = 0;
+    for(unsigned i=0; i<steps; ++i) {
+        const std::uint64_t res = dist((i + 0.5)/steps);
+        CHECK(res >= prev);
+        prev = res;
+        ++hits[res];
+    }
+    for(unsigned k=0; k<=draws; ++k) {
+        const double prob = binomial(marked, k)*binomial(total - marked, draws - k)/binomial(total, draws);
+        CHECK(static_cast<double>(hits[k])/steps == Approx(prob).margin(2.0/steps));
+    }
+}
+
+TEST_CASE("hypergeometric_distribution of a large population")
+{
+    // about 10^10 cells split in halves
+    const std::uint64_t total = 10000000000ULL;
+    const hypergeometric_distribution dist(total, total/5, total/2);
+    const double mean = static_cast<double>(total/10);
+    // the standard deviation is about 2*10^4
+    CHECK(static_cast<double>(dist(0.5)) == Approx(mean).margin(100));
+    CHECK(static_cast<double>(dist(0.0001)) < mean - 50000);
+    CHECK(static_cast<double>(dist(0.9999)) > mean + 50000);
+    CHECK(static_cast<double>(dist(0.9999)) < mean + 100000);
+}
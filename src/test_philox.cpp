@@ -0,0 +1,31 @@
+#include <catch2/catch.hpp>
+
+#include <cstdint>
+
+#include "philox_engine.hpp"
+
+// known answers from the Random123 distribution (kat_vectors)
+TEST_CASE("philox4x32-10 known answers")
+{
+    using engine = philox4x32_engine<10>;
+
+    CHECK(engine({0, 0})({0, 0, 0, 0}) ==
+          engine::counter_type{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8});
+    CHECK(engine({0xffffffff, 0xffffffff})({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}) ==
+          engine::counter_type{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd});
+    CHECK(engine({0xa4093822, 0x299f31d0})({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}) ==
+          engine::counter_type{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1});
+}
+
+TEST_CASE("philox4x32 blocks are independent")
+{
+    const philox4x32_engine<> first({1, 2});
+    const philox4x32_engine<> second({1, 2});
+
+    // the order the blocks are generated in does not matter
+    const auto a = first({5, 0, 0, 0});
+    const auto b = first({6, 0, 0, 0});
+    CHECK(second({6, 0, 0, 0}) == b);
+    CHECK(second({5, 0, 0, 0}) == a);
+    CHECK(a != b);
+}
@@ -0,0 +1,56 @@
+#include "wator/kernel_isa.hpp"
+
+#include <initializer_list>
+
+#include <config.h>
+
+namespace WaTor {
+
+    bool isKernelIsaCompiled(KernelIsa isa) noexcept {
+#ifdef WATOR_KERNEL_DISPATCH
+        static_cast<void>(isa);
+        return true;
+#else
+        return isa == KernelIsa::GENERIC;
+#endif
+    }
+
+    bool isKernelIsaSupported(KernelIsa isa) noexcept {
+        switch(isa) {
+            case KernelIsa::GENERIC:
+                return true;
+#if defined(__x86_64__) || defined(__i386__)
+            // libgcc checks also if the OS saves the registers
+            case KernelIsa::AVX2:
+                return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi") &&
+                       __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("popcnt");
+            case KernelIsa::AVX512:
+                return isKernelIsaSupported(KernelIsa::AVX2) &&
+                       __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#else
+            case KernelIsa::AVX2:
+            case KernelIsa::AVX512:
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    KernelIsa detectKernelIsa() noexcept {
+        for(KernelIsa isa : {KernelIsa::AVX512, KernelIsa::AVX2}) {
+            if(isKernelIsaCompiled(isa) && isKernelIsaSupported(isa)) {
+                return isa;
+            }
+        }
+        return KernelIsa::GENERIC;
+    }
+
+    const char* getKernelIsaName(KernelIsa isa) noexcept {
+        switch(isa) {
+            case KernelIsa::GENERIC: return "generic";
+            case KernelIsa::AVX2: return "avx2";
+            case KernelIsa::AVX512: return "avx512";
+        }
+        return "unknown";
+    }
+}
@@ -3,48 +3,158 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <cstdint>
+#include <stdexcept>
 #include <system_error>
+#include <utility>
 
+#include "hypergeometric_distribution.hpp"
+#include "philox_engine.hpp"
 
-namespace WaTor {
 
-    void Map::saveMap(std::ostream &fout, bool includeHeader) const {
-        if(includeHeader) {
-            fout.write(reinterpret_cast<const char*>(&m_width), sizeof(m_width)); // NOLINT 
-            fout.write(reinterpret_cast<const char*>(&m_height), sizeof(m_height)); // NOLINT
-            std::size_t bytesPerMap = static_cast<std::size_t>(m_width)*m_height;
-            bytesPerMap = (bytesPerMap+3)/4;
-            fout.write(reinterpret_cast<const char*>(&bytesPerMap), sizeof(bytesPerMap)); // NOLINT
+namespace {
+    using WaTor::MapLine;
+
+    // the streams of Map::splitPopulation and Map::randomizeLine
+    using placementEngine = philox4x32_engine<>;
+
+    placementEngine splitEngine(unsigned seed) {
+        return placementEngine{{seed, 0}};
+    }
+
+    placementEngine lineEngine(unsigned seed) {
+        return placementEngine{{seed, 1}};
+    }
+
+    // uniform in [0, 1) from 53 bits
+    double toUniform(std::uint32_t hi, std::uint32_t lo) {
+        const std::uint64_t bits = (std::uint64_t{hi} << 32U | lo) >> 11U; // NOLINT
+        return static_cast<double>(bits)*0x1p-53; // NOLINT
+    }
+
+    // calls fn(row, fishCnt, sharkCnt) for every row of [rowBeg, rowEnd)
+    // with its share of the population of the rows [nodeBeg, nodeEnd), 
+    // which is split between their halves recursively, the entities 
+    // among the tiles of the first half, then the fish among them, every
+    // split keyed by the rows it splits, so the share of a row depends 
+    // only on the seed and the map size, not on how the map is split into lines
+    template<class Fn>
+    void splitRows(const placementEngine &engine, unsigned width, unsigned nodeBeg, unsigned nodeEnd,
+                   std::size_t fishCnt, std::size_t sharkCnt, unsigned rowBeg, unsigned rowEnd, Fn &fn) {
+        if(rowEnd <= nodeBeg || nodeEnd <= rowBeg) {
+            return;
+        }
+        if(nodeEnd - nodeBeg == 1) {
+            fn(nodeBeg, fishCnt, sharkCnt);
+            return;
         }
 
-        unsigned shift = 0;
-        std::uint8_t buffer = 0;
+        const unsigned nodeMid = nodeBeg + (nodeEnd - nodeBeg)/2;
+        const std::size_t cellCnt = std::size_t{nodeEnd - nodeBeg}*width;
+        const std::size_t entityCnt = fishCnt + sharkCnt;
+        const auto rnd = engine({nodeBeg, nodeEnd, 0, 0});
+        const std::size_t firstCellCnt = std::size_t{nodeMid - nodeBeg}*width;
+        const std::size_t firstEntityCnt = 
+            hypergeometric_distribution(cellCnt, entityCnt, firstCellCnt)(toUniform(rnd[0], rnd[1]));
+        const std::size_t firstFishCnt = 
+            hypergeometric_distribution(entityCnt, fishCnt, firstEntityCnt)(toUniform(rnd[2], rnd[3]));
 
-        for(unsigned numaInd=0; numaInd<getMapNumaCnt(); ++numaInd) {
-            const MapNuma &numa = getMapNuma(numaInd);
+        splitRows(engine, width, nodeBeg, nodeMid, firstFishCnt, firstEntityCnt - firstFishCnt, 
+                  rowBeg, rowEnd, fn);
+        splitRows(engine, width, nodeMid, nodeEnd, fishCnt - firstFishCnt, 
+                  sharkCnt - (firstEntityCnt - firstFishCnt), rowBeg, rowEnd, fn);
+    }
+
+    // bit i of val to bit 2*i
+    std::uint64_t spreadBits(std::uint32_t val) {
+        std::uint64_t res = val;
+        res = (res | (res << 16U)) & 0x0000FFFF0000FFFFULL; // NOLINT
+        res = (res | (res << 8U)) & 0x00FF00FF00FF00FFULL; // NOLINT
+        res = (res | (res << 4U)) & 0x0F0F0F0F0F0F0F0FULL; // NOLINT
+        res = (res | (res << 2U)) & 0x3333333333333333ULL; // NOLINT
+        res = (res | (res << 1U)) & 0x5555555555555555ULL; // NOLINT
+        return res;
+    }
+
+    // packs the entities of the map 2 bits each, from the lowest bits 
+    // of a byte, writeByte(std::uint8_t) is called for every byte
+    template<class WriteByte>
+    void packEntities(const WaTor::Map &map, WriteByte &&writeByte) {
+        using WaTor::Entity;
+        using WaTor::Tile;
+
+        std::uint64_t acc = 0;
+        unsigned accBits = 0;
+        // bits are the codes of cnt tiles, cnt <= 16
+        auto push = [&](std::uint64_t bits, unsigned cnt) {
+            acc |= bits << accBits;
+            accBits += 2*cnt;
+            for(; accBits >= 8; accBits -= 8) { // NOLINT
+                writeByte(static_cast<std::uint8_t>(acc));
+                acc >>= 8U; // NOLINT
+            }
+        };
+
+        for(unsigned numaInd=0; numaInd<map.getMapNumaCnt(); ++numaInd) {
+            const WaTor::MapNuma &numa = map.getMapNuma(numaInd);
             for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
                 const MapLine &line = numa.getLine(lineInd);
-                for(unsigned i=0; i<line.getAbsSize(); ++i) {
-                    const Tile& tile = line.getAbs(i);
-                    unsigned entity = static_cast<unsigned>(tile.getEntity());
-
-                    // entity &= 0x03;
-                    buffer |= static_cast<std::uint8_t>(entity << shift); shift += 2;
-                    if(shift >= 8) { // NOLINT
-                        shift = 0;
-                        fout.write(reinterpret_cast<const char*>(&buffer), sizeof(buffer)); // NOLINT
-                        buffer = 0;
+                if(!line.hasEntityPlane()) {
+                    for(unsigned posy=0; posy<line.getHeight(); ++posy) {
+                        for(unsigned panel=0; panel<line.getPanelCnt(); ++panel) {
+                            const Tile *tiles = line.getTilePtr(posy, line.getPanelBegin(panel));
+                            for(unsigned i=0; i<line.getPanelWidth(panel); ++i) {
+                                push(static_cast<unsigned>(tiles[i].getEntity()), 1); // NOLINT
+                            }
+                        }
+                    }
+                    continue;
+                }
+
+                // only the entity plane is read, 16 tiles at a time
+                static_assert(static_cast<unsigned>(Entity::FISH) == 1 && 
+                              static_cast<unsigned>(Entity::SHARK) == 2, "codes of the entities");
+                constexpr unsigned CHUNK = 16;
+                for(unsigned posy=0; posy<line.getHeight(); ++posy) {
+                    const MapLine::EntityWord *row = line.getEntityRowPtr(posy);
+                    for(unsigned block=0; block<line.getBlockCnt(); ++block) {
+                        const MapLine::EntityWord water = row[MapLine::ENTITY_WORDS_PER_BLOCK*block + MapLine::ENTITY_WATER]; // NOLINT
+                        const MapLine::EntityWord fish = row[MapLine::ENTITY_WORDS_PER_BLOCK*block + MapLine::ENTITY_FISH]; // NOLINT
+                        const MapLine::EntityWord shark = ~water & ~fish;
+                        const unsigned cnt = std::min(MapLine::BLOCK_WIDTH, line.getWidth() - block*MapLine::BLOCK_WIDTH);
+                        for(unsigned beg=0; beg<cnt; beg += CHUNK) {
+                            const unsigned chunkCnt = std::min(CHUNK, cnt-beg);
+                            const std::uint64_t chunkMask = (std::uint64_t{1} << chunkCnt) - 1;
+                            const auto chunkFish = static_cast<std::uint32_t>((fish >> beg) & chunkMask);
+                            const auto chunkShark = static_cast<std::uint32_t>((shark >> beg) & chunkMask);
+                            push(spreadBits(chunkFish) | (spreadBits(chunkShark) << 1U), chunkCnt);
+                        }
                     }
                 }
             }
         }
 
-        if(shift != 0) {
-            shift = 0;
-            fout.write(reinterpret_cast<const char*>(&buffer), sizeof(buffer)); // NOLINT
-            buffer = 0;
+        if(accBits != 0) {
+            writeByte(static_cast<std::uint8_t>(acc));
+        }
+    }
+}
+
+namespace WaTor {
+
+    void Map::saveMap(std::ostream &fout, bool includeHeader) const {
+        if(includeHeader) {
+            fout.write(reinterpret_cast<const char*>(&m_width), sizeof(m_width)); // NOLINT 
+            fout.write(reinterpret_cast<const char*>(&m_height), sizeof(m_height)); // NOLINT
+            std::size_t bytesPerMap = static_cast<std::size_t>(m_width)*m_height;
+            bytesPerMap = (bytesPerMap+3)/4;
+            fout.write(reinterpret_cast<const char*>(&bytesPerMap), sizeof(bytesPerMap)); // NOLINT
         }
 
+        packEntities(*this, [&fout](std::uint8_t buffer) {
+            fout.write(reinterpret_cast<const char*>(&buffer), sizeof(buffer)); // NOLINT
+        });
+
         // fout.flush();
     }
 
@@ -59,74 +169,153 @@ namespace WaTor {
             fout.write(bytesPerMap);
         }
 
-        unsigned shift = 0;
-        std::uint8_t bits = 0;
+        packEntities(*this, [&fout](std::uint8_t bits) {
+            fout.write(bits);
+        });
+    }
+
+#endif
+
+    void Map::checkPopulation(std::size_t fishCnt, std::size_t sharkCnt) const {
+        const std::size_t cellCnt = static_cast<std::size_t>(getWidth())*getHeight();
+        if(fishCnt > cellCnt || sharkCnt > cellCnt - fishCnt) {
+            throw std::invalid_argument("Map: more entities than tiles");
+        }
+    }
+
+    void Map::randomize(std::size_t fishCnt, std::size_t sharkCnt, unsigned seed) {
+        checkPopulation(fishCnt, sharkCnt);
+        for(unsigned numaInd=0; numaInd<getMapNumaCnt(); ++numaInd) {
+            for(unsigned lineInd=0; lineInd<getMapNuma(numaInd).getLineCnt(); ++lineInd) {
+                randomizeLine(numaInd, lineInd, fishCnt, sharkCnt, seed);
+            }
+        }
+    }
+
+    std::vector<std::vector<LinePopulation>> Map::splitPopulation(std::size_t fishCnt, std::size_t sharkCnt, 
+                                                                  unsigned seed) const {
+        checkPopulation(fishCnt, sharkCnt);
+        const placementEngine engine = splitEngine(seed);
 
+        std::vector<std::vector<LinePopulation>> res(getMapNumaCnt());
         for(unsigned numaInd=0; numaInd<getMapNumaCnt(); ++numaInd) {
             const MapNuma &numa = getMapNuma(numaInd);
+            res[numaInd].resize(numa.getLineCnt());
             for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
-                const MapLine &line = numa.getLine(lineInd);
-                #pragma GCC unroll 16
-                for(unsigned i=0; i<line.getAbsSize(); ++i) {
-                    const Tile& tile = line.getAbs(i);
-                    unsigned entity = static_cast<unsigned>(tile.getEntity());
-
-                    // entity &= 0x03;
-                    bits |= static_cast<std::uint8_t>(entity << shift); shift += 2;
-                    if(shift >= 8) { // NOLINT
-                        shift = 0;
-                        fout.write(bits);
-                        bits = 0;
+                const unsigned firstRow = getLineFirstRow(numaInd, lineInd);
+                LinePopulation &pop = res[numaInd][lineInd];
+                auto addRow = [&pop](unsigned /*row*/, std::size_t rowFishCnt, std::size_t rowSharkCnt) {
+                    pop.fishCnt += rowFishCnt;
+                    pop.sharkCnt += rowSharkCnt;
+                };
+                splitRows(engine, getWidth(), 0, getHeight(), fishCnt, sharkCnt, 
+                          firstRow, firstRow + numa.getLine(lineInd).getHeight(), addRow);
+            }
+        }
+        return res;
+    }
+
+    void Map::randomizeLine(unsigned numaInd, unsigned lineInd, std::size_t fishCnt, std::size_t sharkCnt, 
+                            unsigned seed) {
+        assert(fishCnt + sharkCnt <= static_cast<std::size_t>(getWidth())*getHeight());
+        MapLine &line = getMapNuma(numaInd).getLine(lineInd);
+        const unsigned firstRow = getLineFirstRow(numaInd, lineInd);
+        const std::size_t width = line.getWidth();
+        const placementEngine engine = lineEngine(seed);
+
+        auto randomizeRow = [&](unsigned row, std::size_t rowFishCnt, std::size_t rowSharkCnt) {
+            const unsigned posy = row - firstRow;
+            // the most common kind fills the row and the others replace it 
+            // at random tiles still holding it, so at least a third of the 
+            // draws hit such a tile
+            std::array<std::pair<Tile, std::size_t>, 3> kinds = {{
+                {Tile{Entity::WATER, 0, 0}, width - rowFishCnt - rowSharkCnt},
+                {Tile{Entity::FISH, 0, 0}, rowFishCnt},
+                {Tile{Entity::SHARK, 0, 0}, rowSharkCnt}
+            }};
+            const std::size_t fillInd = static_cast<std::size_t>(std::max_element(kinds.begin(), kinds.end(), 
+                [](const auto &a, const auto &b) { return a.second < b.second; }) - kinds.begin());
+            const Tile fill = kinds[fillInd].first;
+            for(unsigned panel=0; panel<line.getPanelCnt(); ++panel) {
+                Tile *tiles = line.getTilePtr(posy, line.getPanelBegin(panel));
+                std::fill(tiles, tiles + line.getPanelWidth(panel), fill); // NOLINT
+            }
+
+            // keyed by the row of the map
+            std::uint64_t block = 0;
+            for(std::size_t kindInd=0; kindInd<kinds.size(); ++kindInd) {
+                if(kindInd == fillInd) {
+                    continue;
+                }
+                for(std::size_t placed=0; placed<kinds[kindInd].second;) {
+                    const auto rnd = engine({row, 0, static_cast<std::uint32_t>(block), 
+                                             static_cast<std::uint32_t>(block >> 32U)});
+                    ++block;
+                    for(std::size_t half=0; half<2 && placed<kinds[kindInd].second; ++half) {
+                        const auto posx = static_cast<unsigned>(toUniform(rnd[2*half], rnd[2*half+1])*
+                                                                static_cast<double>(width));
+                        Tile &tile = line.get(posy, posx);
+                        if(tile.getEntity() == fill.getEntity()) {
+                            tile = kinds[kindInd].first;
+                            ++placed;
+                        }
                     }
                 }
             }
-        }
+        };
+        splitRows(splitEngine(seed), getWidth(), 0, getHeight(), fishCnt, sharkCnt, 
+                  firstRow, firstRow + line.getHeight(), randomizeRow);
 
-        if(shift != 0) {
-            shift = 0;
-            fout.write(bits);
-            // bits = 0;
+        if(line.hasEntityPlane()) {
+            line.updateEntityPlane();
         }
     }
 
-    void Map::randomize(std::size_t fishCnt, std::size_t sharkCnt, unsigned seed) {
-        struct Indx {
-            unsigned numaInd;
-            unsigned lineInd;
-            size_t pos;
-        };
-
-        std::vector<Indx> indxList;
-        std::size_t mapSize = static_cast<std::size_t>(getWidth())*getHeight();
-        indxList.reserve(mapSize);
-
-        for(unsigned numaI=0; numaI<getMapNumaCnt(); ++numaI) {
-            const MapNuma& mapNuma = getMapNuma(numaI);
-            for(unsigned lineI=0; lineI<mapNuma.getLineCnt(); ++lineI) {
-                const MapLine& line = mapNuma.getLine(lineI);
-                std::size_t lineSize = static_cast<std::size_t>(line.getHeight())*line.getWidth();
-                for(std::size_t i=0; i<lineSize; ++i) {
-                    indxList.push_back({numaI, lineI, i});
+    void Map::setParity(bool parity) {
+        for(unsigned numaInd=0; numaInd<getMapNumaCnt(); ++numaInd) {
+            MapNuma &numa = getMapNuma(numaInd);
+            for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
+                MapLine &line = numa.getLine(lineInd);
+                for(std::size_t i=0; i<line.getAbsSize(); ++i) {
+                    Tile &tile = line.getAbs(i);
+                    if(tile.getEntity() != Entity::WATER) {
+                        tile.setParity(parity);
+                    }
                 }
             }
         }
+    }
 
-        std::mt19937 mtg(seed);
-        std::shuffle(indxList.begin(), indxList.end(), mtg);
-        indxList.resize(fishCnt + sharkCnt);
-
-        Tile defFish{Entity::FISH, 0, 0};
-        Tile defShark{Entity::SHARK, 0, 0};
+    void Map::initialize() {
+        for(unsigned numaInd=0; numaInd<getMapNumaCnt(); ++numaInd) {
+            MapNuma &numa = getMapNuma(numaInd);
+            for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
+                MapLine &line = numa.getLine(lineInd);
+                if(!line.isInitialized()) {
+                    line.initialize();
+                }
+            }
+        }
+    }
 
-        for(std::size_t i=0; i<fishCnt + sharkCnt; ++i) {
-            const Indx &indx = indxList[i];
-            MapNuma& mapNuma = getMapNuma(indx.numaInd);
-            MapLine& line = mapNuma.getLine(indx.lineInd);
-            unsigned posy = static_cast<unsigned>(indx.pos/line.getWidth());
-            unsigned posx = static_cast<unsigned>(indx.pos%line.getWidth());
-            line.get(posy, posx) = (i<fishCnt) ? defFish : defShark;
+    void Map::markAllOccupied() {
+        for(unsigned numaInd=0; numaInd<getMapNumaCnt(); ++numaInd) {
+            MapNuma &numa = getMapNuma(numaInd);
+            for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
+                numa.getLine(lineInd).markAllOccupied();
+            }
         }
     }
 
-#endif
+    void Map::updateEntityPlanes() {
+        if(m_storage != MapLineStorage::SPLIT) {
+            return;
+        }
+        for(unsigned numaInd=0; numaInd<getMapNumaCnt(); ++numaInd) {
+            MapNuma &numa = getMapNuma(numaInd);
+            for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
+                numa.getLine(lineInd).updateEntityPlane();
+            }
+        }
+    }
 }
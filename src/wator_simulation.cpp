@@ -1,23 +1,135 @@
 #include "wator/simulation.hpp"
 #include "wator/simulation_worker.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
 #include <memory>
 #include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
 
 #include <config.h>
 
 namespace WaTor {
 
-Simulation::Simulation(const Rules &rules, const ExecutionPlanner &exp, unsigned seed)
-    : m_rules(rules), m_exp(exp), 
+namespace {
+    template<KernelIsa isa, class RulesPolicy>
+    SimulationTask makeTileTask(Map &map, unsigned numaInd, unsigned lineInd, 
+                                const Rules &rules, unsigned seed, std::uint64_t chronon,
+                                unsigned stripWidth) {
+        return BasicSimulationWorker<RulesPolicy, isa>{map, numaInd, lineInd, rules, seed, chronon, stripWidth};
+    }
+
+    template<KernelIsa isa, class... Policies>
+    auto findFixedTileTask(const Rules &rules, std::tuple<Policies...> * /*tag*/) {
+        decltype(&makeTileTask<isa, RuntimeRulesPolicy>) res = nullptr;
+        // the first matching one
+        static_cast<void>(((Policies::matches(rules) ? (res = &makeTileTask<isa, Policies>, true) : false) || ...));
+        return res;
+    }
+
+    template<KernelIsa isa>
+    auto selectTileTask(const Rules &rules, const SimulationOptions &opts) {
+        if(opts.fixedRules) {
+            auto res = findFixedTileTask<isa>(rules, static_cast<FixedRulesPolicies*>(nullptr));
+            if(res != nullptr) {
+                return res;
+            }
+        }
+        return &makeTileTask<isa, RuntimeRulesPolicy>;
+    }
+}
+
+KernelIsa Simulation::selectKernelIsa(const SimulationOptions &opts) {
+    if(!opts.kernelIsa.has_value()) {
+        return detectKernelIsa();
+    }
+    const KernelIsa isa = *opts.kernelIsa;
+    if(!isKernelIsaCompiled(isa)) {
+        throw std::runtime_error(std::string{"The "} + getKernelIsaName(isa) + 
+                                 " kernel is not compiled in (WATOR_KERNEL_DISPATCH)");
+    }
+    if(!isKernelIsaSupported(isa)) {
+        throw std::runtime_error(std::string{"The CPU does not support the "} + 
+                                 getKernelIsaName(isa) + " kernel");
+    }
+    return isa;
+}
+
+Simulation::TileTaskFactory Simulation::selectTileTaskFactory(const Rules &rules, 
+                                                              const SimulationOptions &opts,
+                                                              KernelIsa isa) {
+    switch(isa) {
+        case KernelIsa::AVX2:
+            return selectTileTask<KernelIsa::AVX2>(rules, opts);
+        case KernelIsa::AVX512:
+            return selectTileTask<KernelIsa::AVX512>(rules, opts);
+        case KernelIsa::GENERIC:
+            break;
+    }
+    return selectTileTask<KernelIsa::GENERIC>(rules, opts);
+}
+
+Simulation::Simulation(const Rules &rules, const ExecutionPlanner &exp, unsigned seed,
+                       const SimulationOptions &opts)
+    : m_rules(rules), m_exp(exp), m_opts(opts),
       m_workers(std::make_unique<std::unique_ptr<WorkerType>[]>(m_exp.getCpuCnt())), // NOLINT
-      m_map(m_rules, m_exp), m_rng(seed), 
-      m_waitingTime(m_exp.getCpuCnt(), std::chrono::microseconds{0}) {
+      // the tile kernel reads the neighbour rows from the entity planes
+      m_map(m_rules.getHeight(), m_rules.getWidth(), m_exp, 
+            makeAllocStrategy(m_opts, m_scratch),
+            (m_opts.engine == SimulationEngine::TILE) ? MapLineStorage::SPLIT : MapLineStorage::TILES, 
+            m_opts.layout, true, calcLinePairs(m_rules, m_opts)), 
+      m_seed(seed),
+      m_waitingTime(m_exp.getCpuCnt(), std::chrono::microseconds{0}),
+      m_prevRunTime(m_exp.getCpuCnt(), std::chrono::microseconds{0}),
+      m_rebalanceTime(m_exp.getCpuCnt()),
+      m_kernelIsa(selectKernelIsa(m_opts)),
+      m_makeTileTask(selectTileTaskFactory(m_rules, m_opts, m_kernelIsa)) {
+
+    if(m_opts.persistentWorkers && m_scratch != nullptr) {
+        throw std::invalid_argument("The out-of-core mode can not use persistent workers");
+    }
+    if(m_opts.workStealing && m_scratch != nullptr) {
+        throw std::invalid_argument("The out-of-core mode can not use work stealing");
+    }
+    if(m_opts.rebalancePeriod != 0 && 
+       (m_opts.engine != SimulationEngine::TILE || m_scratch != nullptr || m_opts.workStealing)) {
+        throw std::invalid_argument("The rebalancing needs the tile engine without out-of-core mode "
+                                    "and work stealing");
+    }
+    if(m_opts.dataflowSync && 
+       (m_scratch != nullptr || m_opts.persistentWorkers || m_opts.workStealing || m_opts.rebalancePeriod != 0)) {
+        throw std::invalid_argument("The dataflow synchronisation can not be used with the out-of-core mode, "
+                                    "persistent workers, work stealing or rebalancing");
+    }
+    if(m_opts.temporalBlock > 1 && !m_opts.dataflowSync) {
+        throw std::invalid_argument("The temporal blocking needs the dataflow synchronisation");
+    }
+    // the CPUs get getLinePairCnt()/getCpuCnt() pairs or one more
+    if(m_opts.temporalBlock > 1 && m_map.getLinePairCnt()/m_exp.getCpuCnt() < 2) {
+        throw std::invalid_argument("The temporal blocking needs more than one line pair per CPU");
+    }
+    m_stepStats.resize(m_exp.getCpuCnt());
 
+    // the pairs of Map::getCpuFirstPair, counted on the NUMA node
+    const unsigned pairCnt = m_map.getLinePairCnt();
     unsigned cpuInd=0;
     for(unsigned numaInd=0; numaInd<m_exp.getNumaList().size(); ++numaInd) {
         unsigned numaNode = m_exp.getNumaList()[numaInd];
+        const unsigned numaFirstPair = Map::getCpuFirstPair(pairCnt, m_exp.getCpuCnt(), cpuInd);
+        unsigned numaCpuInd = 0;
         for(unsigned cpu : m_exp.getCpuListPerNuma(numaInd)) {
+            const unsigned firstPair = Map::getCpuFirstPair(pairCnt, m_exp.getCpuCnt(), cpuInd);
+            const unsigned endPair = Map::getCpuFirstPair(pairCnt, m_exp.getCpuCnt(), cpuInd+1);
+            m_workerPlace.push_back(WorkerPlace{numaInd, numaCpuInd++, cpu, 
+                                                firstPair - numaFirstPair, endPair - numaFirstPair});
 #ifdef WATOR_NUMA
             m_workers[cpuInd] = std::make_unique<WorkerType>(numaNode);
 #else
@@ -34,75 +146,711 @@ Simulation::Simulation(const Rules &rules, const ExecutionPlanner &exp, unsigned
         }
     }
 
-    m_map.randomize(m_rules, static_cast<unsigned>(m_rng()));
+    initMap(static_cast<unsigned>(std::mt19937{m_seed}()));
+
+    if(m_opts.engine == SimulationEngine::BITBOARD) {
+        m_bitboard.emplace(m_map);
+        m_mapModified = true;
+    }
+
+    if(m_opts.workStealing) {
+        initStealing();
+    }
+    if(m_opts.persistentWorkers) {
+        startStepping();
+    }
+    if(m_opts.dataflowSync) {
+        initFlow();
+    }
+}
+
+Simulation::~Simulation() {
+    if(m_barrier) {
+        m_stopStepping = true;
+        m_barrier->arriveAndWait(0);
+        // the workers may still be leaving the barrier, it is destroyed 
+        // before them
+        for(unsigned cpuInd=1; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+            m_workers[cpuInd]->waitFinish();
+        }
+    }
+}
+
+SimulationTask Simulation::makeTask(unsigned numaInd, unsigned lineInd, std::uint64_t chronon) {
+    if(m_bitboard.has_value()) {
+        return SimulationBitboardWorker{*m_bitboard, numaInd, lineInd, m_rules, m_seed, chronon};
+    }
+    return m_makeTileTask(m_map, numaInd, lineInd, m_rules, m_seed, chronon, m_opts.stripWidth);
+}
+
+void Simulation::syncMap() const {
+    if(!m_mapStale) {
+        return;
+    }
+    assert(m_bitboard.has_value());
+    m_bitboard->store(const_cast<Map&>(m_map)); // NOLINT
+    m_mapStale = false;
+}
+
+std::unique_ptr<MapAllocStrategy> Simulation::makeAllocStrategy(const SimulationOptions &opts,
+                                                                MappedFileAllocStrategy *&scratch) {
+    if(opts.scratchDir.empty()) {
+        return std::make_unique<NumaAllocStrategy>(opts.hugePages, opts.allocLog);
+    }
+    if(opts.engine != SimulationEngine::TILE) {
+        throw std::invalid_argument("The out-of-core mode needs the tile engine");
+    }
+    auto res = std::make_unique<MappedFileAllocStrategy>(opts.scratchDir);
+    scratch = res.get();
+    return res;
 }
 
-void Simulation::calcHalfIterStats() {
+void Simulation::initMap(unsigned seed) {
+    // the same result as Map::randomize
+    const std::size_t fishCnt = m_rules.getInitialFishCnt();
+    const std::size_t sharkCnt = m_rules.getInitialSharkCnt();
+    m_map.checkPopulation(fishCnt, sharkCnt);
+
+    if(m_scratch == nullptr) {
+        // the same lines as in the half iterations
+        for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+            const WorkerPlace &place = m_workerPlace[cpuInd];
+            for(unsigned lineInd=2*place.firstPair; lineInd<2*place.endPair; ++lineInd) {
+                m_workers[cpuInd]->pushWork(MapInitTask{m_map, place.numaInd, lineInd, fishCnt, sharkCnt, seed});
+            }
+        }
+        runWorkers();
+    } else {
+        // a pair of lines per worker at a time, then they are written out
+        const LineList order = getLineOrder();
+        const std::size_t batch = std::size_t{2}*m_exp.getCpuCnt();
+        for(std::size_t beg=0; beg<order.size(); beg += batch) {
+            for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+                for(std::size_t k=beg+2*cpuInd; k<std::min(order.size(), beg+2*cpuInd+2); ++k) {
+                    const auto [numaInd, lineInd] = order[k];
+                    m_workers[cpuInd]->pushWork(MapInitTask{m_map, numaInd, lineInd, fishCnt, sharkCnt, seed});
+                }
+            }
+            runWorkers();
+            writeBackLines(order, beg, std::min(order.size(), beg + batch));
+        }
+    }
+
+    for(unsigned i=0; i<m_exp.getCpuCnt(); ++i) {
+        m_workers[i]->clearStats();
+    }
+}
+
+void Simulation::runWorkers() {
+    m_workers[0]->runOnThisThread(m_exp.getCpuListPerNuma(0).front());
+
+    for(unsigned i=1; i<m_exp.getCpuCnt(); ++i) {
+        m_workers[i]->waitFinish();
+    }
+}
+
+void Simulation::calcHalfIterStats(bool odd) {
+    // a worker may have run several tasks
+    using namespace std::chrono;
+    std::vector<microseconds> lastDuration(m_exp.getCpuCnt());
+    for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+        const microseconds allDuration = m_workers[cpuInd]->getAllRunDuration();
+        lastDuration[cpuInd] = allDuration - m_prevRunTime[cpuInd];
+        m_prevRunTime[cpuInd] = allDuration;
+    }
+    addHalfIterStats(lastDuration, odd);
+}
+
+void Simulation::addHalfIterStats(const std::vector<std::chrono::microseconds> &lastDuration, bool odd) {
     ++m_halfIterCnt;
 
     using namespace std::chrono;
-    microseconds maxTime = m_workers[0]->getLastRunDuration();
-    for(unsigned cpuInd=1; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
-        microseconds lastDuration = m_workers[cpuInd]->getLastRunDuration();
-        maxTime = std::max(maxTime, lastDuration);
+    const microseconds maxTime = *std::max_element(lastDuration.begin(), lastDuration.end());
+    for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+        m_waitingTime[cpuInd] += maxTime - lastDuration[cpuInd];
+        m_rebalanceTime[cpuInd][static_cast<unsigned>(odd)] += lastDuration[cpuInd];
     }
+}
+
+unsigned Simulation::calcLinePairs(const Rules &rules, const SimulationOptions &opts) {
+    if(opts.lineHeight == 0) {
+        throw std::invalid_argument("The line height has to be at least 1");
+    }
+    return std::max(1U, rules.getHeight()/(2*opts.lineHeight));
+}
+
+void Simulation::rebalance() {
+    // the lines stay where they are, so the results do not change, the 
+    // pairs are the rows of StripeRebalancer and every worker is a line
+    // and a group of it, planned per NUMA node, the pairs stay on theirs
+    std::vector<double> workerTime(m_exp.getCpuCnt());
     for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
-        microseconds lastDuration = m_workers[cpuInd]->getLastRunDuration();
-        m_waitingTime[cpuInd] += maxTime - lastDuration;
+        workerTime[cpuInd] = static_cast<double>((m_rebalanceTime[cpuInd][0] + m_rebalanceTime[cpuInd][1]).count());
+        m_rebalanceTime[cpuInd] = {};
+    }
+
+    // a worker has a neighbour above and bellow
+    const StripeRebalancer rebalancer{m_opts.rebalanceThreshold, 1, 2};
+    unsigned firstCpuInd = 0;
+    for(unsigned numaInd=0; numaInd<m_map.getMapNumaCnt(); ++numaInd) {
+        const auto cpuCnt = static_cast<unsigned>(m_exp.getCpuListPerNuma(numaInd).size());
+        const unsigned numaPairCnt = m_map.getMapNuma(numaInd).getLineCnt()/2;
+        std::vector<StripeRebalancer::Line> workers;
+        for(unsigned j=0; j<cpuCnt; ++j) {
+            const WorkerPlace &place = m_workerPlace[firstCpuInd + j];
+            workers.push_back({place.endPair - place.firstPair, numaPairCnt, j});
+        }
+        const std::vector<double> groupTime(workerTime.begin() + firstCpuInd, 
+                                            workerTime.begin() + firstCpuInd + cpuCnt);
+
+        const std::vector<int> shifts = rebalancer.plan(workers, groupTime);
+        for(std::size_t j=0; j<shifts.size(); ++j) {
+            // > 0 the upper worker takes the pairs of the lower one
+            WorkerPlace &upper = m_workerPlace[firstCpuInd + j];
+            WorkerPlace &lower = m_workerPlace[firstCpuInd + j + 1];
+            upper.endPair = static_cast<unsigned>(static_cast<int>(upper.endPair) + shifts[j]);
+            lower.firstPair = upper.endPair;
+            m_movedPairCnt += static_cast<std::uint64_t>(std::abs(shifts[j]));
+        }
+        firstCpuInd += cpuCnt;
     }
 }
 
 void Simulation::doHalfIteration(bool odd) {
-    unsigned cpuInd = 1;
-
     const unsigned uodd = static_cast<unsigned>(odd);
-    for(unsigned i=0; i<m_exp.getNumaList().size(); ++i) {
-        for(unsigned j=0; j<m_exp.getCpuListPerNuma(i).size(); ++j) {
-            if(i == 0 && j == 0) {
+    for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+        const WorkerPlace &place = m_workerPlace[cpuInd];
+        if(m_opts.workStealing) {
+            m_workers[cpuInd]->pushWork(StepTask{*this, cpuInd, odd});
+        } else {
+            for(unsigned pair=place.firstPair; pair<place.endPair; ++pair) {
+                m_workers[cpuInd]->pushWork(makeTask(place.numaInd, 2*pair+uodd));
+            }
+        }
+    }
+
+    runWorkers();
+    calcHalfIterStats(odd);
+}
+
+Simulation::LineList Simulation::getLineOrder() const {
+    LineList res;
+    for(unsigned numaInd=0; numaInd<m_map.getMapNumaCnt(); ++numaInd) {
+        for(unsigned lineInd=0; lineInd<m_map.getMapNuma(numaInd).getLineCnt(); ++lineInd) {
+            res.emplace_back(numaInd, lineInd);
+        }
+    }
+    return res;
+}
+
+void Simulation::prefetchLines(const LineList &order, std::size_t beg, std::size_t end) {
+    if(m_scratch == nullptr) {
+        return;
+    }
+    for(std::size_t k=beg; k<end; ++k) {
+        const MapLine &line = m_map.getMapNuma(order[k].first).getLine(order[k].second);
+        for(const auto &[ptr, bytes] : line.getBuffers()) {
+            m_scratch->getFile().prefetch(ptr, bytes);
+        }
+    }
+}
+
+void Simulation::writeBackLines(const LineList &order, std::size_t beg, std::size_t end) {
+    if(m_scratch == nullptr) {
+        return;
+    }
+    for(std::size_t k=beg; k<end; ++k) {
+        const MapLine &line = m_map.getMapNuma(order[k].first).getLine(order[k].second);
+        for(const auto &[ptr, bytes] : line.getBuffers()) {
+            m_scratch->getFile().writeBack(ptr, bytes);
+        }
+    }
+}
+
+void Simulation::doWavefrontIteration() {
+    // an odd line depends only on the even lines around it, so it is 
+    // updated as soon as they are, the map is swept once per chronon 
+    // with the same result as the two half iterations
+    const LineList order = getLineOrder();
+    const unsigned cpuCnt = m_exp.getCpuCnt();
+    const std::size_t batch = std::size_t{2}*cpuCnt;
+    for(std::size_t beg=0; beg<order.size(); beg += batch) {
+        prefetchLines(order, std::min(order.size(), beg + batch), std::min(order.size(), beg + 2*batch));
+
+        // the even lines of the batch, the last one may be shorter
+        for(unsigned cpuInd=0; cpuInd<cpuCnt && beg + 2*cpuInd < order.size(); ++cpuInd) {
+            const auto [numaInd, lineInd] = order[beg + 2*cpuInd];
+            m_workers[cpuInd]->pushWork(makeTask(numaInd, lineInd));
+        }
+        runWorkers();
+        calcHalfIterStats(false);
+
+        // the odd lines below the even lines of the previous batch, the 
+        // last line of the map is updated after line 0
+        for(unsigned cpuInd=0; cpuInd<cpuCnt && beg + 2*cpuInd < order.size(); ++cpuInd) {
+            if(beg + 2*cpuInd == 0) {
                 continue;
             }
-            unsigned rnd = static_cast<unsigned>(m_rng());
-            auto &&work = SimulationWorker{m_map, i, 2*j+uodd, m_rules, rnd};
-            m_workers[cpuInd]->pushWork(work);
-            ++cpuInd;
+            const auto [numaInd, lineInd] = order[beg + 2*cpuInd - 1];
+            m_workers[cpuInd]->pushWork(makeTask(numaInd, lineInd));
+        }
+        runWorkers();
+        calcHalfIterStats(true);
+
+        // the previous batch is not needed in this chronon any more
+        if(beg != 0) {
+            writeBackLines(order, beg - batch, beg);
         }
     }
 
-    unsigned rnd = static_cast<unsigned>(m_rng());
-    auto &&work = SimulationWorker{m_map, 0, uodd, m_rules, rnd};
-    m_workers[0]->pushWork(work);
+    m_workers[0]->pushWork(makeTask(order.back().first, order.back().second));
+    runWorkers();
+    calcHalfIterStats(true);
 
-    m_workers[0]->runOnThisThread(m_exp.getCpuListPerNuma(0).front());
+    writeBackLines(order, (order.size() - 1)/batch*batch, order.size());
+}
 
-    for(unsigned i=1; i<m_exp.getCpuCnt(); ++i) {
-        m_workers[i]->waitFinish();
+void SteppingTask::operator() () {
+    m_sim->runSteps(m_cpuInd);
+}
+
+void Simulation::startStepping() {
+    std::vector<unsigned> groupSizes;
+    for(unsigned numaInd=0; numaInd<m_exp.getNumaList().size(); ++numaInd) {
+        groupSizes.push_back(static_cast<unsigned>(m_exp.getCpuListPerNuma(numaInd).size()));
+    }
+    m_barrier = std::make_unique<HierarchicalBarrier>(groupSizes);
+
+    for(unsigned cpuInd=1; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+        m_workers[cpuInd]->pushWork(SteppingTask{*this, cpuInd});
+    }
+}
+
+void Simulation::runSteps(unsigned cpuInd) {
+    const unsigned group = m_workerPlace[cpuInd].numaInd;
+    while(true) {
+        // doSteppedIteration or the destructor
+        m_barrier->arriveAndWait(group);
+        if(m_stopStepping) {
+            return;
+        }
+        doStep(cpuInd, false);
+        m_barrier->arriveAndWait(group);
+        doStep(cpuInd, true);
+        m_barrier->arriveAndWait(group);
     }
+}
+
+void Simulation::doStep(unsigned cpuInd, bool odd) {
+    const WorkerPlace &place = m_workerPlace[cpuInd];
+    const unsigned uodd = static_cast<unsigned>(odd);
+
+    auto runLine = [&](unsigned numaInd, unsigned pair) {
+        try {
+            makeTask(numaInd, 2*pair+uodd)();
+        } catch(...) { /* do nothing, as Worker */ }
+    };
+
+    auto clockStart = std::chrono::steady_clock::now();
+    if(m_opts.workStealing) {
+        // nobody takes the other parity in this half iteration
+        refillPairs(cpuInd, 1 - uodd);
+
+        unsigned pair = 0;
+        while(takePair(cpuInd, uodd, true, pair)) {
+            runLine(place.numaInd, pair);
+        }
+        for(unsigned victim : m_victims[cpuInd]) {
+            while(takePair(victim, uodd, false, pair)) {
+                runLine(m_workerPlace[victim].numaInd, pair);
+            }
+        }
+    } else {
+        for(unsigned pair=place.firstPair; pair<place.endPair; ++pair) {
+            runLine(place.numaInd, pair);
+        }
+    }
+    auto clockEnd = std::chrono::steady_clock::now();
+
+    StepStats &stats = m_stepStats[cpuInd];
+    stats.lastDuration[uodd] = std::chrono::duration_cast<std::chrono::microseconds>(clockEnd - clockStart);
+    stats.runDuration += stats.lastDuration[uodd];
+    stats.sumFreq += Utils::readCurCpuFreq(place.cpu)*static_cast<std::uint64_t>(stats.lastDuration[uodd].count());
+}
+
+void StepTask::operator() () {
+    m_sim->doStep(m_cpuInd, m_odd);
+}
+
+void Simulation::initStealing() {
+    const unsigned cpuCnt = m_exp.getCpuCnt();
+    for(auto &ranges : m_pairRanges) {
+        ranges = std::make_unique<PairRange[]>(cpuCnt); // NOLINT
+    }
+
+    m_victims.resize(cpuCnt);
+    for(unsigned cpuInd=0; cpuInd<cpuCnt; ++cpuInd) {
+        const unsigned numaInd = m_workerPlace[cpuInd].numaInd;
+        // the next ones on the same node, then the next nodes
+        for(unsigned k=1; k<cpuCnt; ++k) {
+            const unsigned victim = (cpuInd + k) % cpuCnt;
+            if(m_workerPlace[victim].numaInd == numaInd) {
+                m_victims[cpuInd].push_back(victim);
+            }
+        }
+        for(unsigned k=1; k<cpuCnt; ++k) {
+            const unsigned victim = (cpuInd + k) % cpuCnt;
+            if(m_workerPlace[victim].numaInd != numaInd) {
+                m_victims[cpuInd].push_back(victim);
+            }
+        }
+        // the first half iteration
+        refillPairs(cpuInd, 0);
+    }
+}
+
+void Simulation::refillPairs(unsigned cpuInd, unsigned uodd) {
+    const std::uint64_t first = m_workerPlace[cpuInd].firstPair;
+    const std::uint64_t end = m_workerPlace[cpuInd].endPair;
+    m_pairRanges[uodd][cpuInd].range.store((first << 32U) | end, std::memory_order_relaxed);
+}
+
+bool Simulation::takePair(unsigned cpuInd, unsigned uodd, bool front, unsigned &pair) {
+    constexpr std::uint64_t lowMask = 0xFFFFFFFFU;
+    std::atomic<std::uint64_t> &range = m_pairRanges[uodd][cpuInd].range;
+    std::uint64_t cur = range.load(std::memory_order_relaxed);
+    while(true) {
+        const std::uint64_t first = cur >> 32U;
+        const std::uint64_t end = cur & lowMask;
+        if(first >= end) {
+            return false;
+        }
+        const std::uint64_t next = front ? (((first + 1) << 32U) | end) : ((first << 32U) | (end - 1));
+        // the ranges and the lines were published by the barrier or the
+        // Worker queues before the half iteration
+        if(range.compare_exchange_weak(cur, next, std::memory_order_relaxed)) {
+            pair = static_cast<unsigned>(front ? first : end - 1);
+            return true;
+        }
+    }
+}
+
+void FlowTask::operator() () {
+    m_sim->runFlow(m_cpuInd, m_firstChronon, m_chrononCnt);
+}
 
-    calcHalfIterStats();
+void Simulation::initFlow() {
+    const LineList order = getLineOrder();
+    m_lineEpochs = std::make_unique<LineEpoch[]>(order.size()); // NOLINT
+
+    // the workers follow each other in the order of the lines
+    m_flowLines.resize(m_exp.getCpuCnt());
+    std::size_t k = 0;
+    for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+        const WorkerPlace &place = m_workerPlace[cpuInd];
+        for(unsigned lineInd=2*place.firstPair; lineInd<2*place.endPair; ++lineInd, ++k) {
+            assert(order[k] == std::make_pair(place.numaInd, lineInd));
+            m_flowLines[cpuInd].push_back(static_cast<unsigned>(k));
+        }
+    }
+}
+
+std::chrono::microseconds Simulation::waitForLine(std::size_t k, std::uint64_t chronons) const {
+    constexpr unsigned spinCnt = 1U << 10U;
+    const std::atomic<std::uint64_t> &done = m_lineEpochs[k].done;
+    if(done.load(std::memory_order_acquire) >= chronons) {
+        return std::chrono::microseconds{0};
+    }
+
+    // the neighbour may be on a CPU shared with this one, so it yields 
+    // after a while
+    auto clockStart = std::chrono::steady_clock::now();
+    for(unsigned i=0; done.load(std::memory_order_acquire) < chronons; ++i) {
+        if(i < spinCnt) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    auto clockEnd = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(clockEnd - clockStart);
+}
+
+std::chrono::microseconds Simulation::waitForNeighbours(std::size_t prev, std::uint64_t prevSeen, 
+                                                        std::size_t next, std::uint64_t nextSeen) const {
+    constexpr unsigned spinCnt = 1U << 10U;
+    const std::atomic<std::uint64_t> &prevDone = m_lineEpochs[prev].done;
+    const std::atomic<std::uint64_t> &nextDone = m_lineEpochs[next].done;
+
+    auto clockStart = std::chrono::steady_clock::now();
+    for(unsigned i=0; prevDone.load(std::memory_order_acquire) == prevSeen && 
+                      nextDone.load(std::memory_order_acquire) == nextSeen; ++i) {
+        if(i < spinCnt) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    auto clockEnd = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(clockEnd - clockStart);
+}
+
+void Simulation::runFlow(unsigned cpuInd, std::uint64_t firstChronon, unsigned chrononCnt) {
+    const LineList order = getLineOrder();
+    const std::size_t lineCnt = order.size();
+    StepStats &stats = m_stepStats[cpuInd];
+    stats.flowWait = std::chrono::microseconds{0};
+
+    if(m_opts.temporalBlock > 1) {
+        const std::uint64_t endChronon = firstChronon + chrononCnt;
+        for(std::uint64_t chronon=firstChronon; chronon<endChronon; chronon += m_opts.temporalBlock) {
+            runFlowBlock(cpuInd, chronon, std::min(chronon + m_opts.temporalBlock, endChronon), order);
+        }
+        return;
+    }
+
+    for(std::uint64_t chronon=firstChronon; chronon<firstChronon+chrononCnt; ++chronon) {
+        for(unsigned uodd=0; uodd<2; ++uodd) {
+            for(unsigned k : m_flowLines[cpuInd]) {
+                const auto [numaInd, lineInd] = order[k];
+                if(lineInd % 2 != uodd) {
+                    continue;
+                }
+                // the neighbours are of the other parity, in the previous 
+                // half iteration, the even ones of this chronon for an odd 
+                // line, the odd ones of the previous chronon for an even one, 
+                // and they do not start the next one before this line is done
+                stats.flowWait += waitForLine((k + lineCnt - 1) % lineCnt, chronon + uodd);
+                stats.flowWait += waitForLine((k + 1) % lineCnt, chronon + uodd);
+                try {
+                    makeTask(numaInd, lineInd, chronon)();
+                } catch(...) { /* do nothing, as Worker */ }
+                m_lineEpochs[k].done.store(chronon + 1, std::memory_order_release);
+            }
+        }
+    }
+}
+
+void Simulation::runFlowBlock(unsigned cpuInd, std::uint64_t firstChronon, std::uint64_t endChronon,
+                              const LineList &order) {
+    const std::vector<unsigned> &lines = m_flowLines[cpuInd];
+    const auto lineCnt = static_cast<unsigned>(lines.size());
+    const std::size_t allLineCnt = order.size();
+    // the half iterations of the block, line j of the worker has the ones
+    // of its parity, level = 2*(chronon - firstChronon) + j%2
+    const auto levelCnt = static_cast<unsigned>(2*(endChronon - firstChronon));
+    // lines per tile, a tile is the levels and lines with level + j in
+    // [tile*width, (tile+1)*width), it depends only on the earlier tiles
+    // and on the lower levels of itself, and touches about 2*width lines
+    const unsigned width = levelCnt;
+    const unsigned tileCnt = (levelCnt + lineCnt - 2)/width + 1;
+
+    // the lines of the worker follow each other, only the lines of the 
+    // other workers around them can hold it up
+    const std::size_t prevLine = (lines.front() + allLineCnt - 1) % allLineCnt;
+    const std::size_t nextLine = (lines.back() + 1) % allLineCnt;
+
+    StepStats &stats = m_stepStats[cpuInd];
+    std::size_t pending = std::size_t{lineCnt}*(endChronon - firstChronon);
+    while(pending != 0) {
+        // read before the pass, so a neighbour done during it is not missed
+        const std::uint64_t prevSeen = m_lineEpochs[prevLine].done.load(std::memory_order_acquire);
+        const std::uint64_t nextSeen = m_lineEpochs[nextLine].done.load(std::memory_order_acquire);
+        bool progress = false;
+        for(unsigned tile=0; tile<tileCnt; ++tile) {
+            for(unsigned level=0; level<levelCnt; ++level) {
+                for(unsigned diag=tile*width; diag<(tile+1)*width; ++diag) {
+                    if(diag < level || diag - level >= lineCnt || (diag - level) % 2 != level % 2) {
+                        continue;
+                    }
+                    const std::size_t k = lines[diag - level];
+                    const std::uint64_t chronon = firstChronon + level/2;
+                    const unsigned uodd = level % 2;
+                    // the lines of the other workers (or of this one, not 
+                    // done yet) are not waited for, but passed over
+                    const std::size_t prev = (k + allLineCnt - 1) % allLineCnt, next = (k + 1) % allLineCnt;
+                    if(m_lineEpochs[k].done.load(std::memory_order_relaxed) != chronon ||
+                       m_lineEpochs[prev].done.load(std::memory_order_acquire) < chronon + uodd ||
+                       m_lineEpochs[next].done.load(std::memory_order_acquire) < chronon + uodd) {
+                        continue;
+                    }
+                    const auto [numaInd, lineInd] = order[k];
+                    try {
+                        makeTask(numaInd, lineInd, chronon)();
+                    } catch(...) { /* do nothing, as Worker */ }
+                    m_lineEpochs[k].done.store(chronon + 1, std::memory_order_release);
+                    --pending;
+                    progress = true;
+                }
+            }
+        }
+
+        // nothing of this worker changes until a neighbour moves on, so 
+        // the tiles are not scanned again before
+        if(!progress) {
+            stats.flowWait += waitForNeighbours(prevLine, prevSeen, nextLine, nextSeen);
+        }
+    }
+}
+
+void Simulation::doFlowIterations(unsigned cnt) {
+    for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+        m_workers[cpuInd]->pushWork(FlowTask{*this, cpuInd, m_iterCnt, cnt});
+    }
+    runWorkers();
+
+    // the time not spent waiting for the neighbours is the run time
+    using namespace std::chrono;
+    std::vector<microseconds> allDuration(m_exp.getCpuCnt());
+    for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+        const microseconds runDuration = m_workers[cpuInd]->getAllRunDuration();
+        allDuration[cpuInd] = runDuration - m_prevRunTime[cpuInd];
+        m_prevRunTime[cpuInd] = runDuration;
+    }
+    const microseconds maxTime = *std::max_element(allDuration.begin(), allDuration.end());
+    for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+        m_waitingTime[cpuInd] += maxTime - allDuration[cpuInd] + m_stepStats[cpuInd].flowWait;
+    }
+    m_halfIterCnt += std::uint64_t{2}*cnt;
+}
+
+void Simulation::doSteppedIteration() {
+    // releases the workers, they see everything written before
+    m_barrier->arriveAndWait(0);
+    doStep(0, false);
+    m_barrier->arriveAndWait(0);
+    doStep(0, true);
+    // joins them
+    m_barrier->arriveAndWait(0);
+
+    for(unsigned uodd=0; uodd<2; ++uodd) {
+        std::vector<std::chrono::microseconds> lastDuration(m_exp.getCpuCnt());
+        for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+            lastDuration[cpuInd] = m_stepStats[cpuInd].lastDuration[uodd];
+        }
+        addHalfIterStats(lastDuration, uodd != 0);
+    }
+}
+
+void Simulation::prepareModifiedMap() {
+    if(m_mapModified) {
+        const bool parity = (m_iterCnt % 2) != 0;
+        if(m_bitboard.has_value()) {
+            // entities not updated in the current chronon have stamp != parity
+            m_bitboard->load(m_map, !parity);
+        } else {
+            // after a chronon every entity has the parity of the next one,
+            // but new ones have parity 0
+            m_map.setParity(parity);
+            m_map.markAllOccupied();
+            m_map.updateEntityPlanes();
+        }
+        m_mapModified = false;
+    }
 }
 
 void Simulation::doIteration() {
+    if(m_opts.dataflowSync) {
+        doIterations(1);
+        return;
+    }
+    prepareModifiedMap();
+
     auto clockStart = std::chrono::steady_clock::now();
-    doHalfIteration(false);
-    doHalfIteration(true);
+    if(m_scratch != nullptr) {
+        doWavefrontIteration();
+    } else if(m_barrier) {
+        doSteppedIteration();
+    } else {
+        doHalfIteration(false);
+        doHalfIteration(true);
+    }
+    if(m_opts.rebalancePeriod != 0 && (m_iterCnt + 1) % m_opts.rebalancePeriod == 0) {
+        rebalance();
+    }
     auto clockEnd = std::chrono::steady_clock::now();
     std::chrono::microseconds diff = std::chrono::duration_cast<std::chrono::microseconds>(clockEnd - clockStart);
     m_allTime += diff;
+
+    ++m_iterCnt;
+    m_mapStale = m_bitboard.has_value();
+}
+
+void Simulation::doIterations(unsigned cnt) {
+    if(!m_opts.dataflowSync) {
+        for(unsigned i=0; i<cnt; ++i) {
+            doIteration();
+        }
+        return;
+    }
+    if(cnt == 0) {
+        return;
+    }
+    prepareModifiedMap();
+
+    auto clockStart = std::chrono::steady_clock::now();
+    doFlowIterations(cnt);
+    auto clockEnd = std::chrono::steady_clock::now();
+    m_allTime += std::chrono::duration_cast<std::chrono::microseconds>(clockEnd - clockStart);
+
+    m_iterCnt += cnt;
+    m_mapStale = m_bitboard.has_value();
+}
+
+NumaAudit Simulation::makeNumaAudit() const {
+    NumaAudit res;
+
+    if(m_scratch == nullptr) {
+        for(unsigned numaInd=0; numaInd<m_map.getMapNumaCnt(); ++numaInd) {
+            const auto numaNode = static_cast<int>(m_exp.getNumaList()[numaInd]);
+            const MapNuma &numa = m_map.getMapNuma(numaInd);
+            for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
+                for(const auto &[ptr, bytes] : numa.getLine(lineInd).getBuffers()) {
+                    res.addRange("map lines", ptr, bytes, numaNode);
+                }
+            }
+        }
+    }
+
+    for(unsigned cpuInd=0; cpuInd<m_exp.getCpuCnt(); ++cpuInd) {
+        const WorkerType &worker = *m_workers[cpuInd];
+        if(worker.getNumaNode() == std::numeric_limits<unsigned>::max()) {
+            continue;
+        }
+        const auto numaNode = static_cast<int>(worker.getNumaNode());
+        for(const auto &[ptr, bytes] : worker.getQueueMemory()) {
+            res.addRange("worker queues", ptr, bytes, numaNode);
+        }
+        // the first worker runs on this thread
+        const auto [ptr, bytes] = (cpuInd == 0) ? Utils::getThisThreadStack() : worker.getStackMemory();
+        res.addRange("worker stacks", ptr, bytes, numaNode);
+    }
+
+    return res;
 }
 
 std::vector<std::uint64_t> Simulation::getAvgFreqPerWorker() const {
     std::vector<std::uint64_t> res(m_exp.getCpuCnt());
     for(unsigned i=0; i<m_exp.getCpuCnt(); ++i) {
-        res[i] = m_workers[i]->getAvgFreq();
+        if(m_barrier) {
+            // the Worker is still running its SteppingTask
+            const StepStats &stats = m_stepStats[i];
+            res[i] = (stats.runDuration.count() == 0) ? 0 : 
+                     stats.sumFreq/static_cast<std::uint64_t>(stats.runDuration.count());
+        } else {
+            res[i] = m_workers[i]->getAvgFreq();
+        }
     }
     return res;
 }
 
 std::uint64_t Simulation::getAvgFreq() const {
-    std::uint64_t freqSum{0};
-    for(unsigned i=0; i<m_exp.getCpuCnt(); ++i) {
-        freqSum += m_workers[i]->getAvgFreq();
-    }
+    std::vector<std::uint64_t> freq = getAvgFreqPerWorker();
+    std::uint64_t freqSum = std::accumulate(freq.begin(), freq.end(), std::uint64_t{0});
     return freqSum / m_exp.getCpuCnt();
 }
 
@@ -0,0 +1,322 @@
+#include "wator/simulation_bitboard_worker.hpp"
+#include "wator/map_line_bitboard.hpp"
+
+#include <array>
+#include <cassert>
+#include <vector>
+
+namespace {
+    using Word = WaTor::MapLineBitboard::Word;
+    using WaTor::MapLineBitboard;
+
+    constexpr unsigned WORD_BITS = MapLineBitboard::WORD_BITS;
+
+    // dst[x] = src[(x+1) % width], src and dst may be the same
+    void shiftToLower(const Word *src, Word *dst, unsigned words, unsigned width) {
+        const Word wrap = src[0] & 1U;
+        for(unsigned i=0; i+1<words; ++i) {
+            dst[i] = (src[i] >> 1U) | (src[i+1] << (WORD_BITS-1));
+        }
+        dst[words-1] = (src[words-1] >> 1U) | (wrap << ((width-1) % WORD_BITS));
+    }
+
+    // dst[x] = src[(x-1+width) % width], src and dst may be the same
+    void shiftToHigher(const Word *src, Word *dst, unsigned words, unsigned width, Word lastWordMask) {
+        const Word wrap = (src[words-1] >> ((width-1) % WORD_BITS)) & 1U;
+        for(unsigned i=words-1; i>0; --i) {
+            dst[i] = (src[i] << 1U) | (src[i-1] >> (WORD_BITS-1));
+        }
+        dst[0] = (src[0] << 1U) | wrap;
+        dst[words-1] &= lastWordMask;
+    }
+
+    // bit sliced counters, the counter is stored in planes
+    // [firstPlane, firstPlane+bits) of a row with wpr words per plane
+
+    // mask of the cells with counter >= val
+    Word counterGe(const Word *row, unsigned wpr, unsigned word,
+                   unsigned firstPlane, unsigned bits, unsigned val) {
+        Word greater = 0;
+        Word equal = ~Word{0};
+        for(unsigned b=bits; b-- > 0; ) {
+            const Word plane = row[(firstPlane+b)*wpr + word];
+            if(((val >> b) & 1U) != 0) {
+                equal &= plane;
+            } else {
+                greater |= equal & plane;
+                equal &= ~plane;
+            }
+        }
+        return greater | equal;
+    }
+
+    // counter += 1 for the cells in mask
+    void counterInc(Word *row, unsigned wpr, unsigned word,
+                    unsigned firstPlane, unsigned bits, Word mask) {
+        Word carry = mask;
+        for(unsigned b=0; b<bits && carry != 0; ++b) {
+            Word &plane = row[(firstPlane+b)*wpr + word];
+            const Word newCarry = plane & carry;
+            plane ^= carry;
+            carry = newCarry;
+        }
+    }
+
+    // counter = 0 for the cells in mask
+    void counterClear(Word *row, unsigned wpr, unsigned word,
+                      unsigned firstPlane, unsigned bits, Word mask) {
+        for(unsigned b=0; b<bits; ++b) {
+            row[(firstPlane+b)*wpr + word] &= ~mask;
+        }
+    }
+
+    // picks one of the available directions for every cell,
+    // rnd selects one of the 8 orders (the 4 rotations of 0,1,2,3 and
+    // the 4 rotations of 3,2,1,0) and the first available direction in
+    // this order is chosen, for 1, 2 or 4 available directions
+    // every direction is equally likely
+    std::array<Word, 4> chooseDir(const std::array<Word, 4> &avail,
+                                  const std::array<Word, 3> &rnd) {
+        std::array<Word, 4> res = {0, 0, 0, 0};
+        for(unsigned order=0; order<8; ++order) {
+            Word sel = ~Word{0};
+            for(unsigned b=0; b<3; ++b) {
+                sel &= ((order >> b) & 1U) != 0 ? rnd[b] : ~rnd[b]; // NOLINT
+            }
+            const unsigned first = order & 3U;
+            const bool reversed = (order & 4U) != 0;
+            Word taken = 0;
+            for(unsigned j=0; j<4; ++j) {
+                const unsigned dir = (reversed ? first - j : first + j) & 3U;
+                res[dir] |= sel & avail[dir] & ~taken; // NOLINT
+                taken |= avail[dir]; // NOLINT
+            }
+        }
+        return res;
+    }
+}
+
+namespace WaTor {
+
+    SimulationBitboardWorker::SimulationBitboardWorker(MapBitboard &map, unsigned numaInd,
+            unsigned lineInd, const Rules &rules, unsigned seed, std::uint64_t chronon)
+        : m_map(map), m_rules(rules), m_rng({seed, 0}),
+          m_numaInd(numaInd), m_lineInd(lineInd), m_chronon(chronon),
+          m_parity(((chronon % 2) != 0) ? ~Word{0} : 0), // NOLINT
+          m_firstRow(map.getLineFirstRow(numaInd, lineInd)) {
+    }
+
+    void SimulationBitboardWorker::randomWords(unsigned posy, unsigned wordInd, 
+                                               std::array<Word, 3> &res) const {
+        // two blocks of 128 bits, the last 64 bits are not used
+        const auto chronLow = static_cast<std::uint32_t>(m_chronon);
+        const auto chronHigh = static_cast<std::uint32_t>(m_chronon >> 32U);
+        const RandomEngine::counter_type first = m_rng({2*wordInd, m_firstRow + posy, chronLow, chronHigh});
+        const RandomEngine::counter_type second = m_rng({2*wordInd+1, m_firstRow + posy, chronLow, chronHigh});
+        res[0] = (Word{first[0]} << 32U) | first[1];
+        res[1] = (Word{first[2]} << 32U) | first[3];
+        res[2] = (Word{second[0]} << 32U) | second[1];
+    }
+
+    // up, cur, down - the rows above, the current and bellow
+    template<bool isShark>
+    void SimulationBitboardWorker::stepRow(MapLineBitboard &line, Word *up, Word *cur, Word *down,
+                                           const RowScratch &scr) {
+        constexpr unsigned entPlane = isShark ? MapLineBitboard::SHARK_PLANE : MapLineBitboard::FISH_PLANE;
+        constexpr unsigned FISH = MapLineBitboard::FISH_PLANE;
+        constexpr unsigned SHARK = MapLineBitboard::SHARK_PLANE;
+        constexpr unsigned STAMP = MapLineBitboard::STAMP_PLANE;
+        constexpr unsigned AGE = MapLineBitboard::AGE_PLANE;
+        constexpr unsigned AGE_BITS = MapLineBitboard::AGE_BITS;
+        constexpr unsigned LAST_ATE = MapLineBitboard::LAST_ATE_PLANE;
+        constexpr unsigned LAST_ATE_BITS = MapLineBitboard::LAST_ATE_BITS;
+
+        const unsigned wpr = line.getWordsPerRow();
+        const unsigned width = line.getWidth();
+        const Word lastMask = line.getLastWordMask();
+        auto plane = [wpr](Word *row, unsigned pln) { return row + static_cast<std::size_t>(pln)*wpr; };
+        auto validMask = [wpr, lastMask](unsigned word) { return (word+1 == wpr) ? lastMask : ~Word{0}; };
+
+        // entities not yet updated in this chronon
+        Word anyAct = 0;
+        for(unsigned i=0; i<wpr; ++i) {
+            scr.act[i] = plane(cur, entPlane)[i] & (plane(cur, STAMP)[i] ^ m_parity);
+            anyAct |= scr.act[i];
+        }
+        if(anyAct == 0) {
+            return;
+        }
+
+        // neighbour masks, directions: 0 - up, 1 - right, 2 - down, 3 - left
+        for(unsigned i=0; i<wpr; ++i) {
+            scr.tmp1[i] = plane(cur, FISH)[i] | plane(cur, SHARK)[i];
+            scr.waterDir[0][i] = ~(plane(up, FISH)[i] | plane(up, SHARK)[i]) & validMask(i);
+            scr.waterDir[2][i] = ~(plane(down, FISH)[i] | plane(down, SHARK)[i]) & validMask(i);
+            scr.fishDir[0][i] = plane(up, FISH)[i];
+            scr.fishDir[2][i] = plane(down, FISH)[i];
+        }
+        shiftToLower(scr.tmp1, scr.tmp2, wpr, width);
+        shiftToHigher(scr.tmp1, scr.tmp1, wpr, width, lastMask);
+        for(unsigned i=0; i<wpr; ++i) {
+            scr.waterDir[1][i] = ~scr.tmp2[i] & validMask(i);
+            scr.waterDir[3][i] = ~scr.tmp1[i] & validMask(i);
+        }
+        if constexpr(isShark) {
+            shiftToLower(plane(cur, FISH), scr.fishDir[1], wpr, width);
+            shiftToHigher(plane(cur, FISH), scr.fishDir[3], wpr, width, lastMask);
+        }
+
+        // choosing directions
+        const unsigned starveTime = m_rules.getSharkStarveTime();
+        for(unsigned i=0; i<wpr; ++i) {
+            const Word act = scr.act[i];
+            std::array<Word, 4> avail; // NOLINT
+            if constexpr(isShark) {
+                const Word anyFish = scr.fishDir[0][i] | scr.fishDir[1][i] |
+                                     scr.fishDir[2][i] | scr.fishDir[3][i];
+                for(unsigned d=0; d<4; ++d) {
+                    avail[d] = act & (scr.fishDir[d][i] | (scr.waterDir[d][i] & ~anyFish)); // NOLINT
+                }
+                scr.starve[i] = act & counterGe(cur, wpr, i, LAST_ATE, LAST_ATE_BITS, starveTime);
+                // these sharks could not eat, they die without moving
+                const Word dying = scr.starve[i] & ~anyFish;
+                for(unsigned d=0; d<4; ++d) {
+                    avail[d] &= ~dying; // NOLINT
+                }
+            } else {
+                for(unsigned d=0; d<4; ++d) {
+                    avail[d] = act & scr.waterDir[d][i]; // NOLINT
+                }
+            }
+
+            const std::array<Word, 4> moves = chooseDir(avail, {scr.rnd[0][i], scr.rnd[1][i], scr.rnd[2][i]});
+            for(unsigned d=0; d<4; ++d) {
+                scr.moveDir[d][i] = moves[d]; // NOLINT
+            }
+        }
+
+        // two entities could target the same cell only with moving right and left,
+        // the one moving right wins and the other stays
+        shiftToHigher(scr.moveDir[1], scr.targetRight, wpr, width, lastMask);
+        shiftToLower(scr.moveDir[3], scr.targetLeft, wpr, width);
+        for(unsigned i=0; i<wpr; ++i) {
+            scr.tmp1[i] = scr.targetRight[i] & scr.targetLeft[i];
+        }
+        shiftToHigher(scr.tmp1, scr.tmp1, wpr, width, lastMask);
+        for(unsigned i=0; i<wpr; ++i) {
+            scr.moveDir[3][i] &= ~scr.tmp1[i];
+        }
+        shiftToLower(scr.moveDir[3], scr.targetLeft, wpr, width);
+
+        // counters
+        const unsigned breedTime = isShark ? m_rules.getSharkBreedTime() : m_rules.getFishBreedTime();
+        for(unsigned i=0; i<wpr; ++i) {
+            const Word act = scr.act[i];
+            scr.clearSrc[i] = scr.targetRight[i] | scr.targetLeft[i];
+            if(act == 0) {
+                continue;
+            }
+            const Word movers = scr.moveDir[0][i] | scr.moveDir[1][i] |
+                                scr.moveDir[2][i] | scr.moveDir[3][i];
+            Word alive = act;
+
+            if constexpr(isShark) {
+                Word ate = 0;
+                for(unsigned d=0; d<4; ++d) {
+                    ate |= scr.moveDir[d][i] & scr.fishDir[d][i]; // NOLINT
+                }
+                const Word dies = scr.starve[i] & ~ate;
+                assert((dies & movers) == 0);
+                alive &= ~dies;
+
+                counterClear(cur, wpr, i, LAST_ATE, LAST_ATE_BITS, ate);
+                counterInc(cur, wpr, i, LAST_ATE, LAST_ATE_BITS, alive & ~ate);
+
+                // RIP sharks
+                for(unsigned pln=0; pln<MapLineBitboard::PLANE_CNT; ++pln) {
+                    plane(cur, pln)[i] &= ~dies;
+                }
+            }
+
+            const Word breed = alive & counterGe(cur, wpr, i, AGE, AGE_BITS, breedTime);
+            counterInc(cur, wpr, i, AGE, AGE_BITS, alive & ~breed);
+            // the moving parent and the child both start from age 0
+            counterClear(cur, wpr, i, AGE, AGE_BITS, breed & movers);
+
+            plane(cur, STAMP)[i] = (plane(cur, STAMP)[i] & ~alive) | (m_parity & alive);
+            scr.clearSrc[i] |= movers & ~breed;
+        }
+
+        // moving, targets are always water or fish which are eaten
+        for(unsigned pln=0; pln<MapLineBitboard::PLANE_CNT; ++pln) {
+            Word *curPln = plane(cur, pln);
+            Word *upPln = plane(up, pln);
+            Word *downPln = plane(down, pln);
+            for(unsigned i=0; i<wpr; ++i) {
+                upPln[i] = (upPln[i] & ~scr.moveDir[0][i]) | (curPln[i] & scr.moveDir[0][i]);
+                downPln[i] = (downPln[i] & ~scr.moveDir[2][i]) | (curPln[i] & scr.moveDir[2][i]);
+                scr.tmp1[i] = curPln[i] & scr.moveDir[1][i];
+                scr.tmp2[i] = curPln[i] & scr.moveDir[3][i];
+            }
+            shiftToHigher(scr.tmp1, scr.tmp1, wpr, width, lastMask);
+            shiftToLower(scr.tmp2, scr.tmp2, wpr, width);
+            for(unsigned i=0; i<wpr; ++i) {
+                curPln[i] = (curPln[i] & ~scr.clearSrc[i]) | scr.tmp1[i] | scr.tmp2[i];
+            }
+        }
+    }
+
+    void SimulationBitboardWorker::operator()() {
+        MapLineBitboard &line = m_map.getLine(m_numaInd, m_lineInd);
+        MapLineBitboard &prevLine = m_map.getPrevLine(m_numaInd, m_lineInd);
+        MapLineBitboard &nextLine = m_map.getNextLine(m_numaInd, m_lineInd);
+
+        const unsigned height = line.getHeight();
+        const unsigned wpr = line.getWordsPerRow();
+
+        assert(height > 1 && line.getWidth() > 2);
+
+        std::vector<Word> buffer(static_cast<std::size_t>(RowScratch::BUFFER_CNT)*wpr);
+        Word *next = buffer.data();
+        auto take = [&next, wpr]() { Word *res = next; next += wpr; return res; };
+        RowScratch scr{}; // NOLINT
+        scr.act = take();
+        for(unsigned d=0; d<4; ++d) {
+            scr.fishDir[d] = take(); // NOLINT
+            scr.waterDir[d] = take(); // NOLINT
+            scr.moveDir[d] = take(); // NOLINT
+        }
+        for(Word* &rnd : scr.rnd) {
+            rnd = take();
+        }
+        scr.starve = take();
+        scr.clearSrc = take();
+        scr.targetRight = take();
+        scr.targetLeft = take();
+        scr.tmp1 = take();
+        scr.tmp2 = take();
+        assert(next == buffer.data() + buffer.size());
+
+        for(unsigned posy=0; posy<height; ++posy) {
+            Word *up = (posy == 0) ? prevLine.getRow(prevLine.getHeight()-1) : line.getRow(posy-1);
+            Word *cur = line.getRow(posy);
+            Word *down = (posy+1 == height) ? nextLine.getRow(0) : line.getRow(posy+1);
+
+            const Word *fish = cur + static_cast<std::size_t>(MapLineBitboard::FISH_PLANE)*wpr;
+            const Word *shark = cur + static_cast<std::size_t>(MapLineBitboard::SHARK_PLANE)*wpr;
+            const Word *stamp = cur + static_cast<std::size_t>(MapLineBitboard::STAMP_PLANE)*wpr;
+            for(unsigned i=0; i<wpr; ++i) {
+                if(((fish[i] | shark[i]) & (stamp[i] ^ m_parity)) != 0) {
+                    std::array<Word, 3> words; // NOLINT
+                    randomWords(posy, i, words);
+                    for(unsigned k=0; k<words.size(); ++k) {
+                        scr.rnd[k][i] = words[k]; // NOLINT
+                    }
+                }
+            }
+
+            stepRow<true>(line, up, cur, down, scr);
+            stepRow<false>(line, up, cur, down, scr);
+        }
+    }
+}
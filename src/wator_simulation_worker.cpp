@@ -1,97 +1,335 @@
+// the tile kernel, compiled once for every KernelIsa: 
+// wator_simulation_worker_avx2.cpp and wator_simulation_worker_avx512.cpp 
+// define WATOR_KERNEL_ISA_* and include this file
+
 #include "utils.hpp"
 #include "wator/entity.hpp"
+#include "wator/kernel_isa.hpp"
 #include "wator/rules.hpp"
+#include "wator/rules_policy.hpp"
 #include "wator/simulation_worker.hpp"
 #include "wator/tile.hpp"
-#include <limits>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <tuple>
+
+#include <config.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// everything included above is compiled for the instruction set of the 
+// build, so the inline functions shared with the other translation units 
+// never contain the instructions of the variant
+#if defined(WATOR_KERNEL_ISA_AVX512)
+#define WATOR_KERNEL_ISA KernelIsa::AVX512
+#ifdef WATOR_KERNEL_DISPATCH
+#pragma GCC target("avx2,bmi,bmi2,popcnt,avx512f,avx512bw")
+#define WATOR_KERNEL_AVX2
+#define WATOR_KERNEL_AVX512BW
+#endif
+#elif defined(WATOR_KERNEL_ISA_AVX2)
+#define WATOR_KERNEL_ISA KernelIsa::AVX2
+#ifdef WATOR_KERNEL_DISPATCH
+#pragma GCC target("avx2,bmi,bmi2,popcnt")
+#define WATOR_KERNEL_AVX2
+#endif
+#else
+#define WATOR_KERNEL_ISA KernelIsa::GENERIC
+#endif
+
+// in C++ the pragma does not define __AVX2__ and the others
+#if defined(__AVX2__) && !defined(WATOR_KERNEL_AVX2)
+#define WATOR_KERNEL_AVX2
+#endif
+#if defined(__AVX512BW__) && !defined(WATOR_KERNEL_AVX512BW)
+#define WATOR_KERNEL_AVX512BW
+#endif
 
 namespace {
-    unsigned fastMod(unsigned num, unsigned denum) {
-        switch(denum) {
-            case 1: return 0;
-            case 2: return num%2;
-            case 3: return num%3;
-            case 4: return num%4;
-            default: assert(0);
+    constexpr unsigned DIR_CNT = 4;
+    // a water and a fish mask of the neighbours, the combinations with a
+    // neighbour in both are never looked up
+    constexpr unsigned NEIGHBOURHOOD_CNT = 1U << (2*DIR_CNT);
+    // the moves are chosen by a random nibble
+    constexpr unsigned RND_CNT = 16;
+    constexpr unsigned NO_DIR = DIR_CNT;
+
+    // returns the (rnd % popcount(mask))-th set bit of a 4 bit direction mask,
+    // NO_DIR if mask is empty
+    constexpr unsigned selectDir(unsigned mask, unsigned rnd) {
+        unsigned dirsFilled{0};
+        for(unsigned i=0; i<DIR_CNT; ++i) {
+            dirsFilled += (mask >> i) & 1U;
+        }
+        if(dirsFilled == 0) {
+            return NO_DIR;
         }
-    }
-}
 
-namespace WaTor {
+        unsigned skip = rnd % dirsFilled;
+        for(unsigned i=0; i<DIR_CNT; ++i) {
+            if(((mask >> i) & 1U) != 0 && skip-- == 0) {
+                return i;
+            }
+        }
+        return NO_DIR;
+    }
 
-    SimulationWorker::SimulationWorker(Map &map, unsigned numaInd, unsigned lineInd, 
-            const Rules &rules, unsigned seed) 
-        : m_map(map), m_rules(rules), m_rng((seed != 0) ? seed : 1337), 
-        m_numaInd(numaInd), m_lineInd(lineInd) { // NOLINT
+    // bit d is set for water in direction d, bit d+4 for fish
+    constexpr unsigned neighbourhoodIndex(unsigned waterMask, unsigned fishMask) {
+        return waterMask | (fishMask << DIR_CNT);
     }
-    
-    unsigned SimulationWorker::findTileFish(const std::array<Map::Cordinate, 4> &dirs, 
-                                                unsigned rnd) const {
-        std::array<unsigned, 4> waterDirs; // NOLINT
-        unsigned waterDirsFilled{0};
-
-        for(unsigned i=0; i<dirs.size(); ++i) {
-            if(m_map.get(dirs[i]).getEntity() == Entity::WATER) {
-                waterDirs[waterDirsFilled++] = i; 
+
+    // bits 0-2 - direction of a fish, bits 3-5 - direction of a shark,
+    // bit 6 - the shark eats
+    using Move = std::uint8_t;
+    constexpr unsigned MOVE_SHARK_SHIFT = 3;
+    constexpr unsigned MOVE_DIR_MASK = 0x7U;
+    constexpr unsigned MOVE_ATE_BIT = 6;
+
+    using MoveTable = std::array<std::array<Move, RND_CNT>, NEIGHBOURHOOD_CNT>;
+
+    constexpr MoveTable makeMoveTable() {
+        MoveTable res{};
+        for(unsigned ind=0; ind<NEIGHBOURHOOD_CNT; ++ind) {
+            const unsigned waterMask = ind & ((1U << DIR_CNT) - 1);
+            const unsigned fishMask = ind >> DIR_CNT;
+            for(unsigned rnd=0; rnd<RND_CNT; ++rnd) {
+                // sharks prefer eating
+                const bool ate = fishMask != 0;
+                const unsigned fishDir = selectDir(waterMask, rnd);
+                const unsigned sharkDir = selectDir(ate ? fishMask : waterMask, rnd);
+                res[ind][rnd] = static_cast<Move>(fishDir | (sharkDir << MOVE_SHARK_SHIFT) | // NOLINT
+                                                  (static_cast<unsigned>(ate) << MOVE_ATE_BIT));
             }
         }
+        return res;
+    }
 
-        if(waterDirsFilled > 0) {
-            unsigned resInd = fastMod(rnd, waterDirsFilled);
-            return waterDirs[resInd];
+    constexpr MoveTable MOVE_TABLE = makeMoveTable();
+
+    static_assert(MOVE_TABLE[neighbourhoodIndex(0x0U, 0x0U)][0] == (NO_DIR | (NO_DIR << MOVE_SHARK_SHIFT)), 
+                  "surrounded by sharks");
+    static_assert(MOVE_TABLE[neighbourhoodIndex(0x5U, 0x2U)][3] == (2U | (1U << MOVE_SHARK_SHIFT) | (1U << MOVE_ATE_BIT)),
+                  "fish goes down, shark eats right");
+
+    constexpr unsigned BLOCK_BITS = 64;
+    static_assert(BLOCK_BITS == WaTor::MapLine::BLOCK_WIDTH, "a block is classified at once");
+
+    // bit i of water/fish/parity is set if tiles[i] is water/fish/has parity 1,
+    // cnt <= BLOCK_BITS
+    void classifyTiles(const WaTor::Tile *tiles, unsigned cnt, 
+                       std::uint64_t &water, std::uint64_t &fish, std::uint64_t &parity) {
+        static_assert(WaTor::Tile::RAW_PARITY_MASK == 0x80U, "parity is read with movemask");
+        assert(cnt <= BLOCK_BITS);
+        const auto *raw = reinterpret_cast<const std::uint8_t*>(tiles); // NOLINT
+        std::uint64_t resWater = 0, resFish = 0, resParity = 0;
+        unsigned pos = 0;
+
+#if defined(WATOR_KERNEL_AVX512BW)
+        {
+            // masked load, never touches tiles past cnt
+            const __mmask64 valid = (cnt == BLOCK_BITS) ? ~__mmask64{0} : ((__mmask64{1} << cnt) - 1);
+            const __m512i vec = _mm512_maskz_loadu_epi8(valid, raw);
+            const __mmask64 isWater = _mm512_cmpeq_epi8_mask(vec, _mm512_setzero_si512());
+            const __mmask64 noLastAte = _mm512_testn_epi8_mask(vec, 
+                    _mm512_set1_epi8(static_cast<char>(WaTor::Tile::RAW_LAST_ATE_MASK)));
+            resWater = isWater & valid;
+            resFish = noLastAte & ~isWater & valid;
+            resParity = _mm512_movepi8_mask(vec) & valid;
+            pos = cnt;
         }
+#endif
+#if defined(WATOR_KERNEL_AVX2)
+        for(; pos+32 <= cnt; pos += 32) {
+            const __m256i vec = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(raw + pos)); // NOLINT
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i lastAte = _mm256_and_si256(vec, 
+                    _mm256_set1_epi8(static_cast<char>(WaTor::Tile::RAW_LAST_ATE_MASK)));
+            const auto isWater = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(vec, zero)));
+            const auto noLastAte = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lastAte, zero)));
+            const auto isParity = static_cast<std::uint32_t>(_mm256_movemask_epi8(vec));
+            resWater |= std::uint64_t{isWater} << pos;
+            resFish |= std::uint64_t{noLastAte & ~isWater} << pos;
+            resParity |= std::uint64_t{isParity} << pos;
+        }
+#endif
+#if defined(__SSE2__)
+        for(; pos+16 <= cnt; pos += 16) {
+            const __m128i vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(raw + pos)); // NOLINT
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i lastAte = _mm_and_si128(vec, 
+                    _mm_set1_epi8(static_cast<char>(WaTor::Tile::RAW_LAST_ATE_MASK)));
+            const auto isWater = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(vec, zero)));
+            const auto noLastAte = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(lastAte, zero)));
+            const auto isParity = static_cast<std::uint32_t>(_mm_movemask_epi8(vec));
+            resWater |= std::uint64_t{isWater} << pos;
+            resFish |= std::uint64_t{noLastAte & ~isWater} << pos;
+            resParity |= std::uint64_t{isParity} << pos;
+        }
+#endif
+        for(; pos < cnt; ++pos) {
+            const WaTor::Tile &tile = tiles[pos]; // NOLINT
+            const WaTor::Entity ent = tile.getEntity();
+            resWater |= std::uint64_t{ent == WaTor::Entity::WATER} << pos;
+            resFish |= std::uint64_t{ent == WaTor::Entity::FISH} << pos;
+            resParity |= std::uint64_t{(tile.getRaw() & WaTor::Tile::RAW_PARITY_MASK) != 0} << pos;
+        }
+
+        water = resWater;
+        fish = resFish;
+        parity = resParity;
+    }
+}
 
-        // no free cells, we stay here!
-        return std::numeric_limits<unsigned>::max();
+namespace WaTor {
+
+    template<class RulesPolicy, KernelIsa isa>
+    BasicSimulationWorker<RulesPolicy, isa>::BasicSimulationWorker(Map &map, unsigned numaInd, unsigned lineInd, 
+            const Rules &rules, unsigned seed, std::uint64_t chronon, unsigned stripWidth) 
+        : m_map(map), m_rules(rules), m_rng({seed, 0}), 
+        m_numaInd(numaInd), m_lineInd(lineInd), m_chronon(chronon), m_parity((chronon % 2) != 0), 
+        m_entityPlane(map.getMapNuma(numaInd).getLine(lineInd).hasEntityPlane()),
+        m_firstRow(map.getLineFirstRow(numaInd, lineInd)),
+        m_stripBlocks((stripWidth == 0) ? map.getMapNuma(numaInd).getLine(lineInd).getBlockCnt() 
+                                        : static_cast<unsigned>((std::size_t{stripWidth} + BLOCK_BITS - 1)/BLOCK_BITS)),
+        m_line(map.getMapNuma(numaInd).getLine(lineInd)),
+        m_prevLine(map.getPrevLine(numaInd, lineInd)), 
+        m_nextLine(map.getNextLine(numaInd, lineInd)) { // NOLINT
     }
 
-    unsigned SimulationWorker::findTileShark(const std::array<Map::Cordinate, 4> &dirs, 
-                                                unsigned rnd, bool& ate) const {
-        std::array<unsigned, 4> waterDirs; // NOLINT
-        unsigned waterDirsFilled{0};
-        std::array<unsigned, 4> fishDirs; // NOLINT
-        unsigned fishDirsFilled{0};
-
-        for(unsigned i=0; i<dirs.size(); ++i) {
-            Entity ent = m_map.get(dirs[i]).getEntity();
-            if(ent == Entity::FISH) {
-                fishDirs[fishDirsFilled++] = i;
-            } else if(ent == Entity::WATER) {
-                waterDirs[waterDirsFilled++] = i;
+    template<class RulesPolicy, KernelIsa isa>
+    template<unsigned horLevel>
+    Tile& BasicSimulationWorker<RulesPolicy, isa>::getNeighbour(Tile *cur, unsigned posy, unsigned posx, unsigned dir) {
+        switch(dir) {
+            case 0: 
+                return *(cur - m_line.getRowStride(posx)); // NOLINT
+            case 1:
+                // wraps around inside the same row, the next panel is 
+                // stored after all rows of this one
+                if(horLevel == 2) { return m_line.get(posy, 0); }
+                if(m_line.isPanelBegin(posx+1)) { return m_line.get(posy, posx+1); }
+                return cur[1]; // NOLINT
+            case 2: 
+                return *(cur + m_line.getRowStride(posx)); // NOLINT
+            case 3:
+                if(horLevel == 0) { return m_line.get(posy, m_line.getWidth()-1); }
+                if(m_line.isPanelBegin(posx)) { return m_line.get(posy, posx-1); }
+                return cur[-1]; // NOLINT
+            default: 
+                assert(0);
+                return *cur;
+        }
+    }
+    
+    template<class RulesPolicy, KernelIsa isa>
+    template<unsigned horLevel>
+    void BasicSimulationWorker<RulesPolicy, isa>::getNeighbourMasks(Tile *cur, unsigned posy, unsigned posx, 
+                                                                    unsigned &water, unsigned &fish) {
+        water = 0; fish = 0;
+        for(unsigned i=0; i<DIR_CNT; ++i) {
+            const Entity ent = getNeighbour<horLevel>(cur, posy, posx, i).getEntity();
+            if(ent == Entity::WATER) {
+                water |= 1U << i;
+            } else if(ent == Entity::FISH) {
+                fish |= 1U << i;
             }
         }
+    }
 
-        if(fishDirsFilled > 0) {
-            unsigned resInd = fastMod(rnd, fishDirsFilled);
-            ate = true;
-            return fishDirs[resInd];
-        }
-        if(waterDirsFilled > 0) {
-            unsigned resInd = fastMod(rnd, waterDirsFilled);
-            ate = false;
-            return waterDirs[resInd];
+    template<class RulesPolicy, KernelIsa isa>
+    unsigned BasicSimulationWorker<RulesPolicy, isa>::randomNibble(unsigned posy, unsigned posx) {
+        static_assert(4*RND_BLOCK_WIDTH == 32*std::tuple_size_v<RandomEngine::counter_type>, 
+                      "a nibble for every tile of the block");
+        // the entities of a row are updated left to right, so most of the
+        // time the block is already generated
+        const unsigned block = posx / RND_BLOCK_WIDTH;
+        if(posy != m_rndPosy || block != m_rndBlock) {
+            m_rndPosy = posy;
+            m_rndBlock = block;
+            m_rndBits = m_rng({block, m_firstRow + posy, 
+                               static_cast<std::uint32_t>(m_chronon), 
+                               static_cast<std::uint32_t>(m_chronon >> 32U)});
         }
+        const unsigned bit = 4*(posx % RND_BLOCK_WIDTH);
+        return (m_rndBits[bit/32] >> (bit%32)) & (RND_CNT-1); // NOLINT
+    }
+
+    template<class RulesPolicy, KernelIsa isa>
+    unsigned BasicSimulationWorker<RulesPolicy, isa>::findTileFish(unsigned neighbourhood, unsigned rnd) {
+        assert(neighbourhood < NEIGHBOURHOOD_CNT && rnd < RND_CNT);
+        // if there are no free cells, we stay here! (NO_DIR)
+        return MOVE_TABLE[neighbourhood][rnd] & MOVE_DIR_MASK; // NOLINT
+    }
 
-        // no free cells, we stay here!
-        ate = false;
-        return std::numeric_limits<unsigned>::max();
+    template<class RulesPolicy, KernelIsa isa>
+    unsigned BasicSimulationWorker<RulesPolicy, isa>::findTileShark(unsigned neighbourhood, unsigned rnd, bool& ate) {
+        assert(neighbourhood < NEIGHBOURHOOD_CNT && rnd < RND_CNT);
+        const unsigned move = MOVE_TABLE[neighbourhood][rnd]; // NOLINT
+        ate = ((move >> MOVE_ATE_BIT) & 1U) != 0;
+        // if there are no free cells, we stay here! (NO_DIR)
+        return (move >> MOVE_SHARK_SHIFT) & MOVE_DIR_MASK;
     }
 
 
     //0 - x=0
     //1 - mid
-    //2 - x=height-1
-    template<bool isBotLvl, unsigned vertLevel, bool isShark>
-    unsigned SimulationWorker::tickEntity( const Map::Cordinate &cur, 
-            const std::array<Map::Cordinate, 4> &dirs) {
-        static_assert(0 <= vertLevel && vertLevel <=2 , "Invalid argument");
-        assert(isBotLvl == (cur.posy() + 1 == m_map.getMapLineHeight(cur.numaInd(), cur.lineInd())));
-        assert((vertLevel == 0) == (cur.posx() == 0));
-        assert((vertLevel == 2) == (cur.posx() + 1 == m_map.getMapLineWidth(cur.numaInd(), cur.lineInd())));
-        constexpr bool isFirstCol = (vertLevel == 0);
-        constexpr bool isLastCol = (vertLevel == 2);
+    //2 - x=width-1
+    template<class RulesPolicy, KernelIsa isa>
+    template<unsigned horLevel>
+    void BasicSimulationWorker<RulesPolicy, isa>::markOccupied(unsigned posy, unsigned posx, unsigned dir) {
+        switch(dir) {
+            case 0:
+                // the halo rows are handled by storeHalo
+                if(posy == 0) { return; }
+                --posy;
+                break;
+            case 1:
+                posx = (horLevel == 2) ? 0 : posx+1;
+                break;
+            case 2:
+                if(posy+1 == m_line.getHeight()) { return; }
+                ++posy;
+                break;
+            case 3:
+                posx = (horLevel == 0) ? m_line.getWidth()-1 : posx-1;
+                break;
+            default: assert(0);
+        }
+        m_line.setBlockOccupied(posy, posx / MapLine::BLOCK_WIDTH);
+    }
+
+    template<class RulesPolicy, KernelIsa isa>
+    template<unsigned horLevel>
+    void BasicSimulationWorker<RulesPolicy, isa>::setPlaneEntity(unsigned posy, unsigned posx, 
+                                                                 unsigned dir, Entity ent) {
+        if(!m_entityPlane) {
+            return;
+        }
+        // the halo rows of the plane are written back by storeHalo
+        MapLine::EntityWord *row = m_line.getEntityRowPtr(posy);
+        const unsigned stride = m_line.getEntityRowWords();
+        switch(dir) {
+            case 0: row -= stride; break; // NOLINT
+            case 1: posx = (horLevel == 2) ? 0 : posx+1; break;
+            case 2: row += stride; break; // NOLINT
+            case 3: posx = (horLevel == 0) ? m_line.getWidth()-1 : posx-1; break;
+            case NO_DIR: break;
+            default: assert(0);
+        }
+        MapLine::setEntity(row, posx, ent);
+    }
+
+    template<class RulesPolicy, KernelIsa isa>
+    template<unsigned horLevel, bool isShark>
+    void BasicSimulationWorker<RulesPolicy, isa>::tickEntity(Tile *cur, unsigned posy, unsigned posx,
+                                                        unsigned waterMask, unsigned fishMask) {
+        static_assert(0 <= horLevel && horLevel <=2 , "Invalid argument");
         constexpr bool isFish = !isShark;
-        Tile &curTile = m_map.get(cur);
+        Tile &curTile = *cur;
+        assert(curTile.getParity() == m_parity);
 
         unsigned breedTime;
         if constexpr(isFish) {
@@ -102,6 +340,9 @@ namespace WaTor {
             breedTime = m_rules.getSharkBreedTime();
         }
 
+        // updated in this chronon, the copy made when moving inherits it
+        curTile.setParity(!m_parity);
+
         bool breeding;
 
         if(curTile.getAge() >= breedTime) {
@@ -111,295 +352,218 @@ namespace WaTor {
             breeding = false;
         }
 
-        unsigned rnd = m_rng.get_bits(4);
+        unsigned rnd = randomNibble(posy, posx);
+        const unsigned neighbourhood = neighbourhoodIndex(waterMask, fishMask);
 
         unsigned nextDir;
 
         if constexpr(isFish) {
-            nextDir = findTileFish(dirs, rnd);
+            nextDir = findTileFish(neighbourhood, rnd);
         } else if constexpr(isShark) {
             bool ate;
-            nextDir = findTileShark(dirs, rnd, ate);
+            nextDir = findTileShark(neighbourhood, rnd, ate);
             if(ate) {
                 curTile.setLastAte(0);
             } else {
                 if(curTile.getLastAte() >= m_rules.getSharkStarveTime()) {
                     // THE SHARK IS DEAD, RIP SHARK
                     curTile.set(Entity::WATER, 0, 0);
-                    return std::numeric_limits<unsigned>::max();
+                    setPlaneEntity<horLevel>(posy, posx, NO_DIR, Entity::WATER);
+                    return;
                 }    
                 curTile.setLastAte(curTile.getLastAte() + 1);
             }
         }
 
-        if(nextDir == std::numeric_limits<unsigned>::max()) {
-            return nextDir;
+        if(nextDir == NO_DIR) {
+            return;
         }
 
-        const Map::Cordinate &newCord{dirs[nextDir]}; // NOLINT
-        Tile &newTile = m_map.get(newCord);
+        Tile &newTile = getNeighbour<horLevel>(cur, posy, posx, nextDir);
         if constexpr(isFish) {
             assert(newTile.getEntity() == Entity::WATER);
         } else if constexpr(isShark) {
             assert(newTile.getEntity() != Entity::SHARK);
         }
         newTile = curTile;
+        markOccupied<horLevel>(posy, posx, nextDir);
+        setPlaneEntity<horLevel>(posy, posx, nextDir, isShark ? Entity::SHARK : Entity::FISH);
 
         if(!breeding) {
             curTile.set(Entity::WATER, 0, 0);
+            setPlaneEntity<horLevel>(posy, posx, NO_DIR, Entity::WATER);
         } else {
             curTile.setAge(0);
             newTile.setAge(0);
         }
-
-        if constexpr (isFirstCol) {
-            if(nextDir == 3) {
-                m_map.getUpdateMask(newCord) = true;
-            }
-        }
-        if constexpr (!isBotLvl) {
-            if(nextDir == 2) {
-                m_map.getUpdateMask(newCord) = true;
-            }
-        }
-        if constexpr (!isLastCol) {
-            if(nextDir == 1) {
-                m_map.getUpdateMask(newCord) = true;
-            }
-        }
-
-        return nextDir;
     }
 
-    template<unsigned horLevel, unsigned vertLevel>
-    void SimulationWorker::updatePosCache(unsigned posy, unsigned posx, PosCache &cache) {
-        if constexpr(vertLevel == 0 || vertLevel == 1 || vertLevel == 4) {
-            cache.pos = m_map.makeCordinate(m_numaInd, m_lineInd, posy, posx);
-            for(unsigned d=0; d<4; ++d) {
-                cache.dirs[d] = m_map.dirHelper(cache.pos, d);
-            }
-        } else {
-            m_map.dirRightFast(cache.dirs[0]);
-            m_map.dirRightFast(cache.dirs[2]);
-            cache.dirs[3] = cache.pos;
-            cache.pos = cache.dirs[1];
-            m_map.dirRightFast(cache.dirs[1]);
-        }
-
-        if constexpr(horLevel != 2) {
-            if constexpr(vertLevel == 0) {
-                if constexpr(horLevel == 0) {
-                    cache.curCache.top = m_map.getTopMaskIter(cache.pos);
-                    cache.neigCache.bot = m_map.getBottomMaskIter(cache.dirs[0]);
-                } else if constexpr(horLevel == 1) {
-                    cache.curCache.top = m_map.getTopMaskIter(cache.pos);
-                } else if constexpr(horLevel == 3) {
-                    cache.curCache.bot = m_map.getBottomMaskIter(cache.pos);
-                } else if constexpr(horLevel == 4) {
-                    cache.curCache.bot = m_map.getBottomMaskIter(cache.pos);
-                    cache.neigCache.top = m_map.getTopMaskIter(cache.dirs[2]);
-                }
-            } else {
-                if constexpr(horLevel == 0) {
-                    ++cache.curCache.top;
-                    ++cache.neigCache.bot;
-                } else if constexpr(horLevel == 1) {
-                    ++cache.curCache.top;
-                } else if constexpr(horLevel == 3) {
-                    ++cache.curCache.bot;
-                } else if constexpr(horLevel == 4) {
-                    ++cache.curCache.bot;
-                    ++cache.neigCache.top;
-                }
-            }
-        }
-        
-        /*
-        if constexpr(vertLevel != 2) {
-            if constexpr(horLevel == 0) {
-                if constexpr(vertLevel == 0) {
-                    cache.curCache.top = m_map.getTopMaskIter(cache.pos);
-                    cache.neigCache.bot = m_map.getBottomMaskIter(cache.dirs[0]);
-                } else if constexpr(vertLevel == 1) {
-                    cache.curCache.top = m_map.getTopMaskIter(cache.pos);
-                } else if constexpr(vertLevel == 3) {
-                    cache.curCache.bot = m_map.getBottomMaskIter(cache.pos);
-                } else if constexpr(vertLevel == 4) {
-                    cache.curCache.bot = m_map.getBottomMaskIter(cache.pos);
-                    cache.neigCache.top = m_map.getTopMaskIter(cache.dirs[2]);
-                }
-            } else {
-                if constexpr(vertLevel == 0) {
-                    ++cache.curCache.top;
-                    ++cache.neigCache.bot;
-                } else if constexpr(vertLevel == 1) {
-                    ++cache.curCache.top;
-                } else if constexpr(vertLevel == 3) {
-                    ++cache.curCache.bot;
-                } else if constexpr(vertLevel == 4) {
-                    ++cache.curCache.bot;
-                    ++cache.neigCache.top;
-                }
-            }
-        }
-        */
-    }
-
-    template<unsigned vertLevel, unsigned horLevel>
-    void SimulationWorker::updateEntity(unsigned posy, unsigned posx, PosCache &cache) {
-        static_assert(0 <= vertLevel && vertLevel < 5, "Invalid vertLevel argument");
-        static_assert(0 <= horLevel && horLevel < 5, "Invalid horLevel argument");
-
-        updatePosCache<vertLevel, horLevel>(posy, posx, cache);
-        const Map::Cordinate &curCord = cache.pos;
-        const std::array<Map::Cordinate, 4>  &dirs = cache.dirs;
-
-        assert((vertLevel == 0) == (curCord.posy() == 0));
-        assert((vertLevel == 1) == (curCord.posy() == 1));
-        assert((vertLevel == 3) == (curCord.posy() == m_map.getMapLineHeight(curCord.numaInd(), curCord.lineInd()) - 2));
-        assert((vertLevel == 4) == (curCord.posy() == m_map.getMapLineHeight(curCord.numaInd(), curCord.lineInd()) - 1));
+    template<class RulesPolicy, KernelIsa isa>
+    template<unsigned horLevel>
+    void BasicSimulationWorker<RulesPolicy, isa>::updateEntity(Tile *cur, unsigned posy, unsigned posx) {
+        static_assert(0 <= horLevel && horLevel < 3, "Invalid horLevel argument");
 
-        assert((horLevel == 0) == (curCord.posx() == 0));
-        assert((horLevel == 1) == (curCord.posx() == 1));
-        assert((horLevel == 3) == (curCord.posx() == m_map.getMapLineWidth(curCord.numaInd(), curCord.lineInd()) - 2));
-        assert((horLevel == 4) == (curCord.posx() == m_map.getMapLineWidth(curCord.numaInd(), curCord.lineInd()) - 1));
-        // TODO: assserts
-
-        Tile &curTile {m_map.get(curCord)};
+        Tile &curTile {*cur};
         if(curTile.getEntity() == Entity::WATER) {
             return;
         }
 
-        if(m_map.getUpdateMask(curCord)) {
-            m_map.getUpdateMask(curCord) = false;
+        // already moved in this chronon
+        if(curTile.getParity() != m_parity) {
             return;
         }
 
-        // TODO: fix *Mask
-        if constexpr(vertLevel == 0) {
-            if(*cache.curCache.top) {
-                *cache.curCache.top = false;
-                return;
-            }
-        } else if constexpr(vertLevel == 4) {
-            if(*cache.curCache.bot) {
-                *cache.curCache.bot = false;
-                return;
-            }
-        }
+        unsigned waterMask, fishMask;
+        getNeighbourMasks<horLevel>(cur, posy, posx, waterMask, fishMask);
 
-        constexpr std::array<unsigned, 5> horLvlTickMap = {0, 1, 1, 1, 2};
-        constexpr unsigned horLvlTick = horLvlTickMap[horLevel];
-        unsigned newDir;
         if(curTile.getEntity() == Entity::FISH) {
-            newDir = tickEntity<vertLevel==4, horLvlTick, false>(curCord, dirs);
+            tickEntity<horLevel, false>(cur, posy, posx, waterMask, fishMask);
         } else { 
-            newDir = tickEntity<vertLevel==4, horLvlTick, true>(curCord, dirs);
-        }
-        if constexpr(vertLevel == 2) {
-            return;
-        }
-
-        if(newDir == std::numeric_limits<unsigned>::max()) {
-            return;
+            tickEntity<horLevel, true>(cur, posy, posx, waterMask, fishMask);
         }
+    }
 
-        if constexpr(vertLevel == 0) {
-            if(newDir == 0) {
-                *cache.neigCache.bot = true;
-                // m_map.getBottomMask(dirs[0]) = true;
-            } else if(newDir == 1) {
-                // corner case
-                *(cache.curCache.top + 1) = false;
-                // m_map.getTopMask(dirs[1]) = false;
-            }
-        } else if constexpr(vertLevel == 1) {
-            if(newDir == 0) {
-                // corner case
-                *cache.curCache.top = false;
-                // m_map.getTopMask(dirs[0]) = false;
+    template<class RulesPolicy, KernelIsa isa>
+    void BasicSimulationWorker<RulesPolicy, isa>::updateRowInterior(unsigned posy, unsigned stripBeg, 
+                                                                    unsigned stripEnd) {
+        using Word = std::uint64_t;
+
+        const unsigned width = m_line.getWidth();
+        const unsigned blockCnt = m_line.getBlockCnt();
+
+        auto bitAt = [](Word word, unsigned ind) -> unsigned {
+            return static_cast<unsigned>(word >> ind) & 1U;
+        };
+
+        const Word parityMatch = m_parity ? ~Word{0} : Word{0};
+
+        // blocks without entities are skipped, an entity moving into a 
+        // block marks it as occupied again
+        for(unsigned block = m_line.findOccupiedBlock(posy, stripBeg); block < stripEnd; 
+                block = m_line.findOccupiedBlock(posy, block+1)) {
+            const unsigned blockBeg = block*BLOCK_BITS;
+            const unsigned cnt = std::min(BLOCK_BITS, width-blockBeg);
+            const Word valid = (cnt == BLOCK_BITS) ? ~Word{0} : ((Word{1} << cnt) - 1);
+
+            // the edge columns are updated by updateEntity
+            Word interior = valid;
+            if(block == 0) { interior &= ~Word{1}; }
+            if(block+1 == blockCnt) { interior &= ~(Word{1} << (cnt-1)); }
+
+            // a block is never split between panels, the halo rows are 
+            // valid rows above/bellow the edge rows
+            Tile *blockRow = m_line.getTilePtr(posy, blockBeg);
+            const std::size_t stride = m_line.getRowStride(blockBeg);
+
+            Word curWater, curFish, curParity; // NOLINT
+            classifyTiles(blockRow, cnt, curWater, curFish, curParity);
+            if(curWater == valid) {
+                m_line.clearBlockOccupied(posy, block);
+                continue;
             }
-        } else if constexpr(vertLevel == 3) {
-            if(newDir == 2) {
-                // corner case
-                // m_map.getBottomMask(dirs[2]) = false;
-                *cache.curCache.bot = false;
+
+            // rows above and below are changed only by the entity in the same 
+            // column, the current row is kept up to date after every tick
+            Word upWater, upFish, downWater, downFish; // NOLINT
+            if(m_entityPlane) {
+                // a quarter of the bytes of the tiles
+                const MapLine::EntityWord *entRow = m_line.getEntityRowPtr(posy);
+                const MapLine::EntityWord *upBlock = entRow - m_line.getEntityRowWords() + 
+                                                     MapLine::ENTITY_WORDS_PER_BLOCK*block; // NOLINT
+                const MapLine::EntityWord *downBlock = entRow + m_line.getEntityRowWords() + 
+                                                       MapLine::ENTITY_WORDS_PER_BLOCK*block; // NOLINT
+                upWater = upBlock[MapLine::ENTITY_WATER]; // NOLINT
+                upFish = upBlock[MapLine::ENTITY_FISH]; // NOLINT
+                downWater = downBlock[MapLine::ENTITY_WATER]; // NOLINT
+                downFish = downBlock[MapLine::ENTITY_FISH]; // NOLINT
+            } else {
+                Word unused; // NOLINT
+                classifyTiles(blockRow - stride, cnt, upWater, upFish, unused); // NOLINT
+                classifyTiles(blockRow + stride, cnt, downWater, downFish, unused); // NOLINT
             }
-        } else if constexpr(vertLevel == 4) {
-            if(newDir == 2) {
-                // m_map.getTopMask(dirs[2]) = true;
-                *cache.neigCache.top = true;
-            } else if(newDir == 1) {
-                // corner case
-                // m_map.getBottomMask(dirs[1]) = false;
-                *(cache.curCache.bot+1) = false;
+
+            Word pending = ~curWater & ~(curParity ^ parityMatch) & interior;
+            while(pending != 0) {
+                const auto ind = static_cast<unsigned>(__builtin_ctzll(pending));
+                const unsigned posx = blockBeg + ind;
+
+                unsigned leftWater, leftFish, rightWater, rightFish; // NOLINT
+                if(ind == 0) {
+                    const Entity leftEnt = m_line.get(posy, posx-1).getEntity();
+                    leftWater = (leftEnt == Entity::WATER) ? 1 : 0;
+                    leftFish = (leftEnt == Entity::FISH) ? 1 : 0;
+                } else {
+                    leftWater = bitAt(curWater, ind-1);
+                    leftFish = bitAt(curFish, ind-1);
+                }
+                if(ind+1 == cnt) {
+                    const Entity rightEnt = m_line.get(posy, posx+1).getEntity();
+                    rightWater = (rightEnt == Entity::WATER) ? 1 : 0;
+                    rightFish = (rightEnt == Entity::FISH) ? 1 : 0;
+                } else {
+                    rightWater = bitAt(curWater, ind+1);
+                    rightFish = bitAt(curFish, ind+1);
+                }
+
+                const unsigned waterMask = bitAt(upWater, ind) | (rightWater << 1U) | 
+                                           (bitAt(downWater, ind) << 2U) | (leftWater << 3U);
+                const unsigned fishMask = bitAt(upFish, ind) | (rightFish << 1U) | 
+                                          (bitAt(downFish, ind) << 2U) | (leftFish << 3U);
+
+                if(bitAt(curFish, ind) != 0) {
+                    tickEntity<1, false>(blockRow + ind, posy, posx, waterMask, fishMask); // NOLINT
+                } else { 
+                    tickEntity<1, true>(blockRow + ind, posy, posx, waterMask, fishMask); // NOLINT
+                }
+
+                // only this and the right tile can change in the current row
+                for(unsigned upd=ind; upd<=ind+1 && upd<cnt; ++upd) {
+                    const Tile &tile = blockRow[upd]; // NOLINT
+                    const Entity ent = tile.getEntity();
+                    const Word bit = Word{1} << upd;
+                    curWater = (ent == Entity::WATER) ? (curWater | bit) : (curWater & ~bit);
+                    curFish = (ent == Entity::FISH) ? (curFish | bit) : (curFish & ~bit);
+                    curParity = (ent != Entity::WATER && tile.getParity()) ? (curParity | bit) : (curParity & ~bit);
+                }
+
+                const Word done = (ind+1 == BLOCK_BITS) ? ~Word{0} : ((Word{1} << (ind+1)) - 1);
+                pending = ~curWater & ~(curParity ^ parityMatch) & interior & ~done;
             }
         }
-        
     }
 
-    void SimulationWorker::operator()() {
-        unsigned height = m_map.getMapLineHeight(m_numaInd, m_lineInd);
-        unsigned width = m_map.getMapLineWidth(m_numaInd, m_lineInd);
+    template<class RulesPolicy, KernelIsa isa>
+    void BasicSimulationWorker<RulesPolicy, isa>::operator()() {
+        const unsigned height = m_line.getHeight();
+        const unsigned width = m_line.getWidth();
 
-        assert(height > 4 && width > 4);
+        assert(height > 1 && width > 2);
 
-        unsigned posy=0;
-        unsigned posx=0;
-        PosCache cache;
-        assertMemLocal(cache);
         assertMemLocal(m_rules);
 
-        // 0
-        updateEntity<0, 0>(posy, posx, cache); ++posx;
-        updateEntity<0, 1>(posy, posx, cache); ++posx;
-        for(; posx<width-2; ++posx) {
-            updateEntity<0, 2>(posy, posx, cache);
-        }
-        updateEntity<0, 3>(posy, posx, cache); ++posx;
-        updateEntity<0, 4>(posy, posx, cache); // ++posx;
-
-        // 1
-        posy = 1; posx = 0;
-        updateEntity<1, 0>(posy, posx, cache); ++posx;
-        updateEntity<1, 1>(posy, posx, cache); ++posx;
-        for(; posx<width-2; ++posx) {
-            updateEntity<1, 2>(posy, posx, cache);
-        }
-        updateEntity<1, 3>(posy, posx, cache); ++posx;
-        updateEntity<1, 4>(posy, posx, cache); // ++posx;
-
-        // 2
-        posy = 2; posx = 0;
-        for(; posy<height-2; ++posy) {
-            posx = 0;
-            updateEntity<2, 0>(posy, posx, cache); ++posx;
-            updateEntity<2, 1>(posy, posx, cache); ++posx;
-            for(; posx<width-2; ++posx) {
-                updateEntity<2, 2>(posy, posx, cache);
+        // the neighbouring lines are not updated in this half iteration
+        m_line.loadHalo(m_prevLine, m_nextLine);
+
+        // the entities moving out of a strip have the parity of the next 
+        // chronon, so they are not updated again in the strip they moved to
+        const unsigned blockCnt = m_line.getBlockCnt();
+        for(unsigned stripBeg=0; stripBeg<blockCnt; stripBeg += m_stripBlocks) {
+            const unsigned stripEnd = std::min(blockCnt, stripBeg + m_stripBlocks);
+            for(unsigned posy=0; posy<height; ++posy) {
+                if(stripBeg == 0 && m_line.isBlockOccupied(posy, 0)) {
+                    updateEntity<0>(m_line.getTilePtr(posy, 0), posy, 0);
+                }
+                updateRowInterior(posy, stripBeg, stripEnd);
+                if(stripEnd == blockCnt && m_line.isBlockOccupied(posy, blockCnt-1)) {
+                    updateEntity<2>(m_line.getTilePtr(posy, width-1), posy, width-1);
+                }
             }
-            updateEntity<2, 3>(posy, posx, cache); ++posx;
-            updateEntity<2, 4>(posy, posx, cache); // ++posx;
         }
 
-        // height-2
-        posy = height-2; posx = 0;
-        updateEntity<3, 0>(posy, posx, cache); ++posx;
-        updateEntity<3, 1>(posy, posx, cache); ++posx;
-        for(; posx<width-2; ++posx) {
-            updateEntity<3, 2>(posy, posx, cache);
-        }
-        updateEntity<3, 3>(posy, posx, cache); ++posx;
-        updateEntity<3, 4>(posy, posx, cache); // ++posx;
-
-        // height-1
-        posy = height-1; posx = 0;
-        updateEntity<4, 0>(posy, posx, cache); ++posx;
-        updateEntity<4, 1>(posy, posx, cache); ++posx;
-        for(; posx<width-2; ++posx) {
-            updateEntity<4, 2>(posy, posx, cache);
-        }
-        updateEntity<4, 3>(posy, posx, cache); ++posx;
-        updateEntity<4, 4>(posy, posx, cache); // ++posx;
+        m_line.storeHalo(m_prevLine, m_nextLine);
     }
+
+    template class BasicSimulationWorker<RuntimeRulesPolicy, WATOR_KERNEL_ISA>;
+    template class BasicSimulationWorker<FixedRulesPolicy<3, 10, 3>, WATOR_KERNEL_ISA>; // NOLINT
+    static_assert(std::tuple_size_v<FixedRulesPolicies> == 1, "every fixed rules policy has to be instantiated");
 }
@@ -0,0 +1,3 @@
+// the tile kernel for CPUs with AVX2, picked at runtime by Simulation
+#define WATOR_KERNEL_ISA_AVX2
+#include "wator_simulation_worker.cpp" // NOLINT(bugprone-suspicious-include)
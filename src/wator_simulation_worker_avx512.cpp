@@ -0,0 +1,3 @@
+// the tile kernel for CPUs with AVX-512, picked at runtime by Simulation
+#define WATOR_KERNEL_ISA_AVX512
+#include "wator_simulation_worker.cpp" // NOLINT(bugprone-suspicious-include)
@@ -0,0 +1,56 @@
+#include "wator/stripe_rebalancer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+namespace WaTor {
+
+std::vector<int> StripeRebalancer::plan(const std::vector<Line> &lines, 
+                                        const std::vector<double> &groupTime) const {
+    std::vector<int> res(lines.empty() ? 0 : lines.size()-1, 0);
+
+    // the cost of a row of every group, from the heights before any move
+    std::vector<std::uint64_t> groupRows(groupTime.size(), 0);
+    for(const Line &line : lines) {
+        assert(line.group < groupTime.size());
+        groupRows[line.group] += line.height;
+    }
+
+    std::vector<std::int64_t> height(lines.size());
+    std::transform(lines.begin(), lines.end(), height.begin(), [](const Line &line) {
+        return static_cast<std::int64_t>(line.height);
+    });
+
+    for(std::size_t k=0; k+1<lines.size(); ++k) {
+        const unsigned upper = lines[k].group, lower = lines[k+1].group;
+        const double upperTime = groupTime[upper], lowerTime = groupTime[lower];
+        const double maxTime = std::max(upperTime, lowerTime);
+        if(upper == lower || maxTime <= 0 || std::abs(upperTime - lowerTime) <= m_threshold*maxTime) {
+            continue;
+        }
+
+        // the rows of the slower group go, at its cost
+        const unsigned slower = (upperTime > lowerTime) ? upper : lower;
+        const double rowCost = groupTime[slower]/static_cast<double>(groupRows[slower]);
+        double rows = (lowerTime - upperTime)/(2*rowCost)/m_boundariesPerGroup;
+
+        std::int64_t shift = static_cast<std::int64_t>(rows);
+        if(shift > 0) {
+            shift = std::min({shift, height[k+1] - std::int64_t{m_minHeight},
+                              std::int64_t{lines[k].maxHeight} - height[k]});
+            shift = std::max<std::int64_t>(shift, 0);
+        } else if(shift < 0) {
+            shift = -std::min({-shift, height[k] - std::int64_t{m_minHeight},
+                               std::int64_t{lines[k+1].maxHeight} - height[k+1]});
+            shift = std::min<std::int64_t>(shift, 0);
+        }
+        height[k] += shift;
+        height[k+1] -= shift;
+        res[k] = static_cast<int>(shift);
+    }
+    return res;
+}
+
+}
@@ -0,0 +1,62 @@
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "hierarchical_barrier.hpp"
+
+TEST_CASE("HierarchicalBarrier arriveAndWait") { // NOLINT
+    // 0 - every wait sleeps on the futex
+    const unsigned spinCnt = GENERATE(0U, HierarchicalBarrier::DEFAULT_SPIN_CNT);
+    const std::vector<unsigned> groupSizes = {2, 1, 3};
+    HierarchicalBarrier barrier{groupSizes, spinCnt};
+    CHECK(barrier.getGroupCnt() == 3);
+
+    constexpr unsigned roundCnt = 200;
+    // written by its thread only, read by all of them after the barrier
+    std::vector<unsigned> progress(6, 0); // NOLINT
+    std::atomic<unsigned> failedCnt{0};
+
+    auto run = [&](unsigned group, std::size_t ind) {
+        for(unsigned round=1; round<=roundCnt; ++round) {
+            progress[ind] = round;
+            barrier.arriveAndWait(group);
+            for(unsigned other : progress) {
+                if(other != round) {
+                    ++failedCnt;
+                }
+            }
+            // nobody writes the next round before everybody checked this one
+            barrier.arriveAndWait(group);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    std::size_t ind = 0;
+    for(unsigned group=0; group<groupSizes.size(); ++group) {
+        for(unsigned i=0; i<groupSizes[group]; ++i) {
+            if(ind != 0) {
+                threads.emplace_back(run, group, ind);
+            }
+            ++ind;
+        }
+    }
+    run(0, 0);
+    for(std::thread &thd : threads) {
+        thd.join();
+    }
+
+    CHECK(failedCnt == 0);
+    for(unsigned done : progress) {
+        CHECK(done == roundCnt);
+    }
+}
+
+TEST_CASE("HierarchicalBarrier single thread") { // NOLINT
+    HierarchicalBarrier barrier{{1}};
+    for(unsigned i=0; i<10; ++i) { // NOLINT
+        barrier.arriveAndWait(0);
+    }
+    CHECK(barrier.getGroupCnt() == 1);
+}
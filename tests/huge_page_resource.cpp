@@ -0,0 +1,84 @@
+#include <catch2/catch.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "huge_page_resource.hpp"
+
+TEST_CASE("HugePageResource allocate") { // NOLINT
+    std::ostringstream log;
+    // node 0 exists on every system
+    const int numaNode = GENERATE(-1, 0);
+    HugePageResource res{numaNode, &log};
+
+    const std::size_t pageSize = res.getHugePageSize();
+    REQUIRE(pageSize >= (std::size_t{2} << 20U));
+
+    // not a multiple of the huge page size
+    const std::size_t bytes = pageSize + 4096; // NOLINT
+    void *ptr = res.allocate(bytes, 64); // NOLINT
+    REQUIRE(ptr != nullptr);
+    CHECK(reinterpret_cast<std::uintptr_t>(ptr) % pageSize == 0); // NOLINT
+
+    auto *raw = static_cast<unsigned char*>(ptr);
+    for(std::size_t i=0; i<bytes; i += 4096) { // NOLINT
+        raw[i] = static_cast<unsigned char>(i >> 12U); // NOLINT
+    }
+    for(std::size_t i=0; i<bytes; i += 4096) { // NOLINT
+        CHECK(raw[i] == static_cast<unsigned char>(i >> 12U)); // NOLINT
+    }
+
+    // whatever it got, it is reported
+    CHECK(log.str().find(HugePageResource::getPageKindName(res.getLastPageKind())) != std::string::npos);
+    res.deallocate(ptr, bytes, 64); // NOLINT
+}
+
+TEST_CASE("HugePageResource small allocations share a mapping") { // NOLINT
+    std::ostringstream log;
+    HugePageResource res{-1, &log};
+    const std::size_t pageSize = res.getHugePageSize();
+
+    // like the first buffers of a monotonic_buffer_resource
+    std::vector<std::pair<void*, std::size_t>> ptrs;
+    for(std::size_t bytes=1024; bytes<pageSize/4; bytes *= 2) { // NOLINT
+        ptrs.emplace_back(res.allocate(bytes, 64), bytes); // NOLINT
+    }
+    REQUIRE(!ptrs.empty());
+    auto *first = static_cast<char*>(ptrs.front().first);
+    for(auto [ptr, bytes] : ptrs) {
+        CHECK(reinterpret_cast<std::uintptr_t>(ptr) % 64 == 0); // NOLINT
+        CHECK(static_cast<char*>(ptr) >= first);
+        CHECK(static_cast<char*>(ptr) + bytes <= first + pageSize); // NOLINT
+        static_cast<char*>(ptr)[bytes - 1] = 1; // NOLINT
+    }
+    // a single mapping was made
+    CHECK(log.str().find("Mapped") == log.str().rfind("Mapped"));
+
+    // does not fit into the rest, a new mapping
+    void *large = res.allocate(pageSize, 64);
+    CHECK(reinterpret_cast<std::uintptr_t>(large) % pageSize == 0); // NOLINT
+    CHECK(log.str().find("Mapped") != log.str().rfind("Mapped"));
+
+    for(auto [ptr, bytes] : ptrs) {
+        res.deallocate(ptr, bytes, 64); // NOLINT
+    }
+    res.deallocate(large, pageSize, 64);
+}
+
+TEST_CASE("HugePageResource under monotonic_buffer_resource") { // NOLINT
+    HugePageResource res;
+    std::pmr::monotonic_buffer_resource mono{&res};
+
+    std::pmr::vector<std::uint32_t> vec{&mono};
+    for(std::uint32_t i=0; i<(1U << 20U); ++i) { // NOLINT
+        vec.push_back(i);
+    }
+    for(std::uint32_t i=0; i<vec.size(); ++i) {
+        REQUIRE(vec[i] == i);
+    }
+    CHECK(!res.is_equal(*std::pmr::get_default_resource()));
+    CHECK(res.is_equal(res));
+}
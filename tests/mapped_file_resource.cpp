@@ -0,0 +1,50 @@
+#include <catch2/catch.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory_resource>
+#include <vector>
+
+#include "mapped_file_resource.hpp"
+
+TEST_CASE("MappedFileResource allocate") { // NOLINT
+    MappedFileResource res{std::filesystem::temp_directory_path()};
+    CHECK(res.getFileSize() == 0);
+
+    const std::size_t bytes = (std::size_t{4} << 20U) + 100; // NOLINT
+    auto *raw = static_cast<unsigned char*>(res.allocate(bytes, 64)); // NOLINT
+    REQUIRE(raw != nullptr);
+    CHECK(res.getFileSize() >= bytes);
+
+    for(std::size_t i=0; i<bytes; i += 1000) { // NOLINT
+        raw[i] = static_cast<unsigned char>(i >> 10U); // NOLINT
+    }
+    // the pages are read back from the file
+    res.writeBack(raw + 1, bytes - 2); // NOLINT
+    res.prefetch(raw, bytes);
+    for(std::size_t i=0; i<bytes; i += 1000) { // NOLINT
+        CHECK(raw[i] == static_cast<unsigned char>(i >> 10U)); // NOLINT
+    }
+
+    // a new range of the file
+    const std::size_t fileSize = res.getFileSize();
+    void *other = res.allocate(100, 8); // NOLINT
+    CHECK(res.getFileSize() > fileSize);
+    res.deallocate(other, 100, 8); // NOLINT
+    res.deallocate(raw, bytes, 64); // NOLINT
+}
+
+TEST_CASE("MappedFileResource under monotonic_buffer_resource") { // NOLINT
+    MappedFileResource res{std::filesystem::temp_directory_path()};
+    std::pmr::monotonic_buffer_resource mono{&res};
+
+    std::pmr::vector<std::uint32_t> vec{&mono};
+    for(std::uint32_t i=0; i<(1U << 20U); ++i) { // NOLINT
+        vec.push_back(i);
+    }
+    res.writeBack(vec.data(), vec.size()*sizeof(std::uint32_t));
+    for(std::uint32_t i=0; i<vec.size(); ++i) {
+        REQUIRE(vec[i] == i);
+    }
+    CHECK(!res.is_equal(*std::pmr::get_default_resource()));
+}
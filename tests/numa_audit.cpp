@@ -0,0 +1,107 @@
+#include <catch2/catch.hpp>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "numa_audit.hpp"
+
+TEST_CASE("NumaAudit audit") { // NOLINT
+    constexpr std::size_t bytes = std::size_t{1} << 22U;
+    auto touched = std::make_unique<char[]>(bytes); // NOLINT
+    std::memset(touched.get(), 1, bytes);
+    std::vector<char> small(100, 1); // NOLINT
+
+    NumaAudit audit;
+    audit.addRange("touched", touched.get(), bytes, 0);
+    audit.addRange("touched", small.data(), small.size(), 0);
+    audit.addRange("empty", nullptr, bytes, 0);
+    CHECK(audit.getRangeCnt() == 2);
+
+    const std::vector<NumaResidency> res = audit.audit(16); // NOLINT
+    if(!NumaAudit::isAvailable()) {
+        CHECK(res.empty());
+        return;
+    }
+    REQUIRE(res.size() == 1);
+    CHECK(res[0].kind == "touched");
+    CHECK(res[0].expectedNode == 0);
+    // a page more if the ranges are not aligned
+    CHECK(res[0].sampledPages >= 17);
+    CHECK(res[0].sampledPages <= 18);
+    CHECK(res[0].absentPages == 0);
+    std::size_t onNodes = 0;
+    for(const auto &[node, pages] : res[0].pagesPerNode) {
+        CHECK(node >= 0);
+        onNodes += pages;
+    }
+    CHECK(onNodes == res[0].getPresentPages());
+
+    std::ostringstream out;
+    NumaAudit::print(out, res);
+    CHECK(out.str().find("NUMA residency of touched of node 0") != std::string::npos);
+}
+
+TEST_CASE("NumaAudit migrate") { // NOLINT
+    constexpr std::size_t bytes = std::size_t{1} << 20U;
+    auto mem = std::make_unique<char[]>(bytes); // NOLINT
+    std::memset(mem.get(), 1, bytes);
+
+    NumaAudit audit;
+    audit.addRange("memory", mem.get(), bytes, 0);
+    // node 0 exists on every system, the ranges already local are left
+    CHECK(audit.migrate(1, 64) == 0); // NOLINT
+    if(NumaAudit::isAvailable()) {
+        // every page is on its node after it
+        CHECK(audit.migrate(1.1, 64) >= bytes/static_cast<std::size_t>(sysconf(_SC_PAGESIZE))); // NOLINT
+        const std::vector<NumaResidency> res = audit.audit(64); // NOLINT
+        REQUIRE(res.size() == 1);
+        CHECK(res[0].getLocalFraction() == 1);
+    }
+    CHECK(mem[bytes - 1] == 1);
+}
+
+#ifdef WATOR_NUMA
+TEST_CASE("NumaAudit migrate misplaced") { // NOLINT
+    if(!NumaAudit::isAvailable() || numa_max_node() < 1 || numa_node_size(1, nullptr) <= 0) {
+        WARN("Two NUMA nodes with memory are needed to misplace the pages");
+        return;
+    }
+    const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    constexpr std::size_t pageCnt = 256;
+    const std::size_t bytes = pageCnt*pageSize;
+    void *local = numa_alloc_onnode(bytes, 0);
+    void *misplaced = numa_alloc_onnode(bytes, 0);
+    REQUIRE(local != nullptr);
+    REQUIRE(misplaced != nullptr);
+    std::memset(local, 1, bytes);
+    std::memset(misplaced, 2, bytes);
+
+    NumaAudit audit;
+    audit.addRange("local", local, bytes, 0);
+    audit.addRange("misplaced", misplaced, bytes, 1);
+    std::vector<NumaResidency> res = audit.audit(pageCnt);
+    REQUIRE(res.size() == 2);
+    CHECK(res[0].getLocalFraction() == 1);
+    CHECK(res[1].getLocalFraction() == 0);
+
+    // only the misplaced range is moved, all of its pages
+    CHECK(audit.migrate(1, pageCnt) == pageCnt);
+    res = audit.audit(pageCnt);
+    REQUIRE(res.size() == 2);
+    CHECK(res[0].pagesPerNode == std::map<int, std::size_t>{{0, pageCnt}});
+    CHECK(res[1].pagesPerNode == std::map<int, std::size_t>{{1, pageCnt}});
+    // nothing is left to move
+    CHECK(audit.migrate(1, pageCnt) == 0);
+
+    CHECK(static_cast<char*>(local)[bytes - 1] == 1); // NOLINT
+    CHECK(static_cast<char*>(misplaced)[bytes - 1] == 2); // NOLINT
+    numa_free(local, bytes);
+    numa_free(misplaced, bytes);
+}
+#endif
@@ -0,0 +1,121 @@
+#include <catch2/catch.hpp>
+#include <memory_resource>
+
+#include "wator/entity.hpp"
+#include "wator/map.hpp"
+#include "wator/map_bitboard.hpp"
+#include "wator/map_line.hpp"
+#include "wator/map_line_bitboard.hpp"
+#include "wator/rules.hpp"
+#include "wator/simulation_bitboard_worker.hpp"
+#include "wator/tile.hpp"
+
+using namespace WaTor;
+
+TEST_CASE("WaTor::MapLineBitboard load and store") {  // NOLINT
+    const unsigned width = GENERATE(3U, 64U, 65U, 130U);
+    MapLine line{5, width, std::pmr::get_default_resource()};
+
+    for(unsigned posy=0; posy<line.getHeight(); ++posy) {
+        for(unsigned posx=0; posx<line.getWidth(); ++posx) {
+            const unsigned val = posy*width + posx;
+            if(val % 3 == 1) {
+                line.get(posy, posx) = Tile{Entity::FISH, val % (Tile::MAX_AGE+1), 0};
+            } else if(val % 3 == 2) {
+                line.get(posy, posx) = Tile{Entity::SHARK, val % (Tile::MAX_AGE+1),
+                                            (val/3) % (Tile::MAX_LAST_ATE+1)};
+            }
+        }
+    }
+
+    MapLineBitboard bline{line};
+    CHECK(bline.getHeight() == 5);
+    CHECK(bline.getWidth() == width);
+    CHECK(bline.getWordsPerRow() == (width+63)/64);
+
+    bline.load(line, true);
+
+    MapLine res{5, width, std::pmr::get_default_resource()};
+    bline.store(res);
+
+    for(unsigned posy=0; posy<line.getHeight(); ++posy) {
+        const MapLineBitboard::Word *stamp = bline.getPlane(posy, MapLineBitboard::STAMP_PLANE);
+        for(unsigned posx=0; posx<line.getWidth(); ++posx) {
+            CHECK(res.get(posy, posx) == line.get(posy, posx));
+            CHECK(bline.getTile(posy, posx) == line.get(posy, posx));
+            const bool stamped = ((stamp[posx/64] >> (posx%64)) & 1U) != 0;
+            CHECK(stamped == (line.get(posy, posx).getEntity() != Entity::WATER));
+        }
+        // padding bits are zero
+        for(unsigned plane=0; plane<MapLineBitboard::PLANE_CNT; ++plane) {
+            const MapLineBitboard::Word last = bline.getPlane(posy, plane)[bline.getWordsPerRow()-1];
+            CHECK((last & ~bline.getLastWordMask()) == 0);
+        }
+    }
+}
+
+TEST_CASE("WaTor::MapBitboard neighbour lines") {  // NOLINT
+    std::vector<unsigned> numaList = {0, 1};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {2, 3}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    Map map{31, 5, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    MapBitboard bmap{map};
+
+    CHECK(bmap.getMapNumaCnt() == 2);
+    CHECK(bmap.getLineCnt(0) == 4);
+    CHECK(bmap.getLineCnt(1) == 4);
+
+    CHECK(&bmap.getPrevLine(0, 0) == &bmap.getLine(1, 3));
+    CHECK(&bmap.getNextLine(1, 3) == &bmap.getLine(0, 0));
+    CHECK(&bmap.getPrevLine(1, 0) == &bmap.getLine(0, 3));
+    CHECK(&bmap.getNextLine(0, 3) == &bmap.getLine(1, 0));
+    CHECK(&bmap.getPrevLine(0, 2) == &bmap.getLine(0, 1));
+    CHECK(&bmap.getNextLine(0, 2) == &bmap.getLine(0, 3));
+}
+
+TEST_CASE("WaTor::SimulationBitboardWorker single fish") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    const unsigned seed = GENERATE(1U, 2U, 3U, 4U, 5U, 6U, 7U, 8U);
+    const unsigned posx = GENERATE(0U, 3U, 69U);
+    const unsigned posy = GENERATE(0U, 5U);
+
+    Map map{12, 70, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    const Rules rules{12, 70, 1, 0, 10, 10, 3}; // NOLINT
+    map.get(0, 0, posy, posx) = Tile{Entity::FISH, 0, 0};
+
+    MapBitboard bmap{map};
+    bmap.load(map, true);
+
+    // one chronon with parity 0
+    SimulationBitboardWorker{bmap, 0, 0, rules, seed, 0}();
+    SimulationBitboardWorker{bmap, 0, 1, rules, seed, 0}();
+
+    bmap.store(map);
+
+    unsigned fishCnt = 0;
+    for(unsigned lineInd=0; lineInd<2; ++lineInd) {
+        for(unsigned y=0; y<map.getMapLineHeight(0, lineInd); ++y) {
+            for(unsigned x=0; x<map.getWidth(); ++x) {
+                const Tile &tile = map.get(0, lineInd, y, x);
+                if(tile.getEntity() == Entity::WATER) {
+                    continue;
+                }
+                REQUIRE(tile.getEntity() == Entity::FISH);
+                CHECK(tile.getAge() == 1);
+                ++fishCnt;
+
+                const unsigned globy = y + lineInd*map.getMapLineHeight(0, 0);
+                const unsigned dy = (globy + map.getHeight() - posy) % map.getHeight();
+                const unsigned dx = (x + map.getWidth() - posx) % map.getWidth();
+                const bool isNeighbour = (dx == 0 && (dy == 1 || dy == map.getHeight()-1)) ||
+                                         (dy == 0 && (dx == 1 || dx == map.getWidth()-1));
+                CHECK(isNeighbour);
+            }
+        }
+    }
+    CHECK(fishCnt == 1);
+}
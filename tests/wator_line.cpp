@@ -64,23 +64,6 @@ TEST_CASE("WaTor::MapLine get and getAbs") {  // NOLINT
     }
 }
 
-TEST_CASE("WaTor::MapLine mask functions") { // NOLINT
-    MapLine res{3, 4, std::pmr::get_default_resource()};
-
-    for(unsigned i=0; i<res.getWidth(); ++i) {
-        res.getTopMask(i) = (i%2 == 1);
-        res.getUpdateMask(i) = (i%2 == 0);
-        res.getBottomMask(i) = (i%2 == 1);
-    }
-
-    for(unsigned i=0; i<res.getWidth(); ++i) {
-        const MapLine &cres = res;
-        CHECK(cres.getTopMask(i) == (i%2 == 1));
-        CHECK(cres.getUpdateMask(i) == (i%2 == 0));
-        CHECK(cres.getBottomMask(i) == (i%2 == 1));
-    }
-}
-
 TEST_CASE("WaTor::MapLine tileIter") { // NOLINT
     MapLine res{3, 4, std::pmr::get_default_resource()};
 
@@ -105,35 +88,334 @@ TEST_CASE("WaTor::MapLine tileIter") { // NOLINT
     }
 }
 
-TEST_CASE("WaTor::MapLine maskIter functions") { // NOLINT
+TEST_CASE("WaTor::MapLine halo rows") { // NOLINT
+    MapLine prev{3, 4, std::pmr::get_default_resource()};
     MapLine res{3, 4, std::pmr::get_default_resource()};
+    MapLine next{3, 4, std::pmr::get_default_resource()};
+
+    Tile defFish{Entity::FISH, 0, 0};
+    Tile defShark{Entity::SHARK, 1, 1};
+
+    for(unsigned i=0; i<res.getWidth(); ++i) {
+        prev.get(prev.getHeight()-1, i) = (i%2 == 0) ? defFish : defShark;
+        next.get(0, i) = (i%2 == 0) ? defShark : defFish;
+    }
+
+    res.loadHalo(prev, next);
 
-    MapLine::TopMaskIter tmiter{res.getTopMaskIter(0)};
-    MapLine::UpdateMaskIter umiter{res.getUpdateMaskIter(0)};
-    MapLine::BottomMaskIter bmiter{res.getBottomMaskIter(0)};
     for(unsigned i=0; i<res.getWidth(); ++i) {
-        *tmiter = (i%2 == 1);
-        ++tmiter;
-        *umiter = (i%2 == 0);
-        ++umiter;
-        *bmiter = (i%2 == 1);
-        ++bmiter;
+        CHECK(res.getHaloTop(i) == prev.get(prev.getHeight()-1, i));
+        CHECK(res.getHaloBottom(i) == next.get(0, i));
+        // halo rows are fixed offsets from the edge rows
+        CHECK(&res.getHaloTop(i) == res.getRowPtr(0) + i - res.getWidth());
+        CHECK(&res.getHaloBottom(i) == res.getRowPtr(res.getHeight()-1) + i + res.getWidth());
+        // the line itself is untouched
+        for(unsigned j=0; j<res.getHeight(); ++j) {
+            CHECK(res.get(j, i).getEntity() == Entity::WATER);
+        }
     }
 
-    tmiter = res.getTopMaskIter(0);
-    umiter = res.getUpdateMaskIter(0);
-    bmiter = res.getBottomMaskIter(0);
     for(unsigned i=0; i<res.getWidth(); ++i) {
-        CHECK( *tmiter == (i%2 == 1));
-        ++tmiter;
-        CHECK( *umiter == (i%2 == 0));
-        ++umiter;
-        CHECK( *bmiter == (i%2 == 1));
-        ++bmiter;
+        res.getHaloTop(i) = Tile{};
+        res.getHaloBottom(i) = defShark;
+    }
+
+    res.storeHalo(prev, next);
+
+    for(unsigned i=0; i<res.getWidth(); ++i) {
+        CHECK(prev.get(prev.getHeight()-1, i).getEntity() == Entity::WATER);
+        CHECK(next.get(0, i) == defShark);
+        CHECK(prev.get(0, i).getEntity() == Entity::WATER);
+        CHECK(next.get(next.getHeight()-1, i).getEntity() == Entity::WATER);
+    }
+}
+
+TEST_CASE("WaTor::MapLine occupancy") { // NOLINT
+    // 3 blocks, the last one is partial
+    MapLine res{3, 2*MapLine::BLOCK_WIDTH + 5, std::pmr::get_default_resource()};
+    REQUIRE(res.getBlockCnt() == 3);
+
+    // everything may be occupied after construction
+    for(unsigned i=0; i<res.getHeight(); ++i) {
+        for(unsigned block=0; block<res.getBlockCnt(); ++block) {
+            CHECK(res.isBlockOccupied(i, block));
+        }
+        CHECK(res.findOccupiedBlock(i, 0) == 0);
+    }
+
+    res.get(1, MapLine::BLOCK_WIDTH) = Tile{Entity::FISH, 0, 0};
+    res.get(2, res.getWidth()-1) = Tile{Entity::SHARK, 0, 0};
+    for(unsigned i=0; i<res.getHeight(); ++i) {
+        res.updateOccupancy(i);
+    }
+
+    CHECK(res.findOccupiedBlock(0, 0) == res.getBlockCnt());
+    CHECK(res.findOccupiedBlock(1, 0) == 1);
+    CHECK(res.findOccupiedBlock(1, 1) == 1);
+    CHECK(res.findOccupiedBlock(1, 2) == res.getBlockCnt());
+    CHECK(res.findOccupiedBlock(2, 0) == 2);
+    CHECK(res.findOccupiedBlock(2, res.getBlockCnt()) == res.getBlockCnt());
+
+    res.setBlockOccupied(0, 2);
+    CHECK(res.isBlockOccupied(0, 2));
+    CHECK(res.findOccupiedBlock(0, 0) == 2);
+    res.clearBlockOccupied(0, 2);
+    CHECK_FALSE(res.isBlockOccupied(0, 2));
+
+    SECTION("storeHalo updates the neighbours") {
+        MapLine prev{3, res.getWidth(), std::pmr::get_default_resource()};
+        MapLine next{3, res.getWidth(), std::pmr::get_default_resource()};
+        res.loadHalo(prev, next);
+        res.getHaloBottom(0) = Tile{Entity::FISH, 0, 0};
+        res.storeHalo(prev, next);
+
+        CHECK(prev.findOccupiedBlock(prev.getHeight()-1, 0) == prev.getBlockCnt());
+        CHECK(next.findOccupiedBlock(0, 0) == 0);
+        CHECK(next.findOccupiedBlock(0, 1) == next.getBlockCnt());
+    }
+
+    SECTION("markAllOccupied") {
+        res.markAllOccupied();
+        for(unsigned block=0; block<res.getBlockCnt(); ++block) {
+            CHECK(res.isBlockOccupied(0, block));
+        }
+    }
+}
+
+TEST_CASE("WaTor::MapLine entity plane") { // NOLINT
+    const unsigned width = 2*MapLine::BLOCK_WIDTH + 5;
+    MapLine res{3, width, std::pmr::get_default_resource(), MapLineStorage::SPLIT};
+    REQUIRE(res.hasEntityPlane());
+    REQUIRE(res.getEntityRowWords() == MapLine::ENTITY_WORDS_PER_BLOCK*res.getBlockCnt());
+    CHECK_FALSE(MapLine(3, width, std::pmr::get_default_resource()).hasEntityPlane());
+
+    auto entityAt = [&res](unsigned posy, unsigned posx) {
+        const MapLine::EntityWord *block = res.getEntityRowPtr(posy) + 
+                MapLine::ENTITY_WORDS_PER_BLOCK*(posx / MapLine::BLOCK_WIDTH);
+        const unsigned bit = posx % MapLine::BLOCK_WIDTH;
+        if(((block[MapLine::ENTITY_WATER] >> bit) & 1U) != 0) { return Entity::WATER; }
+        if(((block[MapLine::ENTITY_FISH] >> bit) & 1U) != 0) { return Entity::FISH; }
+        return Entity::SHARK;
+    };
+
+    // all water after construction
+    for(unsigned posy=0; posy<res.getHeight(); ++posy) {
+        for(unsigned posx=0; posx<width; ++posx) {
+            CHECK(entityAt(posy, posx) == Entity::WATER);
+        }
+    }
 
+    res.get(0, 0) = Tile{Entity::FISH, 0, 0};
+    res.get(1, MapLine::BLOCK_WIDTH) = Tile{Entity::SHARK, 2, 1};
+    res.get(2, width-1) = Tile{Entity::FISH, 1, 0};
+    res.updateEntityPlane();
+    for(unsigned posy=0; posy<res.getHeight(); ++posy) {
+        for(unsigned posx=0; posx<width; ++posx) {
+            CHECK(entityAt(posy, posx) == res.get(posy, posx).getEntity());
+        }
+    }
+
+    MapLine::setEntity(res.getEntityRowPtr(1), 3, Entity::SHARK);
+    CHECK(entityAt(1, 3) == Entity::SHARK);
+    MapLine::setEntity(res.getEntityRowPtr(1), 3, Entity::FISH);
+    CHECK(entityAt(1, 3) == Entity::FISH);
+    MapLine::setEntity(res.getEntityRowPtr(1), 3, Entity::WATER);
+    CHECK(entityAt(1, 3) == Entity::WATER);
+
+    SECTION("halo rows") {
+        MapLine prev{3, width, std::pmr::get_default_resource(), MapLineStorage::SPLIT};
+        MapLine next{3, width, std::pmr::get_default_resource(), MapLineStorage::SPLIT};
+        next.get(0, 7) = Tile{Entity::SHARK, 0, 0};
+        next.updateEntityPlane();
+
+        res.loadHalo(prev, next);
+        const MapLine::EntityWord *halo = res.getEntityRowPtr(res.getHeight()-1) + res.getEntityRowWords();
+        CHECK((halo[MapLine::ENTITY_WATER] >> 7U & 1U) == 0);
+        CHECK((halo[MapLine::ENTITY_FISH] >> 7U & 1U) == 0);
+
+        // a fish moves into the row of prev
+        res.getHaloTop(1) = Tile{Entity::FISH, 0, 0};
+        MapLine::setEntity(res.getEntityRowPtr(0) - res.getEntityRowWords(), 1, Entity::FISH);
+        res.storeHalo(prev, next);
+        const MapLine::EntityWord *prevRow = prev.getEntityRowPtr(prev.getHeight()-1);
+        CHECK((prevRow[MapLine::ENTITY_FISH] >> 1U & 1U) == 1);
+    }
+}
+
+TEST_CASE("WaTor::MapLine panels") { // NOLINT
+    // two full panels and a narrower one
+    constexpr unsigned width = 2*MapLine::PANEL_WIDTH + 452;
+    MapLine prev{3, width, std::pmr::get_default_resource(), MapLineStorage::TILES, MapLineLayout::PANELS};
+    MapLine res{3, width, std::pmr::get_default_resource(), MapLineStorage::TILES, MapLineLayout::PANELS};
+    MapLine next{3, width, std::pmr::get_default_resource(), MapLineStorage::TILES, MapLineLayout::PANELS};
+
+    REQUIRE(res.getLayout() == MapLineLayout::PANELS);
+    REQUIRE(res.getPanelCnt() == 3);
+    CHECK(res.getPanelBegin(2) == 2*MapLine::PANEL_WIDTH);
+    CHECK(res.getPanelWidth(1) == MapLine::PANEL_WIDTH);
+    CHECK(res.getPanelWidth(2) == 452);
+    CHECK(res.isPanelBegin(MapLine::PANEL_WIDTH));
+    CHECK(!res.isPanelBegin(MapLine::PANEL_WIDTH+1));
+
+    const MapLine rows{3, width, std::pmr::get_default_resource()};
+    CHECK(rows.getLayout() == MapLineLayout::ROWS);
+    CHECK(rows.getPanelCnt() == 1);
+    CHECK(rows.getRowStride(width-1) == width);
+
+    // distinct tiles, so a wrong address is noticed
+    auto makeTile = [](unsigned posy, unsigned posx) {
+        const unsigned age = (posy + posx/24) % 14; // NOLINT
+        return (posx%3 == 0) ? Tile{Entity::FISH, age, 0} : Tile{Entity::SHARK, age, (posx/3) % 7}; // NOLINT
+    };
+
+    for(unsigned posy=0; posy<res.getHeight(); ++posy) {
+        for(unsigned posx=0; posx<width; ++posx) {
+            res.get(posy, posx) = makeTile(posy, posx);
+        }
+    }
+
+    SECTION("tiles") {
         const MapLine &cres = res;
-        CHECK(cres.getTopMask(i) == (i%2 == 1));
-        CHECK(cres.getUpdateMask(i) == (i%2 == 0));
-        CHECK(cres.getBottomMask(i) == (i%2 == 1));
+        for(unsigned posy=0; posy<res.getHeight(); ++posy) {
+            for(unsigned posx=0; posx<width; ++posx) {
+                REQUIRE(cres.getAbs(static_cast<std::size_t>(posy)*width + posx) == makeTile(posy, posx));
+                REQUIRE(cres.getTilePtr(posy, posx) == &cres.get(posy, posx));
+                REQUIRE(*res.getTileIter(posy, posx) == makeTile(posy, posx));
+                if(posy+1 < res.getHeight()) {
+                    REQUIRE(cres.getTilePtr(posy, posx) + cres.getRowStride(posx) == cres.getTilePtr(posy+1, posx));
+                }
+            }
+        }
+        // a panel is row major
+        const Tile *panel = cres.getTilePtr(1, MapLine::PANEL_WIDTH);
+        for(unsigned i=0; i<MapLine::PANEL_WIDTH; ++i) {
+            CHECK(panel[i] == makeTile(1, MapLine::PANEL_WIDTH + i)); // NOLINT
+        }
+    }
+
+    SECTION("halo rows") {
+        for(unsigned posx=0; posx<width; ++posx) {
+            prev.get(prev.getHeight()-1, posx) = makeTile(7, posx); // NOLINT
+            next.get(0, posx) = makeTile(9, posx); // NOLINT
+        }
+
+        res.loadHalo(prev, next);
+        for(unsigned posx=0; posx<width; ++posx) {
+            REQUIRE(res.getHaloTop(posx) == makeTile(7, posx)); // NOLINT
+            REQUIRE(res.getHaloBottom(posx) == makeTile(9, posx)); // NOLINT
+            REQUIRE(&res.getHaloTop(posx) == res.getTilePtr(0, posx) - res.getRowStride(posx));
+            REQUIRE(&res.getHaloBottom(posx) == 
+                    res.getTilePtr(res.getHeight()-1, posx) + res.getRowStride(posx));
+        }
+
+        for(unsigned posx=0; posx<width; ++posx) {
+            res.getHaloTop(posx) = makeTile(4, posx); // NOLINT
+            res.getHaloBottom(posx) = Tile{};
+        }
+        res.storeHalo(prev, next);
+        for(unsigned posx=0; posx<width; ++posx) {
+            REQUIRE(prev.get(prev.getHeight()-1, posx) == makeTile(4, posx)); // NOLINT
+            REQUIRE(next.get(0, posx) == Tile{});
+            REQUIRE(res.get(0, posx) == makeTile(0, posx));
+        }
+    }
+}
+
+TEST_CASE("WaTor::MapLine deferred initialization") { // NOLINT
+    const MapLineStorage storage = GENERATE(MapLineStorage::TILES, MapLineStorage::SPLIT);
+    MapLine res{3, 70, std::pmr::get_default_resource(), storage, MapLineLayout::ROWS, true}; // NOLINT
+    CHECK(!res.isInitialized());
+    CHECK(res.hasEntityPlane() == (storage == MapLineStorage::SPLIT));
+
+    res.initialize();
+    REQUIRE(res.isInitialized());
+    for(unsigned posy=0; posy<res.getHeight(); ++posy) {
+        for(unsigned posx=0; posx<res.getWidth(); ++posx) {
+            CHECK(res.get(posy, posx).getEntity() == Entity::WATER);
+        }
+        for(unsigned block=0; block<res.getBlockCnt(); ++block) {
+            CHECK(res.isBlockOccupied(posy, block));
+        }
+        if(res.hasEntityPlane()) {
+            // all water, without the bits past the width
+            CHECK(res.getEntityRowPtr(posy)[MapLine::ENTITY_WATER] == ~MapLine::EntityWord{0});
+            CHECK(res.getEntityRowPtr(posy)[MapLine::ENTITY_WORDS_PER_BLOCK + MapLine::ENTITY_WATER] == 0x3FU); // NOLINT
+            CHECK(res.getEntityRowPtr(posy)[MapLine::ENTITY_FISH] == 0);
+        }
     }
 }
+
+TEST_CASE("WaTor::MapLine .moveRows") { // NOLINT
+    const MapLineLayout layout = GENERATE(MapLineLayout::ROWS, MapLineLayout::PANELS);
+    const unsigned width = MapLine::PANEL_WIDTH + 2*MapLine::BLOCK_WIDTH + 5;
+    auto *mmr = std::pmr::get_default_resource();
+    MapLine upper{6, width, mmr, MapLineStorage::SPLIT, layout, false, 3};
+    MapLine lower{6, width, mmr, MapLineStorage::SPLIT, layout, false, 3};
+    CHECK(upper.getMaxHeight() == 12);
+    CHECK(upper.getSpareRowsTop() == 3);
+    CHECK(upper.getSpareRowsBottom() == 3);
+
+    // the entity of a row of both lines together
+    auto entityOf = [](unsigned row, unsigned posx) {
+        const unsigned val = (row*7 + posx) % 5;
+        return (val == 0) ? Entity::FISH : ((val == 1) ? Entity::SHARK : Entity::WATER);
+    };
+    for(unsigned posx=0; posx<width; ++posx) {
+        for(unsigned posy=0; posy<6; ++posy) {
+            upper.get(posy, posx) = Tile{entityOf(posy, posx), 0, 0};
+            lower.get(posy, posx) = Tile{entityOf(posy+6, posx), 0, 0};
+        }
+    }
+    upper.updateEntityPlane();
+    lower.updateEntityPlane();
+    upper.updateOccupancy(5);
+    // an empty row
+    for(unsigned posx=0; posx<width; ++posx) {
+        lower.get(1, posx) = Tile{};
+    }
+    lower.updateEntityPlane();
+    lower.updateOccupancy(1);
+
+    auto check = [&](unsigned upperHeight) {
+        REQUIRE(upper.getHeight() == upperHeight);
+        REQUIRE(lower.getHeight() == 12 - upperHeight);
+        for(unsigned row=0; row<12; ++row) {
+            const MapLine &line = (row < upperHeight) ? upper : lower;
+            const unsigned posy = (row < upperHeight) ? row : row - upperHeight;
+            const MapLine::EntityWord *entRow = line.getEntityRowPtr(posy);
+            for(unsigned posx=0; posx<width; ++posx) {
+                const Entity ent = (row == 7) ? Entity::WATER : entityOf(row, posx);
+                REQUIRE(line.get(posy, posx).getEntity() == ent);
+                const MapLine::EntityWord *block = entRow + MapLine::ENTITY_WORDS_PER_BLOCK*(posx / MapLine::BLOCK_WIDTH);
+                REQUIRE(((block[MapLine::ENTITY_WATER] >> (posx % MapLine::BLOCK_WIDTH)) & 1U) ==
+                        static_cast<unsigned>(ent == Entity::WATER));
+            }
+            CHECK(line.isBlockOccupied(posy, 0) == (row != 7));
+        }
+    };
+
+    MapLine::moveRows(upper, lower, 2);
+    check(8);
+    MapLine::moveRows(upper, lower, -5);
+    check(3);
+    // more than the spare rows on one side, the other rows are moved first
+    MapLine::moveRows(upper, lower, -1);
+    CHECK(lower.getSpareRowsTop() + lower.getSpareRowsBottom() == 2);
+    check(2);
+    MapLine::moveRows(upper, lower, 8);
+    check(10);
+    CHECK(lower.getSpareRowsTop() + lower.getSpareRowsBottom() == 10);
+    upper.centerRows();
+    CHECK(upper.getSpareRowsTop() == 1);
+    CHECK(upper.getSpareRowsBottom() == 1);
+    check(10);
+
+    // the halo rows are loaded from the moved rows
+    upper.loadHalo(lower, lower);
+    CHECK(upper.getHaloBottom(0).getEntity() == entityOf(10, 0));
+    CHECK(upper.getHaloTop(3).getEntity() == entityOf(11, 3));
+
+    const std::size_t absSize = upper.getAbsSize();
+    CHECK(absSize == std::size_t{10}*width);
+    CHECK(upper.getAbs(absSize-1).getEntity() == entityOf(9, width-1));
+}
@@ -1,7 +1,16 @@
 #include <catch2/catch.hpp>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <numeric>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include "posixFostream.hpp"
 #include "wator/entity.hpp"
@@ -11,6 +20,74 @@
 #include "wator/rules.hpp"
 #include "wator/tile.hpp"
 
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+    // every WINDOW bytes of a larger allocation are the same memory, so
+    // a map larger than the RAM can be built, the tiles alias each other,
+    // the smaller allocations (MapNuma, MapLine) do not
+    class AliasedResource : public std::pmr::memory_resource {
+    private:
+        static constexpr std::size_t WINDOW = std::size_t{16} << 20U;
+        int m_fd;
+
+    public:
+        AliasedResource() : m_fd(memfd_create("aliased_resource", 0)) {
+            if(m_fd < 0 || ftruncate(m_fd, WINDOW) != 0) {
+                throw std::bad_alloc();
+            }
+        }
+        AliasedResource(const AliasedResource&) = delete;
+        AliasedResource& operator=(const AliasedResource&) = delete;
+        ~AliasedResource() override { close(m_fd); }
+
+        [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+
+        void* do_allocate(std::size_t bytes, std::size_t /*alignment*/) override {
+            bytes = (bytes + WINDOW - 1)/WINDOW*WINDOW;
+            void *res = mmap(nullptr, bytes, (bytes > WINDOW) ? PROT_NONE : PROT_READ | PROT_WRITE, 
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if(res == MAP_FAILED) { // NOLINT
+                throw std::bad_alloc();
+            }
+            for(std::size_t off=0; off<bytes && bytes>WINDOW; off += WINDOW) {
+                if(mmap(static_cast<char*>(res) + off, WINDOW, PROT_READ | PROT_WRITE, // NOLINT
+                        MAP_SHARED | MAP_FIXED, m_fd, 0) == MAP_FAILED) { // NOLINT
+                    munmap(res, bytes);
+                    throw std::bad_alloc();
+                }
+            }
+            return res;
+        }
+
+        void do_deallocate(void *ptr, std::size_t bytes, std::size_t /*alignment*/) override {
+            munmap(ptr, (bytes + WINDOW - 1)/WINDOW*WINDOW);
+        }
+    };
+
+    class AliasedAllocStrategy : public WaTor::MapAllocStrategy {
+    private:
+        AliasedResource m_resource;
+
+    public:
+        auto operator() (const ExecutionPlanner &exp) 
+            -> std::unique_ptr<std::pmr::memory_resource*[]> override { // NOLINT
+            auto res = std::make_unique<std::pmr::memory_resource*[]>(exp.getNumaList().size()); // NOLINT
+            for(unsigned i=0; i<exp.getNumaList().size(); ++i) {
+                res[i] = &m_resource;
+            }
+            return res;
+        }
+
+        auto getDefaultResource() -> std::pmr::memory_resource* override {
+            return &m_resource;
+        }
+    };
+}
+
 TEST_CASE("WaTor::Map General usage on NUMA") { // NOLINT
     std::vector<unsigned> numaList = {0, 1};
     std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {2, 3}};
@@ -87,6 +164,50 @@ TEST_CASE("WaTor::Map Verify line heights") {  // NOLINT
     }
 }
 
+TEST_CASE("WaTor::Map line pairs") {  // NOLINT
+    std::vector<unsigned> numaList = {0, 1};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {10, 11, 12}}; // NOLINT
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma)); // NOLINT
+    ExecutionPlanner oneCpuExp = ExecutionPlanner::makeMock({0}, {{0}});
+    using namespace WaTor;
+
+    const unsigned linePairs = GENERATE(5U, 12U);
+    for(unsigned height=100; height<=110; ++height) { // NOLINT
+        Map map{height, 5, exp, std::make_unique<MockAllocStrategy>(), MapLineStorage::TILES, // NOLINT
+                MapLineLayout::ROWS, false, linePairs};
+        Map oneCpuMap{height, 5, oneCpuExp, std::make_unique<MockAllocStrategy>(), MapLineStorage::TILES, // NOLINT
+                      MapLineLayout::ROWS, false, linePairs};
+        CHECK(map.getLinePairCnt() == linePairs);
+
+        // the lines do not depend on the CPUs
+        std::vector<unsigned> heights;
+        unsigned firstCpu = 0;
+        for(unsigned numaInd=0; numaInd<map.getMapNumaCnt(); ++numaInd) {
+            MapNuma &numa = map.getMapNuma(numaInd);
+            const auto endCpu = firstCpu + static_cast<unsigned>(exp.getCpuListPerNuma(numaInd).size());
+            CHECK(numa.getLineCnt() == 2*(Map::getCpuFirstPair(linePairs, 5, endCpu) - 
+                                          Map::getCpuFirstPair(linePairs, 5, firstCpu)));
+            for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
+                CHECK(numa.getLine(lineInd).getHeight() >= 2);
+                heights.push_back(numa.getLine(lineInd).getHeight());
+            }
+            firstCpu = endCpu;
+        }
+        std::vector<unsigned> oneCpuHeights;
+        for(unsigned lineInd=0; lineInd<oneCpuMap.getMapNuma(0).getLineCnt(); ++lineInd) {
+            oneCpuHeights.push_back(oneCpuMap.getMapNuma(0).getLine(lineInd).getHeight());
+        }
+        CHECK(heights == oneCpuHeights);
+        CHECK(std::accumulate(heights.begin(), heights.end(), 0U) == height);
+    }
+
+    CHECK(Map{100, 5, exp, std::make_unique<MockAllocStrategy>()}.getLinePairCnt() == 5); // NOLINT
+    CHECK_THROWS_AS((Map{40, 5, exp, std::make_unique<MockAllocStrategy>(), MapLineStorage::TILES, // NOLINT
+                         MapLineLayout::ROWS, false, 12}), std::runtime_error);
+    CHECK_THROWS_AS((Map{200, 5, exp, std::make_unique<MockAllocStrategy>(), MapLineStorage::TILES, // NOLINT
+                         MapLineLayout::ROWS, false, 4}), std::invalid_argument);
+}
+
 namespace {
     template<class TS, class TC>
     void mapSetAndCheck(WaTor::Map &map, TS ts, TC tc) {  // NOLINT
@@ -205,7 +326,7 @@ TEST_CASE("WaTor::Map .getCord") {  // NOLINT
     mapSetAndCheck(omap, ts2, tc2);
 }
 
-TEST_CASE("WaTor::Map .getUpdateMask .getTopMask .getBottomMask") {  // NOLINT
+TEST_CASE("WaTor::Map .setParity") {  // NOLINT
     std::vector<unsigned> numaList = {0, 1};
     std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {2, 3}};
     ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
@@ -213,43 +334,32 @@ TEST_CASE("WaTor::Map .getUpdateMask .getTopMask .getBottomMask") {  // NOLINT
 
     Map omap{37, 5, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
 
-    auto ts1 = [](Map &map, unsigned numaInd, unsigned lineInd, 
-                                         unsigned, unsigned posx) {
-        const bool bit = (posx % 2 == 0);
-        auto cur1 = map.getMapNuma(numaInd).getLine(lineInd).getUpdateMask(posx);
-        auto cur2 = map.getMapNuma(numaInd).getLine(lineInd).getTopMask(posx);
-        auto cur3 = map.getMapNuma(numaInd).getLine(lineInd).getBottomMask(posx);
-        cur1 = bit; cur2 = bit; cur3 = bit;
-    };
-    auto tc1 = [](Map &map, unsigned numaInd, unsigned lineInd, 
-                                         unsigned, unsigned posx) {
-        const Map &cmap = map;
-        const bool bit = (posx % 2 == 0);
-        bool cur1 = cmap.getUpdateMask(numaInd, lineInd, posx);
-        bool cur2 = cmap.getBottomMask(numaInd, lineInd, posx);
-        bool cur3 = cmap.getTopMask(numaInd, lineInd, posx);
-        CHECK(cur1 == bit); CHECK(cur2 == bit); CHECK(cur3 == bit);
-    };
-    auto ts2 = [](Map &map, unsigned numaInd, unsigned lineInd, 
-                                         unsigned, unsigned posx) {
-        const bool nbit = (posx % 2 == 1);
-        auto cur1 = map.getUpdateMask(numaInd, lineInd, posx);
-        auto cur2 = map.getBottomMask(numaInd, lineInd, posx);
-        auto cur3 = map.getTopMask(numaInd, lineInd, posx);
-        cur1 = nbit; cur2 = nbit; cur3 = nbit;
+    const Tile dfish{Entity::FISH, 0, 0};
+    const Tile dshark{Entity::SHARK, 1, 1};
+
+    auto ts1 = [dfish, dshark](Map &map, unsigned numaInd, unsigned lineInd, 
+                                         unsigned posy, unsigned posx) {
+        const unsigned type = (posy + posx)%3;
+        map.get(numaInd, lineInd, posy, posx) = (type == 0) ? Tile{} : ((type == 1) ? dfish : dshark);
     };
-    auto tc2 = [](Map &map, unsigned numaInd, unsigned lineInd, 
-                                         unsigned, unsigned posx) {
-        const bool nbit = (posx % 2 == 1);
-        const Map &cmap = map;
-        bool cur1 = cmap.getMapNuma(numaInd).getLine(lineInd).getUpdateMask(posx);
-        bool cur2 = cmap.getMapNuma(numaInd).getLine(lineInd).getTopMask(posx);
-        bool cur3 = cmap.getMapNuma(numaInd).getLine(lineInd).getBottomMask(posx);
-        CHECK(cur1 == nbit); CHECK(cur2 == nbit); CHECK(cur3 == nbit);
+    auto tc1 = [](bool parity) {
+        return [parity](Map &map, unsigned numaInd, unsigned lineInd, 
+                        unsigned posy, unsigned posx) {
+            const Map &cmap = map;
+            const Tile &cur = cmap.get(numaInd, lineInd, posy, posx);
+            if(cur.getEntity() == Entity::WATER) {
+                CHECK(cur.getRaw() == 0);
+            } else {
+                CHECK(cur.getParity() == parity);
+            }
+        };
     };
 
-    mapSetAndCheck(omap, ts1, tc1);
-    mapSetAndCheck(omap, ts2, tc2);
+    mapSetAndCheck(omap, ts1, tc1(false));
+    omap.setParity(true);
+    mapSetAndCheck(omap, [](Map&, unsigned, unsigned, unsigned, unsigned) {}, tc1(true));
+    omap.setParity(false);
+    mapSetAndCheck(omap, [](Map&, unsigned, unsigned, unsigned, unsigned) {}, tc1(false));
 }
 
 
@@ -259,8 +369,10 @@ TEST_CASE("WaTor::Map .dirHelper and .dirFastRight") {  // NOLINT
     ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
     using namespace WaTor;
 
-    // chess pattern
-    Map omap{32, 4, exp, std::make_unique<MockAllocStrategy>()};  // NOLINT
+    // chess pattern, with panels the tiles of a row are not contiguous
+    const MapLineLayout layout = GENERATE(MapLineLayout::ROWS, MapLineLayout::PANELS);
+    const unsigned width = (layout == MapLineLayout::ROWS) ? 4 : 2*MapLine::PANEL_WIDTH + 52; // NOLINT
+    Map omap{32, width, exp, std::make_unique<MockAllocStrategy>(), MapLineStorage::TILES, layout};  // NOLINT
 
     const Tile dfish{Entity::FISH, 0, 0};
     const Tile dshark{Entity::SHARK, 1, 1};
@@ -270,10 +382,6 @@ TEST_CASE("WaTor::Map .dirHelper and .dirFastRight") {  // NOLINT
         // chess pattern
         const Tile curEnt{((posx + posy)%2 == 0) ? dfish : dshark};
         map.get(numaInd, lineInd, posy, posx) = curEnt;
-        const bool bit = (posx % 2 == 0);
-        map.getUpdateMask(numaInd, lineInd, posx) = bit;
-        map.getTopMask(numaInd, lineInd, posx) = bit;
-        map.getBottomMask(numaInd, lineInd, posx) = bit;
     };
 
     auto tc1 = [dfish, dshark](Map &map, unsigned numaInd, unsigned lineInd,  // NOLINT
@@ -281,18 +389,12 @@ TEST_CASE("WaTor::Map .dirHelper and .dirFastRight") {  // NOLINT
         const Map &cmap = map;
 
         const Tile opEnt{((posx + posy)%2 == 0) ? dshark : dfish};
-        const bool nbit = (posx % 2 == 1);
         Map::Cordinate cord = map.makeCordinate(numaInd, lineInd, posy, posx);
 
         std::array<Map::Cordinate, 4> dirCord;
         for(unsigned i=0; i<dirCord.size(); ++i) {
             dirCord[i] = map.dirHelper(cord, i);
             CHECK(cmap.get(dirCord[i]) == opEnt);
-            if(i == 1 || i == 3) {
-                CHECK(cmap.getUpdateMask(dirCord[i]) == nbit);
-                CHECK(cmap.getUpdateMask(dirCord[i]) == nbit);
-                CHECK(cmap.getUpdateMask(dirCord[i]) == nbit);
-            }
         }
     };
 
@@ -309,14 +411,12 @@ TEST_CASE("WaTor::Map .dirHelper and .dirFastRight") {  // NOLINT
             // cbot = map.makeBottomMaskCache(ccord);
         } else {
             const Tile curEnt{((posx + posy)%2 == 0) ? dfish : dshark};
-            const bool bit = (posx % 2 == 0);
 
             // Map::Cordinate tcord = ccord;
             // Map::Cordinate bcord = ccord;
 
             map.dirRightFast(ccord);
             CHECK(cmap.get(ccord) == curEnt);
-            CHECK(cmap.getUpdateMask(ccord) == bit);
             
             // map.dirRightFast(tcord, ctop);
             // CHECK(cmap.get(tcord) == curEnt);
@@ -334,53 +434,51 @@ TEST_CASE("WaTor::Map .dirHelper and .dirFastRight") {  // NOLINT
     mapSetAndCheck(omap, mts, tc2);
 }
 
-TEST_CASE("WaTor::Map .getUpdateMask(cord) .getTopMask(cord) .getBottomMask(cord)") {  // NOLINT
+TEST_CASE("WaTor::Map .moveLineBoundary") {  // NOLINT
     std::vector<unsigned> numaList = {0, 1};
-    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {2, 3}};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0}, {1}};
     ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
     using namespace WaTor;
 
-    Map omap{37, 5, exp, std::make_unique<MockAllocStrategy>()};  // NOLINT
+    // 4 lines of 10 rows with room for 4 more above and bellow
+    Map map{40, 5, exp, std::make_unique<MockAllocStrategy>(), MapLineStorage::TILES, // NOLINT
+            MapLineLayout::ROWS, false, 0, 4};
+    map.randomize(40, 10, 3); // NOLINT
+    std::ostringstream beforeStr;
+    map.saveMap(beforeStr, true);
+
+    map.moveLineBoundary(0, 0, 3);
+    map.moveLineBoundary(0, 1, -5); // NOLINT
+    map.moveLineBoundary(1, 0, 2);
+
+    // the entities stay where they are
+    std::ostringstream afterStr;
+    map.saveMap(afterStr, true);
+    CHECK(beforeStr.str() == afterStr.str());
+
+    const std::vector<unsigned> heights = {13, 2, 17, 8};
+    unsigned firstRow = 0;
+    for(unsigned k=0; k<4; ++k) {
+        CHECK(map.getMapLineHeight(k/2, k%2) == heights[k]);
+        CHECK(map.getLineFirstRow(k/2, k%2) == firstRow);
+        firstRow += heights[k];
+    }
+}
 
-    auto ts1 = [](Map &map, unsigned numaInd, unsigned lineInd, 
-                                         unsigned, unsigned posx) {
-        const bool bit = (posx % 2 == 0);
-        auto cur1 = map.getUpdateMask(numaInd, lineInd, posx);
-        auto cur2 = map.getBottomMask(numaInd, lineInd, posx);
-        auto cur3 = map.getTopMask(numaInd, lineInd, posx);
-        cur1 = bit; cur2 = bit; cur3 = bit;
-    };
-    auto tc1 = [](Map &map, unsigned numaInd, unsigned lineInd, 
-                                         unsigned posy, unsigned posx) {
-        const bool bit = (posx % 2 == 0);
-        const Map &cmap = map;
-        Map::Cordinate cord = map.makeCordinate(numaInd, lineInd, posy, posx);
-        bool cur1 = cmap.getUpdateMask(cord);
-        bool cur2 = cmap.getTopMask(cord);
-        bool cur3 = cmap.getBottomMask(cord);
-        CHECK(cur1 == bit); CHECK(cur2 == bit); CHECK(cur3 == bit);
-    };
-    auto ts2 = [](Map &map, unsigned numaInd, unsigned lineInd, 
-                                         unsigned posy, unsigned posx) {
-        const bool nbit = (posx % 2 == 1);
-        Map::Cordinate cord = map.makeCordinate(numaInd, lineInd, posy, posx);
-        auto cur1 = map.getUpdateMask(cord);
-        auto cur2 = map.getTopMask(cord);
-        auto cur3 = map.getBottomMask(cord);
-        cur1 = nbit; cur2 = nbit; cur3 = nbit;
-    };
-    auto tc2 = [](Map &map, unsigned numaInd, unsigned lineInd, 
-                                         unsigned, unsigned posx) {
-        const Map &cmap = map;
-        const bool nbit = (posx % 2 == 1);
-        bool cur1 = cmap.getUpdateMask(numaInd, lineInd, posx);
-        bool cur2 = cmap.getTopMask(numaInd, lineInd, posx);
-        bool cur3 = cmap.getBottomMask(numaInd, lineInd, posx);
-        CHECK(cur1 == nbit); CHECK(cur2 == nbit); CHECK(cur3 == nbit);
-    };
+TEST_CASE("WaTor::Map .getPrevLine and .getNextLine") {  // NOLINT
+    std::vector<unsigned> numaList = {0, 1};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {2, 3}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+    using namespace WaTor;
 
-    mapSetAndCheck(omap, ts1, tc1);
-    mapSetAndCheck(omap, ts2, tc2);
+    Map map{32, 4, exp, std::make_unique<MockAllocStrategy>()};  // NOLINT
+
+    CHECK(&map.getPrevLine(0, 0) == &map.getMapNuma(1).getLine(3));
+    CHECK(&map.getNextLine(1, 3) == &map.getMapNuma(0).getLine(0));
+    CHECK(&map.getPrevLine(1, 0) == &map.getMapNuma(0).getLine(3));
+    CHECK(&map.getNextLine(0, 3) == &map.getMapNuma(1).getLine(0));
+    CHECK(&map.getPrevLine(0, 2) == &map.getMapNuma(0).getLine(1));
+    CHECK(&map.getNextLine(0, 2) == &map.getMapNuma(0).getLine(3));
 }
 
 TEST_CASE("WaTor::Map .saveMap") {  // NOLINT
@@ -428,6 +526,172 @@ TEST_CASE("WaTor::Map .saveMap") {  // NOLINT
     }
 }
 
+TEST_CASE("WaTor::Map .saveMap from the entity plane and panels") {  // NOLINT
+    std::vector<unsigned> numaList = {0, 1};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {2, 3}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+    using namespace WaTor;
+
+    // rows are not a multiple of 4 tiles or of a block
+    const unsigned width = GENERATE(5U, 70U, 131U, 2*MapLine::PANEL_WIDTH + 3);
+    Map tilesMap{31, width, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    Map splitMap{31, width, exp, std::make_unique<MockAllocStrategy>(), MapLineStorage::SPLIT}; // NOLINT
+    Map panelsMap{31, width, exp, std::make_unique<MockAllocStrategy>(), // NOLINT
+                  MapLineStorage::TILES, MapLineLayout::PANELS};
+    REQUIRE(splitMap.getStorage() == MapLineStorage::SPLIT);
+    REQUIRE(splitMap.getMapNuma(1).getLine(2).hasEntityPlane());
+
+    const std::size_t fishCnt = 31*width/3, sharkCnt = 31*width/5; // NOLINT
+    tilesMap.randomize(fishCnt, sharkCnt, 7); // NOLINT
+    splitMap.randomize(fishCnt, sharkCnt, 7); // NOLINT
+    panelsMap.randomize(fishCnt, sharkCnt, 7); // NOLINT
+
+    std::ostringstream tilesStr, splitStr, panelsStr;
+    tilesMap.saveMap(tilesStr, true);
+    splitMap.saveMap(splitStr, true);
+    panelsMap.saveMap(panelsStr, true);
+    CHECK(tilesStr.str() == splitStr.str());
+    CHECK(tilesStr.str() == panelsStr.str());
+}
+
+TEST_CASE("WaTor::Map .randomize") {  // NOLINT
+    std::vector<unsigned> numaList = {0, 1};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {2, 3, 4}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+    using namespace WaTor;
+
+    // sparse and dense, so every kind fills the lines once
+    std::size_t fishCnt = 0;
+    std::size_t sharkCnt = 0;
+    std::tie(fishCnt, sharkCnt) = GENERATE(table<std::size_t, std::size_t>({{700, 200}, {3000, 200}, {400, 2800}}));
+    Map map{51, 100, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    map.randomize(fishCnt, sharkCnt, 11); // NOLINT
+
+    const auto population = map.splitPopulation(fishCnt, sharkCnt, 11); // NOLINT
+    std::size_t splitFishCnt = 0;
+    std::size_t splitSharkCnt = 0;
+    for(unsigned numaInd=0; numaInd<map.getMapNumaCnt(); ++numaInd) {
+        const MapNuma &numa = map.getMapNuma(numaInd);
+        REQUIRE(population[numaInd].size() == numa.getLineCnt());
+        for(unsigned lineInd=0; lineInd<numa.getLineCnt(); ++lineInd) {
+            const MapLine &line = numa.getLine(lineInd);
+            std::size_t lineFishCnt = 0;
+            std::size_t lineSharkCnt = 0;
+            for(unsigned posy=0; posy<line.getHeight(); ++posy) {
+                for(unsigned posx=0; posx<line.getWidth(); ++posx) {
+                    lineFishCnt += (line.get(posy, posx).getEntity() == Entity::FISH);
+                    lineSharkCnt += (line.get(posy, posx).getEntity() == Entity::SHARK);
+                }
+            }
+            CHECK(lineFishCnt == population[numaInd][lineInd].fishCnt);
+            CHECK(lineSharkCnt == population[numaInd][lineInd].sharkCnt);
+            splitFishCnt += lineFishCnt;
+            splitSharkCnt += lineSharkCnt;
+        }
+    }
+    CHECK(splitFishCnt == fishCnt);
+    CHECK(splitSharkCnt == sharkCnt);
+
+    // the lines in reverse order, over a different map
+    Map reverseMap{51, 100, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    reverseMap.randomize(100, 100, 3); // NOLINT
+    for(unsigned numaInd=reverseMap.getMapNumaCnt(); numaInd-- > 0;) {
+        for(unsigned lineInd=reverseMap.getMapNuma(numaInd).getLineCnt(); lineInd-- > 0;) {
+            reverseMap.randomizeLine(numaInd, lineInd, fishCnt, sharkCnt, 11); // NOLINT
+        }
+    }
+    std::ostringstream mapStr, reverseStr;
+    map.saveMap(mapStr, true);
+    reverseMap.saveMap(reverseStr, true);
+    CHECK(mapStr.str() == reverseStr.str());
+
+    Map otherSeedMap{51, 100, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    otherSeedMap.randomize(fishCnt, sharkCnt, 12); // NOLINT
+    std::ostringstream otherSeedStr;
+    otherSeedMap.saveMap(otherSeedStr, true);
+    CHECK(mapStr.str() != otherSeedStr.str());
+
+    CHECK_THROWS_AS(map.randomize(5000, 101, 1), std::invalid_argument); // NOLINT
+}
+
+TEST_CASE("WaTor::Map .randomize does not depend on the lines") {  // NOLINT
+    using namespace WaTor;
+    std::size_t fishCnt = 0;
+    std::size_t sharkCnt = 0;
+    std::tie(fishCnt, sharkCnt) = GENERATE(table<std::size_t, std::size_t>({{700, 200}, {400, 2800}}));
+
+    auto randomizedMap = [&](std::vector<std::vector<unsigned>> cpusPerNuma, unsigned linePairs) {
+        std::vector<unsigned> numaList(cpusPerNuma.size());
+        std::iota(numaList.begin(), numaList.end(), 0);
+        ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+        Map map{51, 100, exp, std::make_unique<MockAllocStrategy>(), MapLineStorage::TILES, // NOLINT
+                MapLineLayout::ROWS, false, linePairs};
+        map.randomize(fishCnt, sharkCnt, 11); // NOLINT
+        std::ostringstream res;
+        map.saveMap(res, true);
+        return res.str();
+    };
+
+    const std::string onePair = randomizedMap({{0}}, 1);
+    CHECK(onePair == randomizedMap({{0}}, 3));
+    CHECK(onePair == randomizedMap({{0, 1, 2}}, 3));
+    CHECK(onePair == randomizedMap({{0, 1}, {2, 3, 4}}, 10)); // NOLINT
+}
+
+TEST_CASE("WaTor::Map deferred initialization") {  // NOLINT
+    std::vector<unsigned> numaList = {0, 1};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {2, 3}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+    using namespace WaTor;
+
+    Map map{40, 130, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    Map deferredMap{40, 130, exp, std::make_unique<MockAllocStrategy>(), // NOLINT
+                    MapLineStorage::SPLIT, MapLineLayout::ROWS, true};
+    REQUIRE(!deferredMap.getMapNuma(1).getLine(3).isInitialized());
+
+    // every line on its own thread, the rest by Map::initialize
+    {
+        std::vector<std::thread> threads;
+        for(unsigned numaInd=0; numaInd<deferredMap.getMapNumaCnt(); ++numaInd) {
+            for(unsigned lineInd=0; lineInd<3; ++lineInd) {
+                threads.emplace_back([&line = deferredMap.getMapNuma(numaInd).getLine(lineInd)]() {
+                    line.initialize();
+                });
+            }
+        }
+        for(std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+    deferredMap.initialize();
+    REQUIRE(deferredMap.getMapNuma(1).getLine(3).isInitialized());
+
+    map.randomize(1000, 300, 5); // NOLINT
+    deferredMap.randomize(1000, 300, 5); // NOLINT
+    std::ostringstream mapStr, deferredStr;
+    map.saveMap(mapStr, true);
+    deferredMap.saveMap(deferredStr, true);
+    CHECK(mapStr.str() == deferredStr.str());
+}
+
+TEST_CASE("WaTor::Map on huge pages") {  // NOLINT
+    // a single node, the default resource of the strategy is used
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+    using namespace WaTor;
+
+    Map map{40, 300, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    Map hugeMap{40, 300, exp, std::make_unique<NumaAllocStrategy>(true)}; // NOLINT
+    map.randomize(4000, 1000, 3); // NOLINT
+    hugeMap.randomize(4000, 1000, 3); // NOLINT
+
+    std::ostringstream mapStr, hugeStr;
+    map.saveMap(mapStr, true);
+    hugeMap.saveMap(hugeStr, true);
+    CHECK(mapStr.str() == hugeStr.str());
+}
+
 #ifdef __unix__
 
 #include <fcntl.h>
@@ -455,3 +719,47 @@ TEST_CASE("WaTor::Map .saveMap posixFostream") { // NOLINT
 }
 
 #endif // __unix__ 
+
+TEST_CASE("WaTor::Map with more than 4 G tiles in a line") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+    using namespace WaTor;
+
+    const MapLineLayout layout = GENERATE(MapLineLayout::ROWS, MapLineLayout::PANELS);
+    constexpr unsigned width = 65600;
+    constexpr unsigned lineHeight = 65600;
+    // only the second line is initialized
+    Map map{2*lineHeight, width, exp, std::make_unique<AliasedAllocStrategy>(), // NOLINT
+            MapLineStorage::TILES, layout, true};
+    MapLine &line = map.getMapNuma(0).getLine(1);
+    REQUIRE(line.getHeight() == lineHeight);
+    REQUIRE(line.getAbsSize() > std::numeric_limits<std::uint32_t>::max());
+    line.initialize();
+
+    const unsigned posy = lineHeight-1;
+    const unsigned posx = width-1;
+    const std::size_t indx = static_cast<std::size_t>(posy)*width + posx;
+    Tile &last = line.get(posy, posx);
+    CHECK(&line.getAbs(indx) == &last);
+    CHECK(&map.get(0, 1, posy, posx) == &last);
+
+    // the offset from the first stored tile
+    const unsigned panel = line.getPanelCnt()-1;
+    const std::size_t panelBeg = line.getPanelBegin(panel);
+    const std::size_t offset = panelBeg*(lineHeight+2) + 
+                               static_cast<std::size_t>(posy+1)*line.getPanelWidth(panel) + (posx - panelBeg);
+    CHECK(static_cast<std::size_t>(&last - &line.getHaloTop(0)) == offset);
+    CHECK(static_cast<std::size_t>(&line.getHaloBottom(posx) - &last) == line.getRowStride(posx));
+
+    Map::Cordinate cord = map.makeCordinate(0, 1, posy, posx-1);
+    map.dirRightFast(cord);
+    CHECK(&map.get(cord) == &last);
+
+    last = Tile{Entity::SHARK, 3, 2}; // NOLINT
+    CHECK(line.get(posy, posx).getEntity() == Entity::SHARK);
+
+    const auto population = map.splitPopulation(std::size_t{1} << 32U, std::size_t{1} << 31U, 5); // NOLINT
+    CHECK(population[0][0].fishCnt + population[0][1].fishCnt == std::size_t{1} << 32U);
+    CHECK(population[0][0].sharkCnt + population[0][1].sharkCnt == std::size_t{1} << 31U);
+}
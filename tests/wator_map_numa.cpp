@@ -7,15 +7,10 @@
 #include "wator/map_line.hpp"
 #include "wator/map_numa.hpp"
 
-TEST_CASE("Wator::MapNuma General usage on NUMA") {  // NOLINT
-    std::vector<unsigned> numaList = {0, 1};
-    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {10, 11}}; // NOLINT
-
-    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
-
+TEST_CASE("Wator::MapNuma General usage") {  // NOLINT
     using namespace WaTor;
     unsigned width = GENERATE(3U, 5U, 69U, 420U);
-    MapNuma mapn{27, width, 1, exp, std::pmr::get_default_resource()}; // NOLINT
+    MapNuma mapn{27, width, 4, std::pmr::get_default_resource()}; // NOLINT
 
     // CHECK(mapn.getNumaIndex() == 1);
     CHECK(mapn.getLineCnt() == 4);
@@ -34,15 +29,10 @@ TEST_CASE("Wator::MapNuma General usage on NUMA") {  // NOLINT
     }
 }
 
-TEST_CASE("Wator::MapNuma General usage NO NUMA") {  // NOLINT
-    std::vector<unsigned> numaList = {0};
-    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 7, 13, 21}}; // NOLINT
-
-    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
-
+TEST_CASE("Wator::MapNuma more lines") {  // NOLINT
     using namespace WaTor;
     unsigned width = GENERATE(3U, 5U, 69U, 420U);
-    MapNuma mapn{59, width, 0, exp, std::pmr::get_default_resource()}; // NOLINT
+    MapNuma mapn{59, width, 8, std::pmr::get_default_resource()}; // NOLINT
 
     // CHECK(mapn.getNumaIndex() == 0);
     CHECK(mapn.getLineCnt() == 8);
@@ -62,14 +52,9 @@ TEST_CASE("Wator::MapNuma General usage NO NUMA") {  // NOLINT
 }
 
 TEST_CASE("Wator::MapNuma Verify line heights") {  // NOLINT
-    std::vector<unsigned> numaList = {0, 1, 5};  // NOLINT
-    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}, {10, 11}, {20, 21, 22}}; // NOLINT
-
-    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
-
     using namespace WaTor;
     for(unsigned height=20; height<=30; ++height) { // NOLINT
-        MapNuma mapn{height, 3, 1, exp, std::pmr::get_default_resource()}; // NOLINT
+        MapNuma mapn{height, 3, 4, std::pmr::get_default_resource()}; // NOLINT
 
         std::vector<unsigned> heights;
         heights.reserve(4);
@@ -0,0 +1,44 @@
+#include <catch2/catch.hpp>
+#include <vector>
+
+#include "wator/stripe_rebalancer.hpp"
+
+using namespace WaTor;
+
+TEST_CASE("WaTor::StripeRebalancer .plan") {  // NOLINT
+    // the lines of two workers, the even and the odd ones in a group each
+    const std::vector<StripeRebalancer::Line> lines = {
+        {10, 20, 0}, {10, 20, 1}, {10, 20, 2}, {10, 20, 3}
+    };
+
+    SECTION("balanced") {
+        const StripeRebalancer rebalancer{0.1, 2, 1}; // NOLINT
+        const std::vector<int> res = rebalancer.plan(lines, {100, 105, 95, 100}); // NOLINT
+        CHECK(res == std::vector<int>{0, 0, 0});
+    }
+
+    SECTION("the rows go to the faster group") {
+        const StripeRebalancer rebalancer{0.1, 2, 1}; // NOLINT
+        // the rows of group 1 cost 30, half of the difference is 3.3 rows
+        const std::vector<int> res = rebalancer.plan(lines, {100, 300, 100, 100}); // NOLINT
+        REQUIRE(res.size() == 3);
+        CHECK(res[0] == 3);
+        CHECK(res[1] == -3);
+        CHECK(res[2] == 0);
+    }
+
+    SECTION("split between the boundaries of a group") {
+        const StripeRebalancer rebalancer{0.1, 2, 3}; // NOLINT
+        const std::vector<int> res = rebalancer.plan(lines, {100, 300, 100, 100}); // NOLINT
+        CHECK(res == std::vector<int>{1, -1, 0});
+    }
+
+    SECTION("the heights are limited") {
+        const StripeRebalancer rebalancer{0.1, 8, 1}; // NOLINT
+        const std::vector<int> res = rebalancer.plan(lines, {100, 1000, 100, 100}); // NOLINT
+        CHECK(res == std::vector<int>{2, 0, 0});
+
+        const std::vector<StripeRebalancer::Line> full = {{10, 11, 0}, {10, 20, 1}};
+        CHECK(StripeRebalancer{0.1, 2, 1}.plan(full, {100, 1000}) == std::vector<int>{1}); // NOLINT
+    }
+}
@@ -0,0 +1,385 @@
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sched.h>
+
+#include <config.h>
+
+#include "wator/map.hpp"
+#include "wator/rules.hpp"
+#include "wator/simulation.hpp"
+
+using namespace WaTor;
+
+namespace {
+    // up to 3 workers on a NUMA node, on the CPUs this process may run on,
+    // without the pinning the missing ones are made up
+    ExecutionPlanner makeMultiWorkerMock() {
+        constexpr std::size_t workerCnt = 3;
+        std::vector<unsigned> cpus;
+        cpu_set_t cpuMask;
+        CPU_ZERO(&cpuMask);
+        if(sched_getaffinity(0, sizeof(cpuMask), &cpuMask) == 0) {
+            for(unsigned cpu=0; cpu<CPU_SETSIZE && cpus.size()<workerCnt; ++cpu) {
+                if(CPU_ISSET(cpu, &cpuMask)) { // NOLINT
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        if(cpus.empty()) {
+            cpus.push_back(0);
+        }
+#ifndef WATOR_CPU_PIN
+        for(unsigned cpu=cpus.back()+1; cpus.size()<workerCnt; ++cpu) {
+            cpus.push_back(cpu);
+        }
+#endif
+        return ExecutionPlanner::makeMock({0}, {cpus});
+    }
+
+    // the saved maps of the two simulations are the same
+    void requireSameMap(const Simulation &sim, const Simulation &other) {
+        std::ostringstream mapStr, otherStr;
+        sim.getMap().saveMap(mapStr, true);
+        other.getMap().saveMap(otherStr, true);
+        REQUIRE(mapStr.str() == otherStr.str());
+    }
+}
+
+TEST_CASE("WaTor::Simulation out-of-core") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    // 1 or 4 pairs of lines
+    const unsigned lineHeight = GENERATE(32U, 8U);
+    const Rules rules{64, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.lineHeight = lineHeight;
+    SimulationOptions outOfCoreOpts = opts;
+    outOfCoreOpts.scratchDir = std::filesystem::temp_directory_path().string();
+
+    Simulation sim{rules, exp, 9, opts}; // NOLINT
+    Simulation outOfCoreSim{rules, exp, 9, outOfCoreOpts}; // NOLINT
+    REQUIRE(std::as_const(sim).getMap().getMapNuma(0).getLineCnt() == 64/lineHeight);
+
+    // the wavefront gives the same map as the half iterations
+    for(unsigned chronon=0; chronon<6; ++chronon) { // NOLINT
+        requireSameMap(sim, outOfCoreSim);
+
+        sim.doIteration();
+        outOfCoreSim.doIteration();
+    }
+
+    opts.engine = SimulationEngine::BITBOARD;
+    opts.scratchDir = outOfCoreOpts.scratchDir;
+    CHECK_THROWS_AS((Simulation{rules, exp, 9, opts}), std::invalid_argument); // NOLINT
+}
+
+TEST_CASE("WaTor::Simulation persistent workers") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    const SimulationEngine engine = GENERATE(SimulationEngine::TILE, SimulationEngine::BITBOARD);
+    const Rules rules{64, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.engine = engine;
+    opts.lineHeight = 16; // NOLINT
+    SimulationOptions persistentOpts = opts;
+    persistentOpts.persistentWorkers = true;
+
+    Simulation sim{rules, exp, 9, opts}; // NOLINT
+    Simulation persistentSim{rules, exp, 9, persistentOpts}; // NOLINT
+    for(unsigned chronon=0; chronon<6; ++chronon) { // NOLINT
+        requireSameMap(sim, persistentSim);
+
+        sim.doIteration();
+        persistentSim.doIteration();
+    }
+    CHECK(persistentSim.getAllRunTime().count() > 0);
+    CHECK(persistentSim.getWaitingTimePerThread().size() == 1);
+
+    persistentOpts.engine = SimulationEngine::TILE;
+    persistentOpts.scratchDir = std::filesystem::temp_directory_path().string();
+    CHECK_THROWS_AS((Simulation{rules, exp, 9, persistentOpts}), std::invalid_argument); // NOLINT
+}
+
+TEST_CASE("WaTor::Simulation persistent workers are stopped") {  // NOLINT
+    ExecutionPlanner exp = makeMultiWorkerMock();
+    const Rules rules{64, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.lineHeight = 8; // NOLINT
+    opts.persistentWorkers = true;
+
+    // the workers leave the barrier before it is destroyed
+    for(unsigned i=0; i<20; ++i) { // NOLINT
+        Simulation sim{rules, exp, i, opts};
+        if(i % 2 == 0) {
+            sim.doIteration();
+        }
+    }
+
+    Simulation sim{rules, exp, 9, opts}; // NOLINT
+    opts.persistentWorkers = false;
+    Simulation barrierSim{rules, exp, 9, opts}; // NOLINT
+    for(unsigned chronon=0; chronon<4; ++chronon) { // NOLINT
+        sim.doIteration();
+        barrierSim.doIteration();
+    }
+    requireSameMap(sim, barrierSim);
+}
+
+TEST_CASE("WaTor::Simulation work stealing") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    const bool persistent = GENERATE(false, true);
+    const Rules rules{64, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.lineHeight = 10; // NOLINT
+    SimulationOptions stealingOpts = opts;
+    stealingOpts.workStealing = true;
+    stealingOpts.persistentWorkers = persistent;
+
+    Simulation sim{rules, exp, 9, opts}; // NOLINT
+    Simulation stealingSim{rules, exp, 9, stealingOpts}; // NOLINT
+    for(unsigned chronon=0; chronon<6; ++chronon) { // NOLINT
+        requireSameMap(sim, stealingSim);
+
+        sim.doIteration();
+        stealingSim.doIteration();
+    }
+
+    stealingOpts.persistentWorkers = false;
+    stealingOpts.scratchDir = std::filesystem::temp_directory_path().string();
+    CHECK_THROWS_AS((Simulation{rules, exp, 9, stealingOpts}), std::invalid_argument); // NOLINT
+}
+
+TEST_CASE("WaTor::Simulation work stealing with several workers") {  // NOLINT
+    ExecutionPlanner exp = makeMultiWorkerMock();
+
+    const bool persistent = GENERATE(false, true);
+    // 1 or 3 pairs of lines per worker
+    const unsigned lineHeight = GENERATE(16U, 5U);
+    const Rules rules{96, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.lineHeight = lineHeight;
+    SimulationOptions stealingOpts = opts;
+    stealingOpts.workStealing = true;
+    stealingOpts.persistentWorkers = persistent;
+
+    Simulation sim{rules, exp, 9, opts}; // NOLINT
+    Simulation stealingSim{rules, exp, 9, stealingOpts}; // NOLINT
+    for(unsigned chronon=0; chronon<8; ++chronon) { // NOLINT
+        sim.doIteration();
+        stealingSim.doIteration();
+        requireSameMap(sim, stealingSim);
+    }
+}
+
+TEST_CASE("WaTor::Simulation rebalancing") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    const bool persistent = GENERATE(false, true);
+    const Rules rules{64, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.lineHeight = 16; // NOLINT
+    opts.persistentWorkers = persistent;
+    SimulationOptions rebalanceOpts = opts;
+    rebalanceOpts.rebalancePeriod = 1;
+    rebalanceOpts.rebalanceThreshold = 0;
+
+    // a single worker keeps all the pairs
+    Simulation sim{rules, exp, 9, opts}; // NOLINT
+    Simulation rebalanceSim{rules, exp, 9, rebalanceOpts}; // NOLINT
+    for(unsigned chronon=0; chronon<6; ++chronon) { // NOLINT
+        sim.doIteration();
+        rebalanceSim.doIteration();
+        requireSameMap(sim, rebalanceSim);
+    }
+    CHECK(rebalanceSim.getMovedPairCnt() == 0);
+
+    rebalanceOpts.engine = SimulationEngine::BITBOARD;
+    CHECK_THROWS_AS((Simulation{rules, exp, 9, rebalanceOpts}), std::invalid_argument); // NOLINT
+    rebalanceOpts.engine = SimulationEngine::TILE;
+    rebalanceOpts.workStealing = true;
+    CHECK_THROWS_AS((Simulation{rules, exp, 9, rebalanceOpts}), std::invalid_argument); // NOLINT
+}
+
+TEST_CASE("WaTor::Simulation rebalancing with several workers") {  // NOLINT
+    ExecutionPlanner exp = makeMultiWorkerMock();
+
+    const bool persistent = GENERATE(false, true);
+    // 1 or 8 pairs of lines per worker
+    const unsigned lineHeight = GENERATE(16U, 2U);
+    const Rules rules{96, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.lineHeight = lineHeight;
+    opts.persistentWorkers = persistent;
+    SimulationOptions rebalanceOpts = opts;
+    rebalanceOpts.rebalancePeriod = 1;
+    rebalanceOpts.rebalanceThreshold = 0;
+
+    // the pairs are handed between the workers, not the rows between the
+    // lines, so the maps stay the same whichever worker updates a pair
+    Simulation sim{rules, exp, 9, opts}; // NOLINT
+    Simulation rebalanceSim{rules, exp, 9, rebalanceOpts}; // NOLINT
+    for(unsigned chronon=0; chronon<8; ++chronon) { // NOLINT
+        sim.doIteration();
+        rebalanceSim.doIteration();
+        requireSameMap(sim, rebalanceSim);
+    }
+}
+
+TEST_CASE("WaTor::Simulation dataflow synchronisation") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    const SimulationEngine engine = GENERATE(SimulationEngine::TILE, SimulationEngine::BITBOARD);
+    // 1 or 3 pairs of lines
+    const unsigned lineHeight = GENERATE(32U, 10U);
+    // temporal blocks shorter and longer than doIterations
+    const unsigned temporalBlock = GENERATE(0U, 3U, 5U);
+    const Rules rules{64, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.engine = engine;
+    opts.lineHeight = lineHeight;
+    SimulationOptions flowOpts = opts;
+    flowOpts.dataflowSync = true;
+    flowOpts.temporalBlock = temporalBlock;
+    if(temporalBlock > 1 && lineHeight == 32) {
+        CHECK_THROWS_AS((Simulation{rules, exp, 9, flowOpts}), std::invalid_argument); // NOLINT
+        return;
+    }
+
+    Simulation sim{rules, exp, 9, opts}; // NOLINT
+    Simulation flowSim{rules, exp, 9, flowOpts}; // NOLINT
+    for(unsigned chronon=0; chronon<8; chronon += 4) { // NOLINT
+        requireSameMap(sim, flowSim);
+
+        // several chronons at once or one by one
+        sim.doIterations(4); // NOLINT
+        if(chronon == 0) {
+            flowSim.doIterations(4); // NOLINT
+        } else {
+            for(unsigned i=0; i<4; ++i) { // NOLINT
+                flowSim.doIteration();
+            }
+        }
+    }
+    requireSameMap(sim, flowSim);
+    CHECK(flowSim.getAllRunTime().count() > 0);
+
+    flowOpts.persistentWorkers = true;
+    CHECK_THROWS_AS((Simulation{rules, exp, 9, flowOpts}), std::invalid_argument); // NOLINT
+    opts.temporalBlock = 3;
+    CHECK_THROWS_AS((Simulation{rules, exp, 9, opts}), std::invalid_argument); // NOLINT
+}
+
+TEST_CASE("WaTor::Simulation dataflow synchronisation with several workers") {  // NOLINT
+    ExecutionPlanner exp = makeMultiWorkerMock();
+
+    const SimulationEngine engine = GENERATE(SimulationEngine::TILE, SimulationEngine::BITBOARD);
+    // 1 or 3 pairs of lines per worker
+    const unsigned lineHeight = GENERATE(16U, 5U);
+    // temporal blocks shorter and longer than doIterations, a single pair 
+    // can not be blocked
+    const unsigned temporalBlock = GENERATE(0U, 2U, 4U);
+    if(temporalBlock > 1 && lineHeight == 16) {
+        return;
+    }
+    const Rules rules{96, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.engine = engine;
+    opts.lineHeight = lineHeight;
+    SimulationOptions flowOpts = opts;
+    flowOpts.dataflowSync = true;
+    flowOpts.temporalBlock = temporalBlock;
+
+    Simulation sim{rules, exp, 9, opts}; // NOLINT
+    Simulation flowSim{rules, exp, 9, flowOpts}; // NOLINT
+    // the workers run ahead of each other by up to the chronons of a call
+    for(unsigned cnt : {1U, 2U, 5U, 3U, 8U}) { // NOLINT
+        sim.doIterations(cnt);
+        flowSim.doIterations(cnt);
+        requireSameMap(sim, flowSim);
+    }
+}
+
+TEST_CASE("WaTor::Simulation does not depend on the workers") {  // NOLINT
+    ExecutionPlanner oneWorkerExp = ExecutionPlanner::makeMock({0}, {{0}});
+    ExecutionPlanner exp = makeMultiWorkerMock();
+
+    const SimulationEngine engine = GENERATE(SimulationEngine::TILE, SimulationEngine::BITBOARD);
+    // 2 pairs of lines per worker, or 2, 1 and 1
+    const unsigned lineHeight = GENERATE(8U, 10U);
+    // plain, persistent workers, work stealing, rebalancing, dataflow 
+    // synchronisation or out-of-core
+    const unsigned mode = GENERATE(range(0U, 6U));
+    if(engine == SimulationEngine::BITBOARD && (mode == 3 || mode == 5)) {
+        return;
+    }
+    const Rules rules{96, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.engine = engine;
+    opts.lineHeight = lineHeight;
+    SimulationOptions workersOpts = opts;
+    workersOpts.persistentWorkers = (mode == 1);
+    workersOpts.workStealing = (mode == 2);
+    workersOpts.rebalancePeriod = (mode == 3) ? 1 : 0;
+    workersOpts.rebalanceThreshold = 0;
+    workersOpts.dataflowSync = (mode == 4);
+    if(mode == 5) {
+        workersOpts.scratchDir = std::filesystem::temp_directory_path().string();
+    }
+
+    Simulation sim{rules, oneWorkerExp, 9, opts}; // NOLINT
+    Simulation workersSim{rules, exp, 9, workersOpts}; // NOLINT
+    for(unsigned chronon=0; chronon<8; ++chronon) { // NOLINT
+        requireSameMap(sim, workersSim);
+
+        sim.doIteration();
+        workersSim.doIteration();
+    }
+
+    // every worker needs a pair of lines
+    opts.lineHeight = 20; // NOLINT
+    if(exp.getCpuCnt() == 3) {
+        CHECK_THROWS_AS((Simulation{rules, exp, 9, opts}), std::invalid_argument); // NOLINT
+    }
+}
+
+TEST_CASE("WaTor::Simulation .makeNumaAudit") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    const Rules rules{64, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    SimulationOptions opts;
+    opts.lineHeight = 16; // NOLINT
+    Simulation sim{rules, exp, 9, opts}; // NOLINT
+    sim.doIteration();
+
+    const NumaAudit audit = sim.makeNumaAudit();
+    // the buffers of the 4 lines and the stack of this thread at least
+    CHECK(audit.getRangeCnt() >= 13);
+
+    const std::vector<NumaResidency> res = audit.audit(8); // NOLINT
+    if(NumaAudit::isAvailable()) {
+        REQUIRE(!res.empty());
+        CHECK(res.front().kind == "map lines");
+        CHECK(res.front().expectedNode == 0);
+        CHECK(res.front().getPresentPages() != 0);
+        CHECK(res.back().kind == "worker stacks");
+    }
+}
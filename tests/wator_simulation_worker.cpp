@@ -0,0 +1,368 @@
+#include <catch2/catch.hpp>
+
+#include "wator/entity.hpp"
+#include "wator/map.hpp"
+#include "wator/rules.hpp"
+#include "wator/simulation_worker.hpp"
+#include "wator/tile.hpp"
+
+using namespace WaTor;
+
+TEST_CASE("WaTor::SimulationWorker single fish") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    const unsigned seed = GENERATE(1U, 2U, 3U, 4U, 5U, 6U, 7U, 8U);
+    // line edges, the map edges and the middle
+    const unsigned posy = GENERATE(0U, 2U, 4U, 5U, 11U, 12U, 23U);
+    const unsigned posx = GENERATE(0U, 3U, 69U);
+
+    Map map{24, 70, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    const Rules rules{24, 70, 1, 0, 10, 10, 3}; // NOLINT
+
+    const unsigned lineHeight = map.getMapLineHeight(0, 0);
+    REQUIRE(map.getMapNuma(0).getLineCnt() == 4);
+    map.get(0, posy / lineHeight, posy % lineHeight, posx) = Tile{Entity::FISH, 0, 0};
+
+    // two chronons, even lines first
+    for(unsigned chronon=0; chronon<2; ++chronon) {
+        const bool parity = (chronon % 2) != 0;
+        SimulationWorker{map, 0, 0, rules, seed, chronon}();
+        SimulationWorker{map, 0, 2, rules, seed, chronon}();
+        SimulationWorker{map, 0, 1, rules, seed, chronon}();
+        SimulationWorker{map, 0, 3, rules, seed, chronon}();
+
+        unsigned fishCnt = 0;
+        for(unsigned lineInd=0; lineInd<4; ++lineInd) {
+            for(unsigned y=0; y<lineHeight; ++y) {
+                for(unsigned x=0; x<map.getWidth(); ++x) {
+                    const Tile &tile = map.get(0, lineInd, y, x);
+                    if(tile.getEntity() == Entity::WATER) {
+                        continue;
+                    }
+                    REQUIRE(tile.getEntity() == Entity::FISH);
+                    // moved exactly once in every chronon
+                    CHECK(tile.getAge() == chronon+1);
+                    CHECK(tile.getParity() == !parity);
+                    ++fishCnt;
+                }
+            }
+        }
+        CHECK(fishCnt == 1);
+    }
+}
+
+TEST_CASE("WaTor::SimulationWorker occupancy") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    const unsigned seed = GENERATE(1U, 2U, 3U, 4U);
+    // the fish cross block borders and wrap around
+    constexpr unsigned width = 3*MapLine::BLOCK_WIDTH + 7;
+    const std::vector<unsigned> fishColumns = {0, 63, 64, 127, 128, width-1};
+
+    Map map{24, width, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    const Rules rules{24, width, 6, 0, 14, 10, 3}; // NOLINT
+
+    REQUIRE(map.getMapNuma(0).getLineCnt() == 4);
+    for(unsigned i=0; i<fishColumns.size(); ++i) {
+        map.get(0, i%4, (5*i) % map.getMapLineHeight(0, i%4), fishColumns[i]) = Tile{Entity::FISH, 0, 0};
+    }
+
+    for(unsigned chronon=0; chronon<12; ++chronon) { // NOLINT
+        SimulationWorker{map, 0, 0, rules, seed, chronon}();
+        SimulationWorker{map, 0, 2, rules, seed, chronon}();
+        SimulationWorker{map, 0, 1, rules, seed, chronon}();
+        SimulationWorker{map, 0, 3, rules, seed, chronon}();
+
+        unsigned fishCnt = 0;
+        for(unsigned lineInd=0; lineInd<4; ++lineInd) {
+            const MapLine &line = map.getMapNuma(0).getLine(lineInd);
+            for(unsigned y=0; y<line.getHeight(); ++y) {
+                for(unsigned x=0; x<line.getWidth(); ++x) {
+                    const Tile &tile = line.get(y, x);
+                    if(tile.getEntity() == Entity::WATER) {
+                        continue;
+                    }
+                    // a block with an entity is never skipped
+                    CHECK(line.isBlockOccupied(y, x / MapLine::BLOCK_WIDTH));
+                    CHECK(tile.getAge() == chronon+1);
+                    ++fishCnt;
+                }
+            }
+        }
+        CHECK(fishCnt == fishColumns.size());
+    }
+}
+
+TEST_CASE("WaTor::BasicSimulationWorker fixed rules") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    using Policy = FixedRulesPolicy<3, 10, 3>;
+    const Rules rules{40, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    REQUIRE(Policy::matches(rules));
+    REQUIRE_FALSE(Policy::matches(Rules{40, 150, 1500, 300, 3, 10, 4})); // NOLINT
+
+    Map runtimeMap{40, 150, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    Map fixedMap{40, 150, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    runtimeMap.randomize(rules, 42); // NOLINT
+    fixedMap.randomize(rules, 42); // NOLINT
+
+    // the same results as the runtime rules
+    for(unsigned chronon=0; chronon<20; ++chronon) { // NOLINT
+        for(unsigned lineInd : {0U, 2U, 1U, 3U}) {
+            SimulationWorker{runtimeMap, 0, lineInd, rules, 42, chronon}(); // NOLINT
+            BasicSimulationWorker<Policy>{fixedMap, 0, lineInd, rules, 42, chronon}(); // NOLINT
+        }
+    }
+
+    for(unsigned lineInd=0; lineInd<4; ++lineInd) {
+        const MapLine &runtimeLine = runtimeMap.getMapNuma(0).getLine(lineInd);
+        const MapLine &fixedLine = fixedMap.getMapNuma(0).getLine(lineInd);
+        for(std::size_t i=0; i<runtimeLine.getAbsSize(); ++i) {
+            REQUIRE(runtimeLine.getAbs(i) == fixedLine.getAbs(i));
+        }
+    }
+}
+
+TEST_CASE("WaTor::SimulationWorker random numbers do not depend on the lines") {  // NOLINT
+    const unsigned seed = GENERATE(1U, 2U, 3U, 4U);
+    const unsigned posy = GENERATE(0U, 5U, 11U, 23U);
+    const unsigned posx = GENERATE(0U, 3U, 69U);
+    constexpr unsigned height = 24, width = 70;
+    const Rules rules{height, width, 1, 0, 10, 10, 3}; // NOLINT
+
+    // a lone fish does not interact with anything, so its path is the
+    // same with any split of the map
+    auto fishPath = [&](std::vector<unsigned> numaList, std::vector<std::vector<unsigned>> cpusPerNuma) {
+        ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+        Map map{height, width, exp, std::make_unique<MockAllocStrategy>()};
+
+        auto findLine = [&map](unsigned globy, unsigned &numaInd, unsigned &lineInd) {
+            for(numaInd=0; numaInd<map.getMapNumaCnt(); ++numaInd) {
+                for(lineInd=0; lineInd<map.getMapNuma(numaInd).getLineCnt(); ++lineInd) {
+                    const unsigned first = map.getLineFirstRow(numaInd, lineInd);
+                    if(globy < first + map.getMapLineHeight(numaInd, lineInd)) {
+                        return globy - first;
+                    }
+                }
+            }
+            return 0U;
+        };
+        unsigned numaInd, lineInd; // NOLINT
+        const unsigned y = findLine(posy, numaInd, lineInd);
+        map.get(numaInd, lineInd, y, posx) = Tile{Entity::FISH, 0, 0};
+
+        std::vector<std::pair<unsigned, unsigned>> path;
+        for(unsigned chronon=0; chronon<10; ++chronon) { // NOLINT
+            for(unsigned odd=0; odd<2; ++odd) {
+                for(unsigned numa=0; numa<map.getMapNumaCnt(); ++numa) {
+                    for(unsigned line=odd; line<map.getMapNuma(numa).getLineCnt(); line += 2) {
+                        SimulationWorker{map, numa, line, rules, seed, chronon}();
+                    }
+                }
+            }
+            for(unsigned numa=0; numa<map.getMapNumaCnt(); ++numa) {
+                for(unsigned line=0; line<map.getMapNuma(numa).getLineCnt(); ++line) {
+                    for(unsigned yy=0; yy<map.getMapLineHeight(numa, line); ++yy) {
+                        for(unsigned x=0; x<width; ++x) {
+                            if(map.get(numa, line, yy, x).getEntity() == Entity::FISH) {
+                                path.emplace_back(map.getLineFirstRow(numa, line) + yy, x);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return path;
+    };
+
+    const auto reference = fishPath({0}, {{0}});
+    CHECK(reference.size() == 10);
+    CHECK(fishPath({0}, {{0, 1}}) == reference);
+    CHECK(fishPath({0}, {{0, 1, 2}}) == reference);
+    CHECK(fishPath({0, 1}, {{0}, {1}}) == reference);
+}
+
+TEST_CASE("WaTor::BasicSimulationWorker kernel instruction sets") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    // wide enough for full 64 tile blocks
+    const Rules rules{40, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    CHECK(isKernelIsaSupported(KernelIsa::GENERIC));
+    CHECK(isKernelIsaSupported(detectKernelIsa()));
+
+    Map genericMap{40, 150, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    Map avx2Map{40, 150, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    Map avx512Map{40, 150, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    for(Map *map : {&genericMap, &avx2Map, &avx512Map}) {
+        map->randomize(rules, 42); // NOLINT
+    }
+
+    const bool avx2 = isKernelIsaSupported(KernelIsa::AVX2);
+    const bool avx512 = isKernelIsaSupported(KernelIsa::AVX512);
+
+    // the same results as the generic kernel
+    for(unsigned chronon=0; chronon<20; ++chronon) { // NOLINT
+        for(unsigned lineInd : {0U, 2U, 1U, 3U}) {
+            SimulationWorker{genericMap, 0, lineInd, rules, 7, chronon}(); // NOLINT
+            if(avx2) {
+                BasicSimulationWorker<RuntimeRulesPolicy, KernelIsa::AVX2>{avx2Map, 0, lineInd, rules, 7, chronon}(); // NOLINT
+            }
+            if(avx512) {
+                BasicSimulationWorker<RuntimeRulesPolicy, KernelIsa::AVX512>{avx512Map, 0, lineInd, rules, 7, chronon}(); // NOLINT
+            }
+        }
+    }
+
+    for(unsigned lineInd=0; lineInd<4; ++lineInd) {
+        const MapLine &genericLine = genericMap.getMapNuma(0).getLine(lineInd);
+        const MapLine &avx2Line = avx2Map.getMapNuma(0).getLine(lineInd);
+        const MapLine &avx512Line = avx512Map.getMapNuma(0).getLine(lineInd);
+        for(std::size_t i=0; i<genericLine.getAbsSize(); ++i) {
+            if(avx2) {
+                REQUIRE(genericLine.getAbs(i) == avx2Line.getAbs(i));
+            }
+            if(avx512) {
+                REQUIRE(genericLine.getAbs(i) == avx512Line.getAbs(i));
+            }
+        }
+    }
+}
+
+TEST_CASE("WaTor::SimulationWorker entity plane") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    // partial last block
+    const Rules rules{40, 150, 1500, 300, 3, 10, 3}; // NOLINT
+    Map tilesMap{40, 150, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+    Map splitMap{40, 150, exp, std::make_unique<MockAllocStrategy>(), MapLineStorage::SPLIT}; // NOLINT
+    tilesMap.randomize(rules, 42); // NOLINT
+    splitMap.randomize(rules, 42); // NOLINT
+
+    // the same results as without the plane, and the plane is kept up to date
+    for(unsigned chronon=0; chronon<20; ++chronon) { // NOLINT
+        for(unsigned lineInd : {0U, 2U, 1U, 3U}) {
+            SimulationWorker{tilesMap, 0, lineInd, rules, 7, chronon}(); // NOLINT
+            SimulationWorker{splitMap, 0, lineInd, rules, 7, chronon}(); // NOLINT
+        }
+
+        for(unsigned lineInd=0; lineInd<4; ++lineInd) {
+            const MapLine &tilesLine = tilesMap.getMapNuma(0).getLine(lineInd);
+            const MapLine &splitLine = splitMap.getMapNuma(0).getLine(lineInd);
+            for(unsigned posy=0; posy<splitLine.getHeight(); ++posy) {
+                const MapLine::EntityWord *entRow = splitLine.getEntityRowPtr(posy);
+                for(unsigned posx=0; posx<splitLine.getWidth(); ++posx) {
+                    const Tile &tile = splitLine.get(posy, posx);
+                    REQUIRE(tile == tilesLine.get(posy, posx));
+
+                    const MapLine::EntityWord *block = entRow + 
+                            MapLine::ENTITY_WORDS_PER_BLOCK*(posx / MapLine::BLOCK_WIDTH);
+                    const unsigned bit = posx % MapLine::BLOCK_WIDTH;
+                    REQUIRE(((block[MapLine::ENTITY_WATER] >> bit) & 1U) == 
+                            static_cast<unsigned>(tile.getEntity() == Entity::WATER));
+                    REQUIRE(((block[MapLine::ENTITY_FISH] >> bit) & 1U) == 
+                            static_cast<unsigned>(tile.getEntity() == Entity::FISH));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("WaTor::SimulationWorker panels") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    const MapLineStorage storage = GENERATE(MapLineStorage::TILES, MapLineStorage::SPLIT);
+    // the entities cross the seams of the panels and wrap around the last, narrower one
+    const unsigned width = 2*MapLine::PANEL_WIDTH + 100; // NOLINT
+    const Rules rules{24, width, 24*width/4, 24*width/12, 3, 10, 3}; // NOLINT
+    Map rowsMap{24, width, exp, std::make_unique<MockAllocStrategy>(), storage}; // NOLINT
+    Map panelsMap{24, width, exp, std::make_unique<MockAllocStrategy>(), storage, MapLineLayout::PANELS}; // NOLINT
+    rowsMap.randomize(rules, 5); // NOLINT
+    panelsMap.randomize(rules, 5); // NOLINT
+
+    for(unsigned chronon=0; chronon<10; ++chronon) { // NOLINT
+        for(unsigned lineInd : {0U, 2U, 1U, 3U}) {
+            SimulationWorker{rowsMap, 0, lineInd, rules, 3, chronon}(); // NOLINT
+            SimulationWorker{panelsMap, 0, lineInd, rules, 3, chronon}(); // NOLINT
+        }
+    }
+
+    for(unsigned lineInd=0; lineInd<4; ++lineInd) {
+        const MapLine &rowsLine = rowsMap.getMapNuma(0).getLine(lineInd);
+        const MapLine &panelsLine = panelsMap.getMapNuma(0).getLine(lineInd);
+        REQUIRE(panelsLine.getPanelCnt() == 3);
+        for(std::size_t i=0; i<rowsLine.getAbsSize(); ++i) {
+            REQUIRE(rowsLine.getAbs(i) == panelsLine.getAbs(i));
+        }
+    }
+}
+
+TEST_CASE("WaTor::SimulationWorker column strips") {  // NOLINT
+    std::vector<unsigned> numaList = {0};
+    std::vector<std::vector<unsigned>> cpusPerNuma = {{0, 1}};
+    ExecutionPlanner exp = ExecutionPlanner::makeMock(std::move(numaList), std::move(cpusPerNuma));
+
+    // the fish do not breed, so every one of them ages by one in every chronon
+    const unsigned width = 300; // NOLINT
+    const Rules rules{24, width, 24*width/3, 0, 14, 10, 3}; // NOLINT
+
+    SECTION("every entity is updated once") {
+        const unsigned stripWidth = GENERATE(1U, 64U, 128U);
+        Map map{24, width, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+        map.randomize(rules, 3); // NOLINT
+
+        for(unsigned chronon=0; chronon<10; ++chronon) { // NOLINT
+            for(unsigned lineInd : {0U, 2U, 1U, 3U}) {
+                SimulationWorker{map, 0, lineInd, rules, 9, chronon, stripWidth}(); // NOLINT
+            }
+
+            std::size_t fishCnt = 0;
+            for(unsigned lineInd=0; lineInd<4; ++lineInd) {
+                const MapLine &line = map.getMapNuma(0).getLine(lineInd);
+                for(std::size_t i=0; i<line.getAbsSize(); ++i) {
+                    const Tile &tile = line.getAbs(i);
+                    if(tile.getEntity() == Entity::WATER) {
+                        continue;
+                    }
+                    REQUIRE(tile.getAge() == chronon+1);
+                    REQUIRE(tile.getParity() == ((chronon % 2) == 0));
+                    ++fishCnt;
+                }
+            }
+            REQUIRE(fishCnt == rules.getInitialFishCnt());
+        }
+    }
+
+    SECTION("a strip as wide as the line sweeps whole rows") {
+        Map rowsMap{24, width, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+        Map stripMap{24, width, exp, std::make_unique<MockAllocStrategy>()}; // NOLINT
+        rowsMap.randomize(rules, 3); // NOLINT
+        stripMap.randomize(rules, 3); // NOLINT
+
+        for(unsigned chronon=0; chronon<10; ++chronon) { // NOLINT
+            for(unsigned lineInd : {0U, 2U, 1U, 3U}) {
+                SimulationWorker{rowsMap, 0, lineInd, rules, 9, chronon}(); // NOLINT
+                SimulationWorker{stripMap, 0, lineInd, rules, 9, chronon, width}(); // NOLINT
+            }
+        }
+
+        for(unsigned lineInd=0; lineInd<4; ++lineInd) {
+            const MapLine &rowsLine = rowsMap.getMapNuma(0).getLine(lineInd);
+            const MapLine &stripLine = stripMap.getMapNuma(0).getLine(lineInd);
+            for(std::size_t i=0; i<rowsLine.getAbsSize(); ++i) {
+                REQUIRE(rowsLine.getAbs(i) == stripLine.getAbs(i));
+            }
+        }
+    }
+}
@@ -1,6 +1,9 @@
 #include <catch2/catch.hpp>
 
+#include <stdexcept>
+
 #include "wator/entity.hpp"
+#include "wator/rules.hpp"
 #include "wator/tile.hpp"
 
 TEST_CASE("Wator::Tile water usage") {
@@ -94,3 +97,65 @@ TEST_CASE("Wator::Tile shark usage") { // NOLINT
         }
     }
 }
+
+TEST_CASE("Wator::Tile raw layout") { // NOLINT
+    using namespace WaTor;
+
+    CHECK(Tile{}.getRaw() == 0);
+
+    for(unsigned i=0; i<=Tile::MAX_AGE; ++i) {
+        const Tile fish{Entity::FISH, i, 0};
+        CHECK(fish.getRaw() != 0);
+        CHECK((fish.getRaw() & Tile::RAW_LAST_ATE_MASK) == 0);
+
+        for(unsigned j=0; j<=Tile::MAX_LAST_ATE; ++j) {
+            const Tile shark{Entity::SHARK, i, j};
+            CHECK((shark.getRaw() & Tile::RAW_LAST_ATE_MASK) != 0);
+        }
+    }
+}
+
+TEST_CASE("Wator::Tile parity") { // NOLINT
+    using namespace WaTor;
+
+    for(unsigned i=0; i<=Tile::MAX_AGE; ++i) {
+        Tile fish{Entity::FISH, i, 0};
+        CHECK(!fish.getParity());
+
+        fish.setParity(true);
+        CHECK(fish.getParity());
+        CHECK(fish.getEntity() == Entity::FISH);
+        CHECK(fish.getAge() == i);
+        CHECK(fish == Tile{Entity::FISH, i, 0});
+        CHECK((fish.getRaw() & Tile::RAW_PARITY_MASK) != 0);
+        CHECK((fish.getRaw() & Tile::RAW_LAST_ATE_MASK) == 0);
+
+        for(unsigned j=0; j<=Tile::MAX_LAST_ATE; ++j) {
+            Tile shark{Entity::SHARK, i, j};
+            shark.setParity(true);
+            shark.setAge(Tile::MAX_AGE - i);
+            CHECK(shark.getParity());
+            CHECK(shark.getEntity() == Entity::SHARK);
+            CHECK(shark.getAge() == Tile::MAX_AGE - i);
+            CHECK(shark.getLastAte() == j);
+
+            shark.setParity(false);
+            CHECK(!shark.getParity());
+        }
+
+        fish.set(Entity::WATER, 0, 0);
+        CHECK(!fish.getParity());
+        CHECK(fish.getRaw() == 0);
+    }
+}
+
+TEST_CASE("WaTor::Rules limits") { // NOLINT
+    using namespace WaTor;
+
+    // the starve time shares the bits of the Tile with the parity
+    CHECK(Rules::MAX_SHARK_STARVE_TIME == 6);
+    CHECK_NOTHROW(Rules{10, 10, 1, 1, 14, 14, 6}); // NOLINT
+    CHECK_THROWS_AS((Rules{10, 10, 1, 1, 3, 10, 7}), std::runtime_error); // NOLINT
+    CHECK_THROWS_AS((Rules{10, 10, 1, 1, 15, 10, 3}), std::runtime_error); // NOLINT
+    CHECK_THROWS_AS((Rules{10, 10, 1, 1, 3, 15, 3}), std::runtime_error); // NOLINT
+}